@@ -0,0 +1,230 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include <gsl/span>
+
+#include <albert/bencode/bencoding.hpp>
+
+namespace albert::bencoding {
+
+class Arena;
+class Parser;
+struct ArenaEntry;
+
+/**
+ * Bencoding node allocated in an Arena.
+ *
+ * A node is a 16 bytes handle and is trivially destructible, so dropping an arena never runs destructors.
+ * Children of a list or dict are stored inline in one contiguous array in the arena.
+ * Decoded strings point into the input buffer, which must outlive the nodes.
+ */
+class ArenaNode {
+ public:
+  ArenaNode() :type_(Type::Int), size_(0), int_(0) { }
+
+  static ArenaNode string(std::string_view s);
+  static ArenaNode integer(int64_t i);
+  static ArenaNode list(const ArenaNode *items, size_t size);
+  static ArenaNode dict(const ArenaEntry *entries, size_t size);
+
+  // Decode the first value in data, trailing bytes are ignored
+  static ArenaNode decode(Arena &arena, gsl::span<const uint8_t> data);
+  // Decode the next value from a pull parser
+  static ArenaNode decode(Arena &arena, Parser &parser);
+
+  [[nodiscard]]
+  Type type() const { return type_; }
+  [[nodiscard]]
+  bool is_string() const { return type_ == Type::String; }
+  [[nodiscard]]
+  bool is_int() const { return type_ == Type::Int; }
+  [[nodiscard]]
+  bool is_list() const { return type_ == Type::List; }
+  [[nodiscard]]
+  bool is_dict() const { return type_ == Type::Dict; }
+
+  // Typed accessors, they throw std::invalid_argument on type mismatch
+  [[nodiscard]]
+  std::string_view as_string() const;
+  [[nodiscard]]
+  int64_t as_int() const;
+  [[nodiscard]]
+  gsl::span<const ArenaNode> as_list() const;
+  [[nodiscard]]
+  gsl::span<const ArenaEntry> as_dict() const;
+
+  // Number of items in a list or dict
+  [[nodiscard]]
+  size_t size() const { return size_; }
+  // List item, index must be in range
+  const ArenaNode &operator[](size_t i) const { return items_[i]; }
+  // Dict lookup, returns nullptr if the key does not exist or the node is not a dict
+  [[nodiscard]]
+  const ArenaNode *find(std::string_view key) const;
+
+  // Convert to a value of type T, see bencoding::get
+  template <typename T>
+  T as() const;
+
+  void encode(std::ostream &os, EncodeMode mode = EncodeMode::Bencoding, size_t depth = 0) const;
+  void encode(JsonWriter &writer) const;
+
+ private:
+  ArenaNode(Type type, uint32_t size) :type_(type), size_(size), int_(0) { }
+
+ private:
+  Type type_;
+  uint32_t size_;
+  union {
+    const char *str_;
+    int64_t int_;
+    const ArenaNode *items_;
+    const ArenaEntry *entries_;
+  };
+};
+
+struct ArenaEntry {
+  std::string_view key;
+  ArenaNode value;
+};
+
+static_assert(std::is_trivially_destructible_v<ArenaNode>);
+static_assert(std::is_trivially_destructible_v<ArenaEntry>);
+
+/**
+ * Bump allocator for ArenaNode.
+ *
+ * Memory is taken from a list of chunks and released all at once by reset().
+ * Chunks are kept across resets, so once the arena has grown to the size of the largest message
+ *   decoding does not allocate any more.
+ */
+class Arena {
+ public:
+  static constexpr size_t DefaultChunkSize = 16 * 1024;
+
+  explicit Arena(size_t chunk_size = DefaultChunkSize) :chunk_size_(chunk_size) { }
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  void *allocate(size_t size, size_t align = alignof(std::max_align_t));
+
+  template <typename T>
+  T *allocate_array(size_t n) {
+    static_assert(std::is_trivially_destructible_v<T>, "Arena objects are never destructed");
+    if (n == 0) {
+      return nullptr;
+    }
+    return static_cast<T*>(allocate(sizeof(T) * n, alignof(T)));
+  }
+
+  // Copy s into the arena
+  std::string_view copy(std::string_view s);
+
+  // Release everything allocated so far, all nodes from this arena become invalid
+  void reset();
+
+  // Bytes handed out since the last reset
+  [[nodiscard]]
+  size_t allocated() const { return allocated_; }
+  [[nodiscard]]
+  size_t chunk_count() const { return chunks_.size(); }
+  [[nodiscard]]
+  size_t memory_size() const;
+
+ private:
+  friend class ArenaNode;
+
+  struct Chunk {
+    std::unique_ptr<uint8_t[]> data;
+    size_t size;
+  };
+  std::vector<Chunk> chunks_;
+  // index of the chunk being filled, equals chunks_.size() if there is none
+  size_t current_ = 0;
+  size_t offset_ = 0;
+  size_t chunk_size_;
+  size_t allocated_ = 0;
+
+  // Children of the containers being decoded, reused across messages
+  std::vector<ArenaNode> list_stack_;
+  std::vector<ArenaEntry> dict_stack_;
+};
+
+template <typename T>
+T ArenaNode::as() const {
+  using V = std::remove_cv_t<std::remove_reference_t<T>>;
+  if constexpr (std::is_same_v<V, ArenaNode>) {
+    return *this;
+  } else if constexpr (std::is_same_v<V, std::string_view>) {
+    return as_string();
+  } else if constexpr (std::is_same_v<V, std::string>) {
+    return std::string(as_string());
+  } else if constexpr (std::is_integral_v<V>) {
+    return static_cast<V>(as_int());
+  } else {
+    static_assert(std::is_same_v<V, ArenaNode>, "bencoding::ArenaNode::as<T>, unsupported type");
+  }
+}
+
+template <typename T>
+T get(const ArenaNode &dict, std::string_view key) {
+  auto node = dict.find(key);
+  if (!node) {
+    throw std::invalid_argument("bencoding::get(ArenaNode, " + std::string(key) + "), key not found");
+  }
+  try {
+    return node->as<T>();
+  } catch (const std::invalid_argument &) {
+    throw std::invalid_argument("bencoding::get(ArenaNode, " + std::string(key) + "), item is not " + typeid(T).name());
+  }
+}
+
+template <typename T>
+T get(const ArenaNode &list, size_t index) {
+  if (!list.is_list()) {
+    throw std::invalid_argument("bencoding::get(ArenaNode, " + std::to_string(index) + "), node is not a list");
+  }
+  if (index >= list.size()) {
+    throw std::invalid_argument("bencoding::get(ArenaNode) index out of range: i=" + std::to_string(index) + ", size=" + std::to_string(list.size()));
+  }
+  try {
+    return list[index].as<T>();
+  } catch (const std::invalid_argument &) {
+    throw std::invalid_argument("bencoding::get(ArenaNode, " + std::to_string(index) + "), item is not " + typeid(T).name());
+  }
+}
+
+template <typename T>
+ArenaNode make_node(Arena &arena, T &&t) {
+  using V = std::remove_cv_t<std::remove_reference_t<T>>;
+  if constexpr (std::is_same_v<V, ArenaNode>) {
+    return t;
+  } else if constexpr (std::is_integral_v<V>) {
+    return ArenaNode::integer(t);
+  } else {
+    return ArenaNode::string(arena.copy(std::string_view(t)));
+  }
+}
+
+template <typename ... Args>
+ArenaNode make_list(Arena &arena, Args&&... args) {
+  constexpr size_t n = sizeof...(Args);
+  auto items = arena.allocate_array<ArenaNode>(n);
+  if constexpr (n > 0) {
+    size_t i = 0;
+    ((items[i++] = make_node(arena, std::forward<Args>(args))), ...);
+  }
+  return ArenaNode::list(items, n);
+}
+
+}
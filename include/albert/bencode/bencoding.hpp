@@ -6,12 +6,18 @@
 #include <memory>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
+#include <gsl/span>
+
 namespace albert::bencoding {
 
+class JsonWriter;
+class Parser;
+
 enum class Type {
   String,
   Int,
@@ -28,11 +34,16 @@ class Node {
  public:
   Node(Type type) :type_(type) { }
   static std::shared_ptr<Node> decode(std::istream &);
+  // Decode the first value in data, trailing bytes are ignored
+  static std::shared_ptr<Node> decode(gsl::span<const uint8_t> data);
+  // Same as above, consumed is set to the size of the decoded value
+  static std::shared_ptr<Node> decode(gsl::span<const uint8_t> data, size_t &consumed);
+  // Decode the next value from a pull parser
+  static std::shared_ptr<Node> decode(Parser &parser);
   Type type() const { return type_; }
   virtual void encode(std::ostream &os, EncodeMode = EncodeMode::Bencoding, size_t depth = 0) const = 0;
+  virtual void encode(JsonWriter &writer) const = 0;
   virtual ~Node() = default;
- protected:
-  static std::ostream &make_indent(std::ostream &os, size_t depth);
  private:
   Type type_;
 };
@@ -45,6 +56,7 @@ class StringNode :public Node {
     return s_;
   }
   void encode(std::ostream &os, EncodeMode mode = EncodeMode::Bencoding, size_t depth = 0) const override;
+  void encode(JsonWriter &writer) const override;
  private:
   std::string s_;
 };
@@ -53,6 +65,7 @@ class IntNode :public Node {
   explicit IntNode(int64_t i) :Node(Type::Int), i_(i) { }
   operator int64_t() const { return i_; }
   void encode(std::ostream &os, EncodeMode mode, size_t depth = 0) const override;
+  void encode(JsonWriter &writer) const override;
  private:
   int64_t i_;
 };
@@ -63,6 +76,7 @@ class ListNode :public Node {
   explicit ListNode(std::vector<std::shared_ptr<Node>> nodes = {}) :Node(Type::List), list_(std::move(nodes)) { }
 
   void encode(std::ostream &os, EncodeMode mode, size_t depth = 0) const override;
+  void encode(JsonWriter &writer) const override;
   size_t size() const { return list_.size(); }
   std::shared_ptr<const Node> operator[](size_t i) const {
     return list_[i];
@@ -86,6 +100,7 @@ class DictNode :public Node {
     return dict_;
   }
   void encode(std::ostream &os, EncodeMode mode, size_t depth = 0) const override;
+  void encode(JsonWriter &writer) const override;
   operator const std::map<std::string, std::shared_ptr<Node>>&() const {
     return dict_;
   }
@@ -98,6 +113,9 @@ class InvalidBencoding :public std::runtime_error {
   explicit InvalidBencoding(std::string s) :runtime_error(std::move(s)) { }
 };
 
+// Quote and escape s as a JSON string
+std::string json_string(std::string_view s);
+
 template <typename T, typename = void>
 struct GetNodeType { };
 
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace albert::bencoding {
+
+// How strings that are not text are written in JSON
+enum class BinaryMode {
+  // Every byte that is not printable ASCII becomes \u00XX, the layout of EncodeMode::JSON
+  Escape,
+  Hex,
+  Base64,
+};
+
+struct JsonOptions {
+  // No whitespace and a newline after each top level value (NDJSON), instead of the indented layout
+  bool compact = false;
+  // With Hex or Base64, valid UTF-8 without control characters is still written as text
+  BinaryMode binary = BinaryMode::Escape;
+};
+
+BinaryMode parse_binary_mode(std::string_view name);
+
+/**
+ * Buffered JSON output for bencoded values.
+ *
+ * Output goes through a 64 KiB buffer which is written to the stream when full, on flush() and on destruction.
+ * Strings are scanned 8 bytes at a time for bytes that need escaping, runs of plain bytes are copied at once.
+ */
+class JsonWriter {
+ public:
+  static constexpr size_t BufferSize = 64 * 1024;
+  // Streamed strings up to this size are buffered to tell text from binary, longer ones are binary
+  static constexpr size_t MaxBufferedString = 64 * 1024;
+
+  // indent is the nesting level of the first value in the indented layout
+  explicit JsonWriter(std::ostream &os, JsonOptions options = {}, size_t indent = 0);
+  ~JsonWriter();
+  JsonWriter(const JsonWriter &) = delete;
+  JsonWriter &operator=(const JsonWriter &) = delete;
+
+  void begin_dict();
+  void begin_list();
+  void end();
+  void key(std::string_view key);
+  void integer(int64_t i);
+  void string(std::string_view s);
+
+  // A string given in pieces, length is the total size
+  void string_begin(size_t length);
+  void string_chunk(std::string_view data);
+  void string_end();
+
+  void flush();
+
+ private:
+  void begin_value();
+  void end_value();
+  void begin_container(bool is_dict);
+  void indent(size_t depth);
+
+  void write(std::string_view s);
+  void put(char c);
+  void write_escaped(std::string_view s, bool raw_utf8);
+  void write_hex(std::string_view s);
+  void write_base64(std::string_view s);
+  void finish_base64();
+  void write_quoted(std::string_view s);
+
+ private:
+  std::ostream &os_;
+  JsonOptions options_;
+  size_t indent_;
+
+  std::vector<char> buffer_;
+  size_t used_ = 0;
+
+  // Whether each open container is a dict, and how many items it has so far
+  std::vector<bool> is_dict_;
+  std::vector<size_t> items_;
+
+  // Streamed string
+  enum class StringState {
+    Escaped,
+    Buffered,
+    Hex,
+    Base64,
+  };
+  StringState string_state_ = StringState::Escaped;
+  std::string pending_;
+  std::array<uint8_t, 3> carry_{};
+  size_t carry_size_ = 0;
+};
+
+}
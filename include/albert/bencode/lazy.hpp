@@ -0,0 +1,125 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include <gsl/span>
+
+#include <albert/bencode/bencoding.hpp>
+
+namespace albert::bencoding {
+
+/**
+ * Bencoding node that only records its byte range in the encoded data.
+ *
+ * decode() checks the whole value once without building anything, children are parsed when they are accessed,
+ *   so only the fields that are actually read get materialized.
+ * raw() is the exact encoded bytes of a node, e.g. the info hash is the hash of raw() of the "info" dict.
+ * All nodes from one decode share ownership of the data, so nodes can be copied and kept around.
+ */
+class LazyNode {
+ public:
+  using Buffer = std::vector<uint8_t>;
+
+  LazyNode() = default;
+
+  // Decode the first value in data, trailing bytes are ignored, throws ParseError on malformed input
+  static LazyNode decode(Buffer data);
+  static LazyNode decode(std::shared_ptr<const Buffer> data);
+
+  [[nodiscard]]
+  Type type() const { return type_; }
+  [[nodiscard]]
+  bool is_string() const { return type_ == Type::String; }
+  [[nodiscard]]
+  bool is_int() const { return type_ == Type::Int; }
+  [[nodiscard]]
+  bool is_list() const { return type_ == Type::List; }
+  [[nodiscard]]
+  bool is_dict() const { return type_ == Type::Dict; }
+
+  // Encoded bytes of this node
+  [[nodiscard]]
+  gsl::span<const uint8_t> raw() const;
+
+  // Typed accessors, they throw std::invalid_argument on type mismatch
+  [[nodiscard]]
+  std::string_view as_string() const;
+  [[nodiscard]]
+  int64_t as_int() const;
+
+  // Children are parsed on every call, keep the results if they are used more than once
+  [[nodiscard]]
+  std::vector<LazyNode> items() const;
+  [[nodiscard]]
+  std::vector<std::pair<std::string_view, LazyNode>> entries() const;
+  // Number of items in a list or dict
+  [[nodiscard]]
+  size_t size() const;
+  // Dict lookup, returns std::nullopt if the key does not exist or the node is not a dict
+  [[nodiscard]]
+  std::optional<LazyNode> find(std::string_view key) const;
+
+  // Convert to a value of type T, see bencoding::get
+  template <typename T>
+  T as() const;
+
+  // Decode this node and all of its children into a Node tree
+  [[nodiscard]]
+  std::shared_ptr<Node> materialize() const;
+
+  // Bencoding writes raw() as it is
+  void encode(std::ostream &os, EncodeMode mode = EncodeMode::Bencoding, size_t depth = 0) const;
+
+ private:
+  LazyNode(std::shared_ptr<const Buffer> data, size_t offset, size_t size);
+  template <typename F>
+  void for_each_child(F &&f) const;
+
+ private:
+  std::shared_ptr<const Buffer> data_;
+  size_t offset_ = 0;
+  size_t size_ = 0;
+  Type type_ = Type::Int;
+};
+
+template <typename T>
+T LazyNode::as() const {
+  using V = std::remove_cv_t<std::remove_reference_t<T>>;
+  if constexpr (std::is_same_v<V, LazyNode>) {
+    return *this;
+  } else if constexpr (std::is_same_v<V, std::string_view>) {
+    return as_string();
+  } else if constexpr (std::is_same_v<V, std::string>) {
+    return std::string(as_string());
+  } else if constexpr (std::is_integral_v<V>) {
+    return static_cast<V>(as_int());
+  } else {
+    static_assert(std::is_same_v<V, LazyNode>, "bencoding::LazyNode::as<T>, unsupported type");
+  }
+}
+
+template <typename T>
+T get(const LazyNode &dict, std::string_view key) {
+  auto node = dict.find(key);
+  if (!node) {
+    throw std::invalid_argument("bencoding::get(LazyNode, " + std::string(key) + "), key not found");
+  }
+  try {
+    return node->as<T>();
+  } catch (const std::invalid_argument &) {
+    throw std::invalid_argument("bencoding::get(LazyNode, " + std::string(key) + "), item is not " + typeid(T).name());
+  }
+}
+
+}
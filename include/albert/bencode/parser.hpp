@@ -0,0 +1,119 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include <string>
+#include <string_view>
+
+#include <gsl/span>
+
+#include <albert/bencode/bencoding.hpp>
+
+namespace albert::bencoding {
+
+class ParseError :public InvalidBencoding {
+ public:
+  ParseError(const std::string &s, size_t offset)
+      :InvalidBencoding(s + " at offset " + std::to_string(offset)), offset_(offset) { }
+  // Byte offset in the input where the error was detected
+  size_t offset() const { return offset_; }
+ private:
+  size_t offset_;
+};
+
+enum class Token {
+  String,
+  Int,
+  ListBegin,
+  DictBegin,
+  End,
+  Eof,
+};
+
+/**
+ * Zero-copy pull parser over a byte span.
+ *
+ * Strings are returned as std::string_view pointing into the input, so the input must outlive them.
+ * The parser never allocates. Dict keys are reported as ordinary String tokens,
+ *   the parser only checks that a key is a string and is followed by a value.
+ *
+ * Usage:
+ *   Parser parser(data);
+ *   if (parser.next() == Token::DictBegin) {
+ *     while (parser.next() != Token::End) {
+ *       auto key = parser.string();
+ *       ...
+ *     }
+ *   }
+ */
+class Parser {
+ public:
+  static constexpr size_t MaxDepth = 64;
+
+  explicit Parser(gsl::span<const uint8_t> data) :data_(data) { }
+
+  // Consume and return the next token, throws ParseError on malformed input
+  Token next();
+  // Return the next token without consuming it
+  [[nodiscard]]
+  Token peek() const;
+
+  // Skip the next complete value, including all of its children
+  void skip();
+  // Skip the rest of a value whose first token has already been consumed
+  void skip(Token first);
+
+  // Value of the last String token
+  [[nodiscard]]
+  std::string_view string() const { return string_; }
+  // Value of the last Int token
+  [[nodiscard]]
+  int64_t integer() const { return integer_; }
+
+  // Convenience readers, they throw ParseError if the next token is not of the expected type
+  std::string_view read_string();
+  int64_t read_integer();
+  void read_list_begin();
+  void read_dict_begin();
+
+  [[nodiscard]]
+  size_t depth() const { return depth_; }
+  // Bytes consumed so far
+  [[nodiscard]]
+  size_t offset() const { return offset_; }
+  // Offset where the last token started
+  [[nodiscard]]
+  size_t token_offset() const { return token_offset_; }
+  [[nodiscard]]
+  gsl::span<const uint8_t> data() const { return data_; }
+  [[nodiscard]]
+  gsl::span<const uint8_t> remaining() const { return data_.subspan(offset_); }
+  // True after a complete top-level value has been consumed
+  [[nodiscard]]
+  bool done() const { return depth_ == 0 && started_; }
+
+ private:
+  [[noreturn]] void fail(const std::string &reason, size_t offset) const;
+  int64_t parse_integer(char terminator);
+  bool in_dict() const { return depth_ > 0 && ((dict_bits_ >> (depth_ - 1)) & 1u); }
+  bool expecting_key() const { return in_dict() && ((key_bits_ >> (depth_ - 1)) & 1u); }
+  void flip_key_bit() { key_bits_ ^= (uint64_t(1) << (depth_ - 1)); }
+  void push(bool is_dict);
+
+ private:
+  gsl::span<const uint8_t> data_;
+  size_t offset_ = 0;
+  size_t token_offset_ = 0;
+  size_t depth_ = 0;
+  bool started_ = false;
+
+  // One bit per nesting level, bit i is set when level i+1 is a dict
+  uint64_t dict_bits_ = 0;
+  // One bit per nesting level, bit i is set when level i+1 is a dict and a key comes next
+  uint64_t key_bits_ = 0;
+
+  std::string_view string_;
+  int64_t integer_ = 0;
+};
+
+}
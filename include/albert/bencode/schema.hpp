@@ -0,0 +1,431 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <limits>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <gsl/span>
+
+#include <albert/bencode/arena.hpp>
+#include <albert/bencode/parser.hpp>
+#include <albert/bencode/writer.hpp>
+
+/**
+ * Compile time schema for bencoded dicts.
+ *
+ * A struct describes its dict entries once, in sorted key order, with a static bencoding_fields() function:
+ *
+ *   struct Message {
+ *     int64_t msg_type;
+ *     std::optional<int64_t> piece;
+ *
+ *     static constexpr auto bencoding_fields() {
+ *       using namespace bencoding::schema;
+ *       return std::make_tuple(
+ *           required("msg_type", &Message::msg_type),
+ *           optional("piece", &Message::piece));
+ *     }
+ *   };
+ *
+ * schema::decode() and schema::encode() are generated from that list, there is no virtual dispatch and no DOM.
+ * Values are converted by Codec<T>, it is specialized here for integers, strings, lists, maps, std::optional
+ *   and nested schema structs, other modules specialize it for their own types.
+ * On decoding unknown keys are skipped, a missing required key or a value of the wrong type throws SchemaError.
+ * On encoding optional fields that hold a default constructed value are left out.
+ */
+namespace albert::bencoding::schema {
+
+class SchemaError :public InvalidBencoding {
+ public:
+  explicit SchemaError(const std::string &s) :InvalidBencoding(s) { }
+};
+
+template <typename T, typename = void>
+struct Codec;
+
+template <typename S, typename M, typename C, bool Required>
+struct Field {
+  using member_type = M;
+  using codec = C;
+  static constexpr bool is_required = Required;
+
+  std::string_view key;
+  M S::*member;
+};
+
+template <typename T>
+struct is_optional :std::false_type { };
+template <typename T>
+struct is_optional<std::optional<T>> :std::true_type { };
+
+// A field that must be present, C overrides the codec of the member type
+template <typename C = void, typename S, typename M>
+constexpr auto required(std::string_view key, M S::*member) {
+  static_assert(!is_optional<M>::value, "std::optional members are declared with schema::optional()");
+  return Field<S, M, std::conditional_t<std::is_void_v<C>, Codec<M>, C>, true>{key, member};
+}
+// A field that may be absent, the member keeps its value then
+template <typename C = void, typename S, typename M>
+constexpr auto optional(std::string_view key, M S::*member) {
+  return Field<S, M, std::conditional_t<std::is_void_v<C>, Codec<M>, C>, false>{key, member};
+}
+
+template <typename T, typename = void>
+struct has_schema :std::false_type { };
+template <typename T>
+struct has_schema<T, std::void_t<decltype(T::bencoding_fields())>> :std::true_type { };
+
+template <typename T>
+inline constexpr auto fields_of = T::bencoding_fields();
+template <typename T>
+inline constexpr size_t field_count = std::tuple_size_v<std::decay_t<decltype(fields_of<T>)>>;
+
+template <typename T>
+constexpr auto keys_of() {
+  return std::apply([](const auto &...field) {
+    return std::array<std::string_view, sizeof...(field)>{field.key...};
+  }, fields_of<T>);
+}
+
+// Bit of a key in the mask returned by decode()
+template <typename T>
+constexpr uint64_t field_bit(std::string_view key) {
+  auto keys = keys_of<T>();
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (keys[i] == key) {
+      return uint64_t(1) << i;
+    }
+  }
+  throw std::invalid_argument("bencoding::schema::field_bit, unknown key");
+}
+
+template <typename T>
+constexpr uint64_t required_mask() {
+  uint64_t ret = 0;
+  size_t i = 0;
+  std::apply([&](const auto &...field) {
+    ((ret |= std::decay_t<decltype(field)>::is_required ? (uint64_t(1) << i) : 0, i++), ...);
+  }, fields_of<T>);
+  return ret;
+}
+
+// Decode a dict into out, token is the first token of the value and has been consumed.
+// Returns the fields that were present, bit i for the i-th field
+template <typename T>
+uint64_t decode(Parser &parser, Token token, T &out);
+// Decode the next value of parser
+template <typename T>
+uint64_t decode(Parser &parser, T &out) {
+  auto token = parser.next();
+  return decode(parser, token, out);
+}
+// Decode the first value in data, trailing bytes are ignored
+template <typename T>
+uint64_t decode(gsl::span<const uint8_t> data, T &out) {
+  Parser parser(data);
+  return decode(parser, out);
+}
+template <typename T>
+uint64_t decode(const ArenaNode &node, T &out);
+
+template <typename T>
+void encode(Writer &w, const T &in);
+
+/**
+ * Codecs
+ */
+template <typename T>
+struct Codec<T, std::enable_if_t<std::is_integral_v<T>>> {
+  static void decode(Parser &parser, Token token, T &out) {
+    if (token != Token::Int) {
+      throw SchemaError("expected an integer");
+    }
+    out = checked(parser.integer());
+  }
+  static void decode(const ArenaNode &node, T &out) {
+    if (!node.is_int()) {
+      throw SchemaError("expected an integer");
+    }
+    out = checked(node.as_int());
+  }
+  static void encode(Writer &w, T in) {
+    w.integer(static_cast<int64_t>(in));
+  }
+
+ private:
+  static T checked(int64_t i) {
+    if constexpr (std::is_signed_v<T>) {
+      if (i < int64_t(std::numeric_limits<T>::min()) || i > int64_t(std::numeric_limits<T>::max())) {
+        throw SchemaError("integer " + std::to_string(i) + " out of range");
+      }
+    } else {
+      if (i < 0 || uint64_t(i) > uint64_t(std::numeric_limits<T>::max())) {
+        throw SchemaError("integer " + std::to_string(i) + " out of range");
+      }
+    }
+    return static_cast<T>(i);
+  }
+};
+
+// Points into the input, no copy
+template <>
+struct Codec<std::string_view> {
+  static void decode(Parser &parser, Token token, std::string_view &out) {
+    if (token != Token::String) {
+      throw SchemaError("expected a string");
+    }
+    out = parser.string();
+  }
+  static void decode(const ArenaNode &node, std::string_view &out) {
+    if (!node.is_string()) {
+      throw SchemaError("expected a string");
+    }
+    out = node.as_string();
+  }
+  static void encode(Writer &w, std::string_view in) {
+    w.string(in);
+  }
+};
+
+template <>
+struct Codec<std::string> {
+  static void decode(Parser &parser, Token token, std::string &out) {
+    std::string_view s;
+    Codec<std::string_view>::decode(parser, token, s);
+    out.assign(s.data(), s.size());
+  }
+  static void decode(const ArenaNode &node, std::string &out) {
+    std::string_view s;
+    Codec<std::string_view>::decode(node, s);
+    out.assign(s.data(), s.size());
+  }
+  static void encode(Writer &w, const std::string &in) {
+    w.string(in);
+  }
+};
+
+template <typename T, typename A>
+struct Codec<std::vector<T, A>> {
+  static void decode(Parser &parser, Token token, std::vector<T, A> &out) {
+    if (token != Token::ListBegin) {
+      throw SchemaError("expected a list");
+    }
+    out.clear();
+    for (auto item = parser.next(); item != Token::End; item = parser.next()) {
+      Codec<T>::decode(parser, item, out.emplace_back());
+    }
+  }
+  static void decode(const ArenaNode &node, std::vector<T, A> &out) {
+    if (!node.is_list()) {
+      throw SchemaError("expected a list");
+    }
+    out.clear();
+    for (auto &item : node.as_list()) {
+      Codec<T>::decode(item, out.emplace_back());
+    }
+  }
+  static void encode(Writer &w, const std::vector<T, A> &in) {
+    w.list_begin();
+    for (auto &item : in) {
+      Codec<T>::encode(w, item);
+    }
+    w.end();
+  }
+};
+
+namespace detail {
+[[noreturn]] inline void rethrow_in(std::string_view key, const SchemaError &e) {
+  throw SchemaError("'" + std::string(key) + "': " + e.what());
+}
+}
+
+// Dict with arbitrary keys, std::map keeps them in the byte order bencoding requires
+template <typename T, typename C, typename A>
+struct Codec<std::map<std::string, T, C, A>> {
+  static void decode(Parser &parser, Token token, std::map<std::string, T, C, A> &out) {
+    if (token != Token::DictBegin) {
+      throw SchemaError("expected a dict");
+    }
+    out.clear();
+    while (parser.next() != Token::End) {
+      auto key = parser.string();
+      auto value = parser.next();
+      try {
+        Codec<T>::decode(parser, value, out[std::string(key)]);
+      } catch (const SchemaError &e) {
+        detail::rethrow_in(key, e);
+      }
+    }
+  }
+  static void decode(const ArenaNode &node, std::map<std::string, T, C, A> &out) {
+    if (!node.is_dict()) {
+      throw SchemaError("expected a dict");
+    }
+    out.clear();
+    for (auto &entry : node.as_dict()) {
+      try {
+        Codec<T>::decode(entry.value, out[std::string(entry.key)]);
+      } catch (const SchemaError &e) {
+        detail::rethrow_in(entry.key, e);
+      }
+    }
+  }
+  static void encode(Writer &w, const std::map<std::string, T, C, A> &in) {
+    w.dict_begin();
+    for (auto &[key, value] : in) {
+      w.string(key);
+      Codec<T>::encode(w, value);
+    }
+    w.end();
+  }
+};
+
+template <typename T>
+struct Codec<std::optional<T>> {
+  static void decode(Parser &parser, Token token, std::optional<T> &out) {
+    Codec<T>::decode(parser, token, out.emplace());
+  }
+  static void decode(const ArenaNode &node, std::optional<T> &out) {
+    Codec<T>::decode(node, out.emplace());
+  }
+  // Only called for a value that is present
+  static void encode(Writer &w, const std::optional<T> &in) {
+    Codec<T>::encode(w, *in);
+  }
+};
+
+template <typename T>
+struct Codec<T, std::enable_if_t<has_schema<T>::value>> {
+  static void decode(Parser &parser, Token token, T &out) {
+    schema::decode(parser, token, out);
+  }
+  static void decode(const ArenaNode &node, T &out) {
+    schema::decode(node, out);
+  }
+  static void encode(Writer &w, const T &in) {
+    schema::encode(w, in);
+  }
+};
+
+// A value kept as the bytes it was encoded with, only the pull parser can decode it
+struct Raw {
+  gsl::span<const uint8_t> data;
+};
+template <>
+struct Codec<Raw> {
+  static void decode(Parser &parser, Token token, Raw &out) {
+    auto start = parser.token_offset();
+    parser.skip(token);
+    out.data = parser.data().subspan(start, parser.offset() - start);
+  }
+  static void encode(Writer &w, const Raw &in) {
+    w.raw(in.data.data(), in.data.size());
+  }
+};
+
+/**
+ * Implementation
+ */
+namespace detail {
+
+// Call f(field, bit) for the field named key, returns false for an unknown key
+template <typename T, typename F, size_t... I>
+bool dispatch(std::string_view key, F &&f, std::index_sequence<I...>) {
+  return ((key == std::get<I>(fields_of<T>).key && (f(std::get<I>(fields_of<T>), uint64_t(1) << I), true)) || ...);
+}
+
+template <typename T>
+void check_required(uint64_t present) {
+  constexpr auto mask = required_mask<T>();
+  if ((present & mask) != mask) {
+    constexpr auto keys = keys_of<T>();
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (((mask & ~present) >> i) & 1u) {
+        throw SchemaError("'" + std::string(keys[i]) + "' not found");
+      }
+    }
+  }
+}
+
+}
+
+template <typename T>
+uint64_t decode(Parser &parser, Token token, T &out) {
+  static_assert(field_count<T> <= 64, "bencoding::schema supports at most 64 fields");
+  if (token != Token::DictBegin) {
+    throw SchemaError("expected a dict");
+  }
+  uint64_t present = 0;
+  while (parser.next() != Token::End) {
+    auto key = parser.string();
+    auto value = parser.next();
+    auto known = detail::dispatch<T>(key, [&](const auto &field, uint64_t bit) {
+      using C = typename std::decay_t<decltype(field)>::codec;
+      try {
+        C::decode(parser, value, out.*field.member);
+      } catch (const SchemaError &e) {
+        detail::rethrow_in(key, e);
+      }
+      present |= bit;
+    }, std::make_index_sequence<field_count<T>>());
+    if (!known) {
+      parser.skip(value);
+    }
+  }
+  detail::check_required<T>(present);
+  return present;
+}
+
+template <typename T>
+uint64_t decode(const ArenaNode &node, T &out) {
+  static_assert(field_count<T> <= 64, "bencoding::schema supports at most 64 fields");
+  if (!node.is_dict()) {
+    throw SchemaError("expected a dict");
+  }
+  uint64_t present = 0;
+  for (auto &entry : node.as_dict()) {
+    detail::dispatch<T>(entry.key, [&](const auto &field, uint64_t bit) {
+      using C = typename std::decay_t<decltype(field)>::codec;
+      try {
+        C::decode(entry.value, out.*field.member);
+      } catch (const SchemaError &e) {
+        detail::rethrow_in(entry.key, e);
+      }
+      present |= bit;
+    }, std::make_index_sequence<field_count<T>>());
+  }
+  detail::check_required<T>(present);
+  return present;
+}
+
+template <typename T>
+void encode(Writer &w, const T &in) {
+  static_assert(keys_sorted(keys_of<T>()), "bencoding::schema, keys must be listed in sorted order");
+  w.dict_begin();
+  std::apply([&](const auto &...field) {
+    ([&](const auto &f) {
+      using F = std::decay_t<decltype(f)>;
+      auto &value = in.*f.member;
+      if constexpr (!F::is_required) {
+        if (value == typename F::member_type{}) {
+          return;
+        }
+      }
+      w.string(f.key);
+      F::codec::encode(w, value);
+    }(field), ...);
+  }, fields_of<T>);
+  w.end();
+}
+
+}
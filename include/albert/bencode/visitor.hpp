@@ -0,0 +1,134 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include <gsl/span>
+
+#include <albert/bencode/json.hpp>
+#include <albert/bencode/parser.hpp>
+
+namespace albert::bencoding {
+
+/**
+ * Receiver of decoding events, every event does nothing by default.
+ *
+ * A string value arrives as string_begin(), any number of string_chunk() and string_end(),
+ *   so a string of any size can be consumed without holding it in memory.
+ * Dict keys are delivered whole to key() before the value.
+ */
+class Visitor {
+ public:
+  virtual ~Visitor() = default;
+
+  virtual void begin_dict() { }
+  virtual void begin_list() { }
+  // End of the innermost dict or list
+  virtual void end() { }
+  virtual void key(std::string_view key) { }
+  virtual void integer(int64_t i) { }
+  virtual void string_begin(size_t length) { }
+  virtual void string_chunk(std::string_view data) { }
+  virtual void string_end() { }
+};
+
+/**
+ * Push decoder, input is fed in chunks of any size and turned into Visitor events.
+ *
+ * Memory use does not depend on the input, only keys split over two chunks are buffered.
+ * Decoding stops after the first complete top level value, errors are reported as ParseError.
+ *
+ * Usage:
+ *   StreamDecoder decoder(visitor);
+ *   while (read a chunk) {
+ *     decoder.feed(chunk);
+ *   }
+ *   decoder.finish();
+ */
+class StreamDecoder {
+ public:
+  static constexpr size_t MaxDepth = Parser::MaxDepth;
+  static constexpr size_t MaxKeyLength = 64 * 1024;
+
+  explicit StreamDecoder(Visitor &visitor) :visitor_(visitor) { }
+
+  // Decode a chunk, returns the bytes used, which is less than data.size() only once the value is complete
+  size_t feed(gsl::span<const uint8_t> data);
+  // Signal the end of input, throws ParseError if the value is not complete
+  void finish() const;
+  // Start over for the next value of a stream of concatenated values, the offset keeps counting
+  void reset();
+
+  [[nodiscard]]
+  bool done() const { return state_ == State::Done; }
+  [[nodiscard]]
+  size_t depth() const { return depth_; }
+  // Bytes decoded so far, inside a callback it is the offset just past the bytes that triggered it
+  [[nodiscard]]
+  size_t offset() const { return offset_; }
+
+ private:
+  enum class State {
+    Value,
+    Integer,
+    Length,
+    String,
+    Done,
+  };
+
+  [[noreturn]] void fail(const std::string &reason, size_t offset) const;
+  void begin_value(uint8_t ch);
+  void end_value();
+  void accumulate_digit(uint8_t ch);
+  bool in_dict() const { return depth_ > 0 && ((dict_bits_ >> (depth_ - 1)) & 1u); }
+  bool expecting_key() const { return in_dict() && ((key_bits_ >> (depth_ - 1)) & 1u); }
+
+ private:
+  Visitor &visitor_;
+  State state_ = State::Value;
+  size_t offset_ = 0;
+  size_t token_offset_ = 0;
+  size_t depth_ = 0;
+  uint64_t dict_bits_ = 0;
+  uint64_t key_bits_ = 0;
+
+  // Integer or string length being read
+  uint64_t number_ = 0;
+  bool negative_ = false;
+  bool has_digits_ = false;
+
+  // String being read
+  bool is_key_ = false;
+  size_t remaining_ = 0;
+  std::string key_;
+};
+
+// Decode the first value in data, which may be a memory mapped file, returns the bytes used
+size_t visit(gsl::span<const uint8_t> data, Visitor &visitor);
+
+/**
+ * Visitor that writes JSON as it goes, with default options the output is the same as Node::encode with EncodeMode::JSON.
+ */
+class JsonVisitor :public Visitor {
+ public:
+  explicit JsonVisitor(std::ostream &os, JsonOptions options = {}) :writer_(os, options) { }
+
+  void begin_dict() override { writer_.begin_dict(); }
+  void begin_list() override { writer_.begin_list(); }
+  void end() override { writer_.end(); }
+  void key(std::string_view key) override { writer_.key(key); }
+  void integer(int64_t i) override { writer_.integer(i); }
+  void string_begin(size_t length) override { writer_.string_begin(length); }
+  void string_chunk(std::string_view data) override { writer_.string_chunk(data); }
+  void string_end() override { writer_.string_end(); }
+
+  void flush() { writer_.flush(); }
+
+ private:
+  JsonWriter writer_;
+};
+
+}
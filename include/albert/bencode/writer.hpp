@@ -0,0 +1,107 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <gsl/span>
+
+namespace albert::bencoding {
+
+class WriterOverflow :public std::runtime_error {
+ public:
+  explicit WriterOverflow(const std::string &s) :runtime_error(s) { }
+};
+
+// Number of decimal digits in n
+constexpr size_t decimal_digits(uint64_t n) {
+  size_t ret = 1;
+  while (n >= 10) {
+    n /= 10;
+    ret++;
+  }
+  return ret;
+}
+// Encoded size of a string of the given length
+constexpr size_t string_size(size_t length) {
+  return decimal_digits(length) + 1 + length;
+}
+// Encoded size of an integer
+constexpr size_t integer_size(int64_t i) {
+  return 2 + (i < 0 ? 1 + decimal_digits(0 - uint64_t(i)) : decimal_digits(uint64_t(i)));
+}
+
+// Bencoding requires dict keys in strictly increasing order, check the key list of a dict at compile time with
+//   static_assert(keys_sorted(keys));
+template <size_t N>
+constexpr bool keys_sorted(const std::array<std::string_view, N> &keys) {
+  for (size_t i = 1; i < N; i++) {
+    if (!(keys[i-1] < keys[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Bencoding writer into a caller provided fixed size buffer.
+ *
+ * Nothing is allocated, WriterOverflow is thrown if the buffer is too small.
+ * The writer does not check the structure, callers write dict keys in sorted order, see keys_sorted().
+ */
+class Writer {
+ public:
+  explicit Writer(gsl::span<uint8_t> buffer) :buffer_(buffer) { }
+
+  Writer &string(std::string_view s) {
+    string_header(s.size());
+    return raw(s.data(), s.size());
+  }
+  Writer &string(gsl::span<const uint8_t> s) {
+    string_header(s.size());
+    return raw(s.data(), s.size());
+  }
+  // Write the length prefix of a string, the caller must write exactly length bytes with raw() or reserve() next
+  Writer &string_header(size_t length);
+  Writer &integer(int64_t i);
+  Writer &list_begin() { return put('l'); }
+  Writer &dict_begin() { return put('d'); }
+  Writer &end() { return put('e'); }
+
+  // Write bytes as they are
+  Writer &raw(const void *data, size_t size) {
+    memcpy(reserve(size), data, size);
+    return *this;
+  }
+  // Advance by size bytes and return where they start, for callers that encode values in place
+  uint8_t *reserve(size_t size) {
+    if (size > buffer_.size() - size_) {
+      overflow(size);
+    }
+    auto ret = buffer_.data() + size_;
+    size_ += size;
+    return ret;
+  }
+
+  [[nodiscard]]
+  size_t size() const { return size_; }
+  [[nodiscard]]
+  gsl::span<const uint8_t> written() const { return {buffer_.data(), size_}; }
+
+ private:
+  Writer &put(uint8_t c) {
+    *reserve(1) = c;
+    return *this;
+  }
+  [[noreturn]] void overflow(size_t size) const;
+
+ private:
+  gsl::span<uint8_t> buffer_;
+  size_t size_ = 0;
+};
+
+}
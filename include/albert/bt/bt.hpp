@@ -3,6 +3,8 @@
 
 #include <boost/asio/steady_timer.hpp>
 
+#include <albert/bencode/lazy.hpp>
+#include <albert/common/open_hash_map.hpp>
 #include <albert/krpc/krpc.hpp>
 #include <albert/bt/config.hpp>
 #include <albert/u160/u160.hpp>
@@ -18,7 +20,7 @@ class TorrentResolver;
 class BT {
  public:
   BT(boost::asio::io_service &io, Config config);
-  std::weak_ptr<TorrentResolver> resolve_torrent(const u160::U160 &info_hash, std::function<void(const bencoding::DictNode &)> handler);
+  std::weak_ptr<TorrentResolver> resolve_torrent(const u160::U160 &info_hash, std::function<void(const bencoding::LazyNode &)> handler);
   std::weak_ptr<TorrentResolver> file_transfer(const u160::U160 &info_hash, const bencoding::DictNode &info);
   void start();
   u160::U160 self() const { return self_; }
@@ -38,7 +40,7 @@ class BT {
   Config config_;
   boost::asio::io_service &io_;
   u160::U160 self_;
-  std::map<albert::u160::U160, std::shared_ptr<TorrentResolver>> resolvers_;
+  common::OpenHashMap<albert::u160::U160, std::shared_ptr<TorrentResolver>> resolvers_;
 
   boost::asio::steady_timer gc_timer_;
   std::chrono::seconds expiration_time_;
@@ -3,11 +3,15 @@
 #include <cstdint>
 
 #include <array>
+#include <map>
 #include <memory>
+#include <optional>
+#include <string>
 #include <gsl/span>
 
 #include <boost/asio/ip/tcp.hpp>
 
+#include <albert/bencode/schema.hpp>
 #include <albert/bt/bt.hpp>
 #include <albert/bt/transport.hpp>
 #include <albert/krpc/krpc.hpp>
@@ -60,6 +64,41 @@ struct Handshake {
 
 constexpr const char *MetadataMessage = "ut_metadata";
 
+// BEP 10 extended handshake, only the entries we use
+struct ExtendedHandshake {
+  // extension name -> extended message id
+  std::map<std::string, int64_t> m;
+  std::optional<int64_t> metadata_size;
+  std::optional<int64_t> p;
+  std::optional<int64_t> reqq;
+  std::string v;
+
+  static constexpr auto bencoding_fields() {
+    using namespace bencoding::schema;
+    return std::make_tuple(
+        required("m", &ExtendedHandshake::m),
+        optional("metadata_size", &ExtendedHandshake::metadata_size),
+        optional("p", &ExtendedHandshake::p),
+        optional("reqq", &ExtendedHandshake::reqq),
+        optional("v", &ExtendedHandshake::v));
+  }
+};
+
+// BEP 9 ut_metadata message, the piece data follows the dict
+struct UtMetadataMessage {
+  int64_t msg_type = 0;
+  std::optional<int64_t> piece;
+  std::optional<int64_t> total_size;
+
+  static constexpr auto bencoding_fields() {
+    using namespace bencoding::schema;
+    return std::make_tuple(
+        required("msg_type", &UtMetadataMessage::msg_type),
+        optional("piece", &UtMetadataMessage::piece),
+        optional("total_size", &UtMetadataMessage::total_size));
+  }
+};
+
 enum class ConnectionStatus {
   Connecting,
   Connected,
@@ -123,10 +162,7 @@ class PeerConnection :public std::enable_shared_from_this<PeerConnection> {
   void handle_receive(const boost::system::error_code &err, size_t bytes_transferred);
 
   void handle_message(uint8_t type, const gsl::span<uint8_t> data);
-  void handle_extended_message(
-      uint8_t extended_id,
-      std::shared_ptr<bencoding::DictNode> msg,
-      const std::vector<uint8_t> &appended_data);
+  void handle_extended_message(uint8_t extended_id, gsl::span<const uint8_t> content);
   void handle_keep_alive();
   /**
    * Send helpers
@@ -174,8 +210,7 @@ class PeerConnection :public std::enable_shared_from_this<PeerConnection> {
   bool peer_interested_ = false;
   bool peer_choke_ = true;
   std::vector<uint8_t> peer_bitfield_;
-  std::shared_ptr<bencoding::DictNode> extended_handshake_;
-  std::map<std::string, std::shared_ptr<bencoding::Node>> m_dict_;
+  std::optional<ExtendedHandshake> extended_handshake_;
   std::map<uint8_t, std::string> extended_message_id_ = {
       {2, MetadataMessage}
   };
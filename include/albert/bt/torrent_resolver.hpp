@@ -6,6 +6,7 @@
 #include <mutex>
 #include <atomic>
 
+#include <albert/bencode/lazy.hpp>
 #include <albert/krpc/krpc.hpp>
 #include <albert/u160/u160.hpp>
 #include <albert/common/commom.hpp>
@@ -24,6 +25,10 @@ namespace albert::bt {
 namespace peer {
 class PeerConnection;
 }
+
+// A .torrent around a verified info dict, the info bytes are kept as they are so the info hash stays the same
+bencoding::LazyNode make_torrent(gsl::span<const uint8_t> info);
+
 class TorrentResolver :public std::enable_shared_from_this<TorrentResolver> {
   static std::mutex pointers_lock_;
   static std::set<TorrentResolver*> pointers_;
@@ -87,7 +92,7 @@ class TorrentResolver :public std::enable_shared_from_this<TorrentResolver> {
   [[nodiscard]]
   std::map<std::string, size_t> peers_stat() const;
 
-  void set_torrent_handler(std::function<void(const bencoding::DictNode &torrent)> handler);
+  void set_torrent_handler(std::function<void(const bencoding::LazyNode &torrent)> handler);
  private:
   void piece_handler(wp<peer::PeerConnection> pc, int piece, const std::vector<uint8_t> &data);
   void handshake_handler(wp<peer::PeerConnection> pc, int total_pieces, size_t metdata_size);
@@ -112,7 +117,7 @@ class TorrentResolver :public std::enable_shared_from_this<TorrentResolver> {
   std::vector<std::vector<uint8_t>> pieces_;
   size_t metadata_size_;
 
-  std::function<void(const bencoding::DictNode &torrent)> torrent_handler_;
+  std::function<void(const bencoding::LazyNode &torrent)> torrent_handler_;
 
   bencoding::DictNode info_;
   bool has_metadata_;
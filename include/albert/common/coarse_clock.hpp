@@ -0,0 +1,36 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+namespace albert::common {
+
+/**
+ * A clock that returns the time of its last update() instead of reading the system clock.
+ *
+ * The event loop updates it once per datagram and per timer tick, so code that checks the time of many
+ *   entries reads one cached value. It reads the real clock until the first update(),
+ *   programs without an event loop get exact time.
+ */
+class CoarseClock {
+ public:
+  using clock = std::chrono::high_resolution_clock;
+  using time_point = clock::time_point;
+  using duration = clock::duration;
+
+  static time_point now() {
+    auto ticks = now_.load(std::memory_order_relaxed);
+    return ticks == 0 ? clock::now() : time_point(duration(ticks));
+  }
+
+  static time_point update() {
+    auto ret = clock::now();
+    now_.store(ret.time_since_epoch().count(), std::memory_order_relaxed);
+    return ret;
+  }
+
+ private:
+  static inline std::atomic<duration::rep> now_{0};
+};
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+
+#include <array>
+#include <stdexcept>
+#include <utility>
+
+namespace albert::common {
+
+/**
+ * Vector with a fixed capacity and inline storage, it never allocates.
+ *
+ * All N items are default constructed up front, so it is meant for small trivial items.
+ */
+template <typename T, size_t N>
+class FixedVector {
+ public:
+  using value_type = T;
+  using iterator = T*;
+  using const_iterator = const T*;
+
+  FixedVector() = default;
+
+  iterator begin() { return items_.data(); }
+  iterator end() { return items_.data() + size_; }
+  const_iterator begin() const { return items_.data(); }
+  const_iterator end() const { return items_.data() + size_; }
+
+  T &operator[](size_t i) { return items_[i]; }
+  const T &operator[](size_t i) const { return items_[i]; }
+  T &front() { return items_[0]; }
+  const T &front() const { return items_[0]; }
+  T &back() { return items_[size_ - 1]; }
+  const T &back() const { return items_[size_ - 1]; }
+
+  [[nodiscard]]
+  size_t size() const { return size_; }
+  [[nodiscard]]
+  bool empty() const { return size_ == 0; }
+  [[nodiscard]]
+  bool full() const { return size_ == N; }
+  [[nodiscard]]
+  static constexpr size_t capacity() { return N; }
+
+  // Throws std::length_error if full
+  void push_back(T item) {
+    if (full()) {
+      throw std::length_error("FixedVector::push_back(), capacity exceeded");
+    }
+    items_[size_++] = std::move(item);
+  }
+  void pop_back() { size_--; }
+  void clear() { size_ = 0; }
+
+ private:
+  std::array<T, N> items_{};
+  size_t size_ = 0;
+};
+
+}
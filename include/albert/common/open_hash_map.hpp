@@ -0,0 +1,247 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace albert::common {
+
+/**
+ * Hash map with open addressing and linear probing, for hot maps with small keys.
+ *
+ * Items live in one flat array, a lookup touches one or a few adjacent slots.
+ * Erasing shifts the following items back instead of leaving tombstones, so lookups stay short.
+ * Iteration order is unspecified. Any insertion or erase invalidates iterators and references,
+ *   collect the keys first to erase while iterating.
+ */
+template <typename K, typename V, typename Hash = std::hash<K>, typename KeyEqual = std::equal_to<K>>
+class OpenHashMap {
+  using Slot = std::optional<std::pair<const K, V>>;
+
+ public:
+  using key_type = K;
+  using mapped_type = V;
+  using value_type = std::pair<const K, V>;
+
+  template <bool Const>
+  class Iterator {
+    using SlotPointer = std::conditional_t<Const, const Slot*, Slot*>;
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<const K, V>;
+    using difference_type = std::ptrdiff_t;
+    using reference = std::conditional_t<Const, const value_type&, value_type&>;
+    using pointer = std::conditional_t<Const, const value_type*, value_type*>;
+
+    Iterator() = default;
+    Iterator(SlotPointer slot, SlotPointer end) :slot_(slot), end_(end) { skip_empty(); }
+    // iterator to const_iterator
+    template <bool C = Const, typename = std::enable_if_t<C>>
+    Iterator(const Iterator<false> &rhs) :slot_(rhs.slot_), end_(rhs.end_) { }
+
+    reference operator*() const { return **slot_; }
+    pointer operator->() const { return &**slot_; }
+    Iterator &operator++() {
+      ++slot_;
+      skip_empty();
+      return *this;
+    }
+    Iterator operator++(int) {
+      auto ret = *this;
+      ++*this;
+      return ret;
+    }
+    bool operator==(const Iterator &rhs) const { return slot_ == rhs.slot_; }
+    bool operator!=(const Iterator &rhs) const { return slot_ != rhs.slot_; }
+
+   private:
+    friend class OpenHashMap;
+    template <bool> friend class Iterator;
+
+    void skip_empty() {
+      while (slot_ != end_ && !slot_->has_value()) {
+        ++slot_;
+      }
+    }
+
+    SlotPointer slot_ = nullptr;
+    SlotPointer end_ = nullptr;
+  };
+  using iterator = Iterator<false>;
+  using const_iterator = Iterator<true>;
+
+  OpenHashMap() = default;
+
+  iterator begin() { return iterator(slots_.data(), slots_.data() + slots_.size()); }
+  iterator end() { return iterator(slots_.data() + slots_.size(), slots_.data() + slots_.size()); }
+  const_iterator begin() const { return const_iterator(slots_.data(), slots_.data() + slots_.size()); }
+  const_iterator end() const { return const_iterator(slots_.data() + slots_.size(), slots_.data() + slots_.size()); }
+
+  [[nodiscard]]
+  size_t size() const { return size_; }
+  [[nodiscard]]
+  bool empty() const { return size_ == 0; }
+  [[nodiscard]]
+  size_t capacity() const { return slots_.size(); }
+  // Bytes allocated for the slots
+  [[nodiscard]]
+  size_t memory_size() const { return slots_.capacity() * sizeof(Slot); }
+
+  iterator find(const K &key) {
+    auto i = find_index(key);
+    return i == npos ? end() : iterator(slots_.data() + i, slots_.data() + slots_.size());
+  }
+  const_iterator find(const K &key) const {
+    auto i = find_index(key);
+    return i == npos ? end() : const_iterator(slots_.data() + i, slots_.data() + slots_.size());
+  }
+  [[nodiscard]]
+  bool contains(const K &key) const { return find_index(key) != npos; }
+  [[nodiscard]]
+  size_t count(const K &key) const { return contains(key) ? 1 : 0; }
+
+  V &at(const K &key) {
+    auto i = find_index(key);
+    if (i == npos) {
+      throw std::out_of_range("OpenHashMap::at(), key not found");
+    }
+    return slots_[i]->second;
+  }
+  const V &at(const K &key) const {
+    auto i = find_index(key);
+    if (i == npos) {
+      throw std::out_of_range("OpenHashMap::at(), key not found");
+    }
+    return slots_[i]->second;
+  }
+  V &operator[](const K &key) {
+    return emplace(key).first->second;
+  }
+
+  // Construct the value from args only if the key does not exist, same as std::unordered_map::try_emplace
+  template <typename ... Args>
+  std::pair<iterator, bool> emplace(const K &key, Args&& ... args) {
+    reserve(size_ + 1);
+    auto i = bucket(key);
+    while (slots_[i]) {
+      if (equal_(slots_[i]->first, key)) {
+        return {iterator(slots_.data() + i, slots_.data() + slots_.size()), false};
+      }
+      i = (i + 1) & mask_;
+    }
+    slots_[i].emplace(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+    size_++;
+    return {iterator(slots_.data() + i, slots_.data() + slots_.size()), true};
+  }
+  std::pair<iterator, bool> insert(value_type item) {
+    return emplace(item.first, std::move(item.second));
+  }
+
+  size_t erase(const K &key) {
+    auto i = find_index(key);
+    if (i == npos) {
+      return 0;
+    }
+    slots_[i].reset();
+    size_--;
+    // Move back the following items that would not be found past the hole
+    auto hole = i;
+    for (auto j = (i + 1) & mask_; slots_[j]; j = (j + 1) & mask_) {
+      auto home = bucket(slots_[j]->first);
+      if (((j - home) & mask_) >= ((j - hole) & mask_)) {
+        slots_[hole].emplace(std::move(*slots_[j]));
+        slots_[j].reset();
+        hole = j;
+      }
+    }
+    return 1;
+  }
+
+  void clear() {
+    for (auto &slot : slots_) {
+      slot.reset();
+    }
+    size_ = 0;
+  }
+
+  // Make room for n items without rehashing
+  void reserve(size_t n) {
+    // Keep the load factor at most 3/4
+    if (n * 4 <= slots_.size() * 3) {
+      return;
+    }
+    size_t capacity = MinCapacity;
+    while (n * 4 > capacity * 3) {
+      capacity *= 2;
+    }
+    rehash(capacity);
+  }
+
+  // Release the slots that are not needed for the current items, iteration time depends on the capacity
+  void shrink_to_fit() {
+    size_t capacity = MinCapacity;
+    while (size_ * 4 > capacity * 3) {
+      capacity *= 2;
+    }
+    if (capacity < slots_.size()) {
+      rehash(capacity);
+    }
+  }
+
+ private:
+  static constexpr size_t npos = ~size_t(0);
+  static constexpr size_t MinCapacity = 8;
+
+  size_t bucket(const K &key) const {
+    // Fibonacci hashing, the top bits of the product depend on all bits of the hash
+    return (uint64_t(hash_(key)) * 0x9e3779b97f4a7c15ull) >> shift_;
+  }
+
+  size_t find_index(const K &key) const {
+    if (size_ == 0) {
+      return npos;
+    }
+    for (auto i = bucket(key); slots_[i]; i = (i + 1) & mask_) {
+      if (equal_(slots_[i]->first, key)) {
+        return i;
+      }
+    }
+    return npos;
+  }
+
+  void rehash(size_t capacity) {
+    std::vector<Slot> old(capacity);
+    old.swap(slots_);
+    mask_ = capacity - 1;
+    shift_ = 64;
+    for (size_t c = capacity; c > 1; c >>= 1) {
+      shift_--;
+    }
+    for (auto &slot : old) {
+      if (slot) {
+        auto i = bucket(slot->first);
+        while (slots_[i]) {
+          i = (i + 1) & mask_;
+        }
+        slots_[i].emplace(std::move(*slot));
+      }
+    }
+  }
+
+ private:
+  std::vector<Slot> slots_;
+  size_t size_ = 0;
+  size_t mask_ = 0;
+  // 64 - log2(capacity)
+  size_t shift_ = 64;
+  Hash hash_;
+  KeyEqual equal_;
+};
+
+}
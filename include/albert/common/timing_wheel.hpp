@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <utility>
+#include <vector>
+
+namespace albert::common {
+
+/**
+ * Hierarchical timing wheel, schedules items at integer ticks.
+ *
+ * Level l has 64 slots of 64^l ticks each. An item goes to the lowest level whose slot covers its deadline,
+ *   and moves down a level each time the level below wraps around, so scheduling is O(1)
+ *   and advancing one tick only touches the items due in it and the slots that cascade.
+ * Items further than the 64^4 ticks of the wheel wait in an overflow list.
+ * There is no cancellation, users skip stale items when they become due.
+ */
+template <typename T>
+class TimingWheel {
+ public:
+  using Tick = uint64_t;
+
+  explicit TimingWheel(Tick now = 0) :now_(now) { }
+
+  [[nodiscard]]
+  Tick now() const { return now_; }
+  [[nodiscard]]
+  size_t size() const { return size_; }
+  [[nodiscard]]
+  bool empty() const { return size_ == 0; }
+
+  // Items that are already due fire on the next tick. Returns the tick the item fires with,
+  //   users that skip stale items must compare against it, not against the deadline they asked for
+  Tick schedule(Tick deadline, T item) {
+    if (deadline <= now_) {
+      deadline = now_ + 1;
+    }
+    place(deadline, std::move(item));
+    size_++;
+    return deadline;
+  }
+
+  // Fire on_due(deadline, item) for every item due at or before to, in tick order
+  template <typename F>
+  void advance(Tick to, F &&on_due) {
+    if (to <= now_) {
+      return;
+    }
+    if (empty()) {
+      now_ = to;
+      return;
+    }
+    if (to - now_ >= Range) {
+      // Stepping would take too long, fire everything due and place the rest again
+      std::vector<std::pair<Tick, T>> items;
+      for (auto &level : levels_) {
+        for (auto &slot : level) {
+          items.insert(items.end(), std::make_move_iterator(slot.begin()), std::make_move_iterator(slot.end()));
+          slot.clear();
+        }
+      }
+      items.insert(items.end(), std::make_move_iterator(overflow_.begin()), std::make_move_iterator(overflow_.end()));
+      overflow_.clear();
+      size_ = 0;
+      now_ = to;
+      for (auto &item : items) {
+        if (item.first <= to) {
+          on_due(item.first, item.second);
+        } else {
+          schedule(item.first, std::move(item.second));
+        }
+      }
+      return;
+    }
+
+    while (now_ < to) {
+      now_++;
+      cascade();
+      auto &slot = levels_[0][now_ & SlotMask];
+      if (slot.empty()) {
+        continue;
+      }
+      // on_due may schedule new items into this slot, they belong to the next round
+      auto due = std::move(slot);
+      slot.clear();
+      size_ -= due.size();
+      for (auto &item : due) {
+        on_due(item.first, item.second);
+      }
+    }
+  }
+
+  [[nodiscard]]
+  size_t memory_size() const {
+    size_t ret = sizeof(*this) + overflow_.capacity() * sizeof(std::pair<Tick, T>);
+    for (auto &level : levels_) {
+      for (auto &slot : level) {
+        ret += slot.capacity() * sizeof(std::pair<Tick, T>);
+      }
+    }
+    return ret;
+  }
+
+ private:
+  static constexpr size_t SlotBits = 6;
+  static constexpr size_t SlotCount = size_t(1) << SlotBits;
+  static constexpr Tick SlotMask = SlotCount - 1;
+  static constexpr size_t LevelCount = 4;
+  static constexpr Tick Range = Tick(1) << (SlotBits * LevelCount);
+
+  void place(Tick deadline, T item) {
+    for (size_t level = 0; level < LevelCount; level++) {
+      // The deadline falls into the current turn of the next level
+      auto shift = SlotBits * (level + 1);
+      if ((deadline >> shift) == (now_ >> shift)) {
+        levels_[level][(deadline >> (SlotBits * level)) & SlotMask].emplace_back(deadline, std::move(item));
+        return;
+      }
+    }
+    overflow_.emplace_back(deadline, std::move(item));
+  }
+
+  // Move the items of the higher level slots that start at now_ down
+  void cascade() {
+    if ((now_ & (Range - 1)) == 0) {
+      redistribute(overflow_);
+    }
+    for (size_t level = LevelCount - 1; level > 0; level--) {
+      auto shift = SlotBits * level;
+      if ((now_ & ((Tick(1) << shift) - 1)) == 0) {
+        redistribute(levels_[level][(now_ >> shift) & SlotMask]);
+      }
+    }
+  }
+
+  void redistribute(std::vector<std::pair<Tick, T>> &slot) {
+    auto items = std::move(slot);
+    slot.clear();
+    for (auto &item : items) {
+      place(item.first, std::move(item.second));
+    }
+  }
+
+ private:
+  Tick now_;
+  size_t size_ = 0;
+  std::array<std::array<std::vector<std::pair<Tick, T>>, SlotCount>, LevelCount> levels_{};
+  std::vector<std::pair<Tick, T>> overflow_;
+};
+
+}
@@ -1,48 +1,114 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 
 #include <chrono>
-#include <unordered_set>
-#include <unordered_map>
+#include <deque>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 namespace albert::dht {
 
-class BlacklistItem {
- public:
-  BlacklistItem(std::chrono::microseconds expiration)
-      : expired_at_(std::chrono::system_clock::now() + expiration) { }
-  bool expired() const;
- private:
-  std::chrono::system_clock::time_point expired_at_;
-};
-
-
+/**
+ * Banned endpoints, and optionally the /24 subnets of endpoints banned many times.
+ *
+ * has() runs for every datagram, so it first asks a Bloom filter of one 64 bit word per key,
+ *   only keys that may be banned are looked up in the table. Bits of removed keys stay set until
+ *   the filter is rebuilt, which happens once as many keys were removed as are left.
+ * The table is open addressing with linear probing, sized for max_size records at half load.
+ *   When it is full a clock hand evicts a record that was not hit since the hand last passed.
+ * All bans last the same duration, so they expire in the order they were added. gc() pops them from
+ *   a queue in that order instead of scanning the table.
+ *
+ * With a subnet threshold, each ban also counts towards its /24, and the /24 itself is banned at the
+ *   threshold, until the duration passed after the last ban in it.
+ */
 class Blacklist {
  public:
   typedef std::tuple<uint32_t, uint16_t> KeyType;
 
-  struct BlacklistHash {
-    size_t operator()(const KeyType &item) const;
-  };
-
-  Blacklist(size_t max_size, std::chrono::microseconds duration) :max_size_(max_size), banning_duration_(duration) { }
+  // subnet_threshold: Number of banned endpoints that bans their /24, 0 to never ban subnets
+  Blacklist(size_t max_size, std::chrono::microseconds duration, size_t subnet_threshold = 0);
 
+  // Returns true if the endpoint was not banned
   bool add(KeyType endpoint);
 
+  // Not const, a hit keeps the ban from being evicted
   [[nodiscard]]
-  bool has(const KeyType &item) const;
+  bool has(const KeyType &item);
 
   [[nodiscard]]
-  size_t memory_size() const {
-    return sizeof(*this) + items_.size() * (sizeof(KeyType) + sizeof(BlacklistItem));
-  }
+  size_t memory_size() const;
+  // Banned endpoints
+  [[nodiscard]]
+  size_t size() const { return endpoint_count_; }
   [[nodiscard]]
-  size_t size() const { return items_.size(); }
+  size_t subnet_count() const { return subnet_count_; }
 
+  // Remove the expired bans, returns how many
   size_t gc();
+
  private:
+  struct Record {
+    // Key | Occupied, 0 for an empty slot
+    uint64_t key = 0;
+    // Whole seconds of common::CoarseClock
+    uint32_t expires_at = 0;
+    // Banned endpoints in the subnet, subnet records only
+    uint16_t count = 0;
+    bool referenced = false;
+    // A subnet record is only a counter until the threshold
+    bool banned = false;
+  };
+  static_assert(sizeof(Record) == 16);
+  static constexpr uint64_t Occupied = uint64_t(1) << 63u;
+  // Endpoint keys fit in 48 bits, subnet keys have this bit set
+  static constexpr uint64_t SubnetBit = uint64_t(1) << 48u;
+
+  static uint64_t endpoint_key(uint32_t ip, uint16_t port) { return (uint64_t(ip) << 16u) | port; }
+  static uint64_t subnet_key(uint32_t ip) { return SubnetBit | (ip >> 8u); }
+  static bool is_subnet(uint64_t key) { return (key & SubnetBit) != 0; }
+  static uint64_t hash(uint64_t key);
+  static uint32_t now_seconds();
+
+  // Bloom filter, the bits of a key are all in one word
+  static uint64_t filter_mask(uint64_t h);
+  [[nodiscard]]
+  bool may_contain(uint64_t key) const;
+  void filter_add(uint64_t key);
+  void rebuild_filter();
+
+  // Slot of the key, npos if it is not in the table
+  [[nodiscard]]
+  size_t find(uint64_t key) const;
+  // Slot of a new record of the key, the key must not be in the table
+  size_t insert(uint64_t key);
+  void erase(size_t slot);
+  void evict();
+  // Whether the key is banned now, and mark it referenced if so
+  bool hit(uint64_t key, uint32_t now);
+  void ban(size_t slot, uint32_t now);
+
+ private:
+  static constexpr size_t npos = ~size_t(0);
+
   size_t max_size_;
-  std::chrono::microseconds banning_duration_;
-  std::unordered_map<KeyType, BlacklistItem, BlacklistHash> items_;
+  uint32_t duration_seconds_;
+  size_t subnet_threshold_;
+
+  std::vector<uint64_t> filter_;
+  // Removed since the filter was last built
+  size_t filter_stale_ = 0;
+
+  std::vector<Record> records_;
+  size_t size_ = 0;
+  size_t clock_hand_ = 0;
+  size_t endpoint_count_ = 0;
+  size_t subnet_count_ = 0;
+
+  // (key, expires_at) in ban order, items whose record was banned again or removed are skipped
+  std::deque<std::pair<uint64_t, uint32_t>> expirations_;
 };
 
-}
\ No newline at end of file
+}
@@ -31,13 +31,27 @@ struct Config :public albert::config::Config {
 
   std::string info_hash_save_path = "info_hash.txt";
   std::string routing_table_save_path = "route.txt";
+  // The main routing table is saved in the background this often, 0 to only save it on exit
+  int routing_table_checkpoint_interval_seconds = 60;
 
   int discovery_interval_seconds = 5;
   int report_interval_seconds = 5;
   int refresh_nodes_check_interval_seconds = 5;
+  // Questionable nodes are pinged at this rate instead of all at once
+  size_t max_node_pings_per_second = 64;
   int get_peers_refresh_interval_seconds = 2;
   int get_peers_request_expiration_seconds = 30;
+  // Queries in flight per lookup, and nodes a lookup keeps to ask
+  size_t get_peers_alpha = 3;
+  size_t get_peers_shortlist_size = 32;
+  // An endpoint is left out of lookups for a while once this many of its get_peers queries in a row timed out
+  size_t get_peers_max_timeouts_in_row = 3;
+  int get_peers_unresponsive_seconds = 300;
+  // The longest a query waits for its response, whatever the round trip times
   int transaction_expiration_seconds = 60;
+  // Timeout of queries before any response, then it adapts to the round trip times, but no shorter than the min
+  int transaction_initial_timeout_ms = 3000;
+  int transaction_min_timeout_ms = 1000;
 
   bool throttler_enabled = false;
   int throttler_max_rps = 1000;
@@ -52,9 +66,13 @@ struct Config :public albert::config::Config {
   bool fake_id = false;
   size_t fake_id_prefix_length = 128;
   bool fat_routing_table = false;
+  // Flat buckets indexed by common prefix length instead of the trie, non fat mode only
+  bool flat_routing_table = false;
 
   size_t blacklist_size = 65536;
   size_t blacklist_hours = 6;
+  // Ban the /24 of this many banned endpoints, 0 to only ban endpoints
+  size_t blacklist_subnet_threshold = 0;
 
   bool debug = false;
   std::string resolve_torrent_info_hash;
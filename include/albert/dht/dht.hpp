@@ -11,9 +11,12 @@
 #include <tuple>
 #include <vector>
 
+#include <gsl/span>
+
 #include <albert/krpc/krpc.hpp>
 #include <albert/dht/blacklist.hpp>
 #include <albert/dht/config.hpp>
+#include <albert/dht/rtt_estimator.hpp>
 #include <albert/dht/transaction.hpp>
 
 namespace boost::asio {
@@ -29,6 +32,7 @@ class U160;
 namespace albert::dht {
 namespace routing_table {
 class RoutingTable;
+class EntryStore;
 }
 namespace get_peers {
   class GetPeersManager;
@@ -47,16 +51,25 @@ class DHT {
   ~DHT();
 
   // routing_table: The routing table the query belongs to. If routing_table is nullptr, it belongs all routing tables.
-  std::string create_query(std::shared_ptr<krpc::Query> query, routing_table::RoutingTable *routing_table);
-  std::string create_response(const krpc::Response &query);
+  // ip, port: The node the query is sent to, its round trip times set the timeout of the query.
+  // The message is encoded into buffer, returns the encoded size, throws bencoding::WriterOverflow if it does not fit
+  size_t create_query(
+      std::shared_ptr<krpc::Query> query,
+      routing_table::RoutingTable *routing_table,
+      uint32_t ip, uint16_t port,
+      gsl::span<uint8_t> buffer);
+  size_t create_response(const krpc::Response &response, gsl::span<uint8_t> buffer);
   double get_current_time() const {
     return std::chrono::duration<double>(
         std::chrono::high_resolution_clock::now() - bootstrap_time_).count();
   }
 
   void add_routing_table(std::unique_ptr<routing_table::RoutingTable> routing_table);
+  // Nodes of all routing tables, new tables should share it
+  [[nodiscard]]
+  std::shared_ptr<routing_table::EntryStore> node_store() const { return node_store_; }
 
-  bool in_black_list(uint32_t ip, uint16_t port) const;
+  bool in_black_list(uint32_t ip, uint16_t port);
   bool add_to_black_list(uint32_t ip, uint16_t port);
 
   size_t memory_size() const;
@@ -67,6 +80,8 @@ class DHT {
   krpc::NodeInfo self_info_;
 
   dht::TransactionManager transaction_manager;
+  dht::RttEstimator rtt_;
+  std::shared_ptr<dht::routing_table::EntryStore> node_store_;
   std::list<std::unique_ptr<dht::routing_table::RoutingTable>> routing_tables_;
   dht::routing_table::RoutingTable *main_routing_table_;
 
@@ -98,7 +113,17 @@ class DHTInterface {
   DHTInterface(Config config, boost::asio::io_service &io_service);
   ~DHTInterface();
   void start();
-  void get_peers(const u160::U160 &info_hash, const std::function<void(uint32_t, uint16_t)> &callback);
+  // callback is called for each new peer, on_done once the lookup finished or expired
+  void get_peers(
+      const u160::U160 &info_hash,
+      const std::function<void(uint32_t, uint16_t)> &callback,
+      const std::function<void()> &on_done = nullptr);
+  // get_peers() of each info hash. The lookups share the nodes they learn, a lookup takes the ones closer to
+  // its target than its own, so lookups of many info hashes at once need fewer queries than one by one
+  void get_peers_batch(
+      gsl::span<const u160::U160> info_hashes,
+      const std::function<void(const u160::U160 &info_hash, uint32_t ip, uint16_t port)> &callback,
+      const std::function<void(const u160::U160 &info_hash)> &on_done = nullptr);
   void sample_infohashes(const std::function<void(const u160::U160 &info_hash)> handler);
   void set_announce_peer_handler(std::function<void (const u160::U160 &info_hash)> handler);
   size_t memory_size() const;
@@ -0,0 +1,250 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <albert/common/coarse_clock.hpp>
+#include <albert/common/open_hash_map.hpp>
+#include <albert/common/timing_wheel.hpp>
+#include <albert/krpc/krpc.hpp>
+#include <albert/u160/u160.hpp>
+
+namespace albert::dht::routing_table {
+
+const int MaxGoodNodeAliveMinutes = 15;
+
+enum class EntryState : uint8_t {
+  Good,
+  Questionable,
+  Bad,
+};
+
+// Number of entries in each state
+struct StateCounts {
+  size_t good = 0;
+  size_t questionable = 0;
+  size_t bad = 0;
+
+  [[nodiscard]]
+  size_t known() const { return good + questionable + bad; }
+
+  size_t &operator[](EntryState state) {
+    switch (state) {
+      case EntryState::Good: return good;
+      case EntryState::Questionable: return questionable;
+      default: return bad;
+    }
+  }
+  StateCounts &operator+=(const StateCounts &rhs) {
+    good += rhs.good;
+    questionable += rhs.questionable;
+    bad += rhs.bad;
+    return *this;
+  }
+};
+
+/**
+ * A node of the routing tables, packed into 40 bytes so that tables of millions of nodes fit in memory.
+ *
+ * Times are kept as 32 bit whole seconds of the clock, 0 for never, so they are one second coarse
+ *   like the timing wheel of EntryStore. The client version, the "v" of the messages of the node,
+ *   is kept inline, BEP 20 versions are 4 bytes and longer ones are cut.
+ */
+class Entry {
+ public:
+  static constexpr size_t MaxVersionLength = 4;
+
+  // An empty entry, for the free slots of EntryStore
+  Entry() = default;
+  Entry(const krpc::NodeInfo &info, std::string_view version);
+  Entry(const u160::U160 &id, uint32_t ip, uint16_t port, std::string_view version)
+      :Entry(krpc::NodeInfo(id, ip, port), version) { }
+  // A node restored from a snapshot, it stays good until last_seen is MaxGoodNodeAliveMinutes old
+  Entry(const krpc::NodeInfo &info, std::string_view version, std::chrono::high_resolution_clock::time_point last_seen);
+
+  Entry(const Entry &rhs) = default;
+  Entry(Entry &&rhs) = default;
+  Entry &operator=(const Entry &rhs) = default;
+  Entry &operator=(Entry &&rhs) = default;
+
+  [[nodiscard]]
+  krpc::NodeInfo node_info() const { return krpc::NodeInfo(id(), ip_, port_); }
+
+  [[nodiscard]]
+  u160::U160 id() const { return u160::U160::decode(id_); }
+
+  [[nodiscard]]
+  uint32_t ip() const { return ip_; }
+
+  [[nodiscard]]
+  uint16_t port() const { return port_; }
+
+  [[nodiscard]]
+  std::string_view version() const { return {version_, version_length_}; }
+
+  // When the node last responded, time_point{} if it never did
+  [[nodiscard]]
+  std::chrono::high_resolution_clock::time_point last_seen() const;
+  // A query was sent to it since it last responded
+  [[nodiscard]]
+  bool response_required() const { return response_required_; }
+
+  bool operator<(const Entry &rhs) const {
+    return id() < rhs.id();
+  }
+
+  // The ones without a time point use common::CoarseClock
+  [[nodiscard]]
+  bool is_good() const noexcept ;
+  // Same as is_good() with the clock already read, for checking many entries at once
+  [[nodiscard]]
+  bool is_good(std::chrono::high_resolution_clock::time_point now) const noexcept;
+
+  [[nodiscard]]
+  bool is_bad() const;
+  [[nodiscard]]
+  bool is_bad(std::chrono::high_resolution_clock::time_point now) const;
+
+  [[nodiscard]]
+  EntryState state(std::chrono::high_resolution_clock::time_point now) const;
+  // When state() changes next only because time passes, time_point::max() if it does not
+  [[nodiscard]]
+  std::chrono::high_resolution_clock::time_point next_state_change(
+      std::chrono::high_resolution_clock::time_point now) const;
+
+  void make_good_now();
+  void make_bad();
+  bool require_response_now();
+
+  [[nodiscard]]
+  std::string to_string() const {
+    return node_info().to_string() + "@" + std::string(version());
+  }
+
+ private:
+  uint8_t id_[u160::U160Length]{};
+  uint32_t ip_{};
+  // Whole seconds of the clock, 0 for never
+  uint32_t last_seen_{};
+  uint32_t last_require_response_{};
+  uint16_t port_{};
+  char version_[MaxVersionLength]{};
+  uint8_t version_length_ : 3 {};
+  bool response_required_ : 1 {};
+  bool bad_ : 1 {};
+};
+static_assert(sizeof(Entry) == 40);
+
+/**
+ * Entries of the routing tables, addressed by slot.
+ *
+ * A slot stays valid until its entry is removed, so buckets only keep slots and moving nodes between buckets
+ *   does not touch the entries. Entries are also indexed by endpoint, which finds the entry of a sender in O(1).
+ * Each endpoint can only have one entry.
+ *
+ * Several routing tables can share one store. Each table registers with add_table() and holds a subset of the entries,
+ *   an entry is kept once with the set of tables holding it, and removed with its last table.
+ *   The liveness of a node lives in its entry, so a status update is seen by every table holding it.
+ *
+ * The store also counts entries by state, in total and per table. Changes made through the store are counted at once,
+ *   changes that only come from time passing are scheduled on a timing wheel with one second ticks
+ *   and counted by expire(), which only visits the entries that are due.
+ *   Every change of a counted state is reported to the callbacks of the tables holding the entry,
+ *   so buckets can keep their own counts.
+ */
+class EntryStore {
+ public:
+  using Slot = uint32_t;
+  static constexpr Slot npos = ~Slot(0);
+  using TableId = uint8_t;
+  static constexpr size_t MaxTables = 32;
+  using TimePoint = common::CoarseClock::time_point;
+  using Wheel = common::TimingWheel<Slot>;
+  using StateChangeCallback = std::function<void (Slot slot, EntryState old_state, EntryState new_state)>;
+
+  // Throws std::length_error if there are already MaxTables tables
+  TableId add_table(StateChangeCallback callback);
+  // Remove the table from all entries it holds
+  void remove_table(TableId table);
+
+  // Add the entry to the table, or only the table to the entry of the same node if the store has one.
+  // Throws std::invalid_argument if the endpoint has an entry with another id, or the table already holds it
+  Slot insert(TableId table, Entry entry);
+  // Remove the entry from the table, returns a copy of it
+  Entry remove(TableId table, Slot slot);
+  void reserve(size_t n);
+
+  // Use the modifiers below to change the state of an entry, so that it gets counted
+  const Entry &operator[](Slot slot) const { return records_[slot].entry; }
+
+  void make_good_now(Slot slot);
+  void make_bad(Slot slot);
+  bool require_response_now(Slot slot);
+
+  // Count the state changes due at now
+  void expire(TimePoint now);
+
+  // Whole seconds since the clock epoch, the ticks of the timing wheels
+  static Wheel::Tick tick(TimePoint time);
+
+  // State of the entry as of the last expire()
+  [[nodiscard]]
+  EntryState state(Slot slot) const { return records_[slot].state; }
+  // Of all distinct entries
+  [[nodiscard]]
+  const StateCounts &counts() const { return counts_; }
+  // Of the entries the table holds
+  [[nodiscard]]
+  const StateCounts &counts(TableId table) const { return tables_[table].counts; }
+  [[nodiscard]]
+  bool contains(TableId table, Slot slot) const { return (records_[slot].tables >> table) & 1u; }
+
+  // Slot of the entry with this endpoint, npos if there is none
+  [[nodiscard]]
+  Slot find(uint32_t ip, uint16_t port) const;
+
+  [[nodiscard]]
+  size_t size() const { return endpoints_.size(); }
+  [[nodiscard]]
+  size_t memory_size() const;
+
+ private:
+  static uint64_t endpoint_key(uint32_t ip, uint16_t port) { return (uint64_t(ip) << 16u) | port; }
+  // Count the current state of the entry and schedule its next change
+  void update(Slot slot, TimePoint now);
+
+ private:
+  struct Record {
+    Entry entry;
+    // Bit i is set if table i holds the entry, 0 for a free slot
+    uint32_t tables = 0;
+    // Tick of the live schedule item of this slot, older items are skipped. Ticks are seconds, they fit
+    uint32_t scheduled = NotScheduled;
+    EntryState state = EntryState::Questionable;
+  };
+  static constexpr uint32_t NotScheduled = ~uint32_t(0);
+  std::vector<Record> records_;
+  std::vector<Slot> free_slots_;
+  common::OpenHashMap<uint64_t, Slot> endpoints_;
+
+  struct Table {
+    bool used = false;
+    StateCounts counts;
+    StateChangeCallback on_state_change;
+  };
+  static_assert(MaxTables <= sizeof(Record::tables) * 8);
+  std::array<Table, MaxTables> tables_{};
+
+  StateCounts counts_;
+  // State change deadlines
+  Wheel schedule_{tick(common::CoarseClock::now())};
+};
+
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <functional>
+#include <list>
+#include <optional>
+#include <ostream>
+#include <tuple>
+#include <vector>
+
+#include <albert/common/open_hash_map.hpp>
+#include <albert/dht/routing_table/routing_table.hpp>
+#include <albert/u160/u160.hpp>
+
+namespace albert::dht::routing_table {
+
+/**
+ * Non fat routing table backend, one bucket per common prefix length with our own id.
+ *
+ * Bucket i holds the nodes whose ids share exactly i leading bits with self,
+ *   the last bucket also holds the nodes that share more.
+ * This is the same partition the trie reaches by only splitting the bucket self is in,
+ *   but the bucket of an id is found in O(1) and the slots of a bucket are contiguous.
+ * An id is found through a hash index of its position in its bucket, buckets are only scanned by gc and lookups.
+ *   Buckets keep the ids next to the slots, so lookups only read the entries of the nodes they may return.
+ */
+class FlatTable {
+ public:
+  static constexpr size_t BucketCount = u160::U160Bits;
+
+  FlatTable(const RoutingTable *owner, EntryStore *store, RefreshWheel *refresh_wheel)
+      :owner_(owner), store_(store), refresh_wheel_(refresh_wheel) {
+    changed_at_.fill(common::CoarseClock::now());
+  }
+
+  [[nodiscard]]
+  size_t bucket_index(const u160::U160 &id) const;
+  [[nodiscard]]
+  u160::U160 prefix(size_t i) const;
+  [[nodiscard]]
+  static size_t prefix_length(size_t i) { return std::min(i + 1, BucketCount - 1); }
+
+  // Counts are as of the last EntryStore::expire()
+  [[nodiscard]]
+  bool is_full() const { return full_bucket_count_ == BucketCount - 1; }
+  [[nodiscard]]
+  size_t bucket_good_node_count(size_t i) const { return counts_[i].good; }
+  [[nodiscard]]
+  size_t bucket_known_node_count(size_t i) const { return buckets_[i].size(); }
+  [[nodiscard]]
+  size_t max_prefix_length() const;
+  // Buckets with at least one good node
+  [[nodiscard]]
+  size_t bucket_count() const { return good_bucket_count_; }
+  [[nodiscard]]
+  size_t memory_size() const;
+  void k_closest_good_nodes(KClosest &result) const;
+
+  bool add_node(Entry entry);
+  std::optional<Entry> remove(const u160::U160 &id);
+  void remove(uint32_t ip, uint16_t port);
+  std::tuple<size_t, size_t, size_t, std::list<krpc::NodeInfo>> gc();
+
+  void iterate_entries(const std::function<void (const Entry&)> &cb) const;
+
+  bool require_response_now(const u160::U160 &id);
+  bool make_good_now(const u160::U160 &id);
+  bool make_good_now(uint32_t ip, uint16_t port);
+  void make_bad(uint32_t ip, uint16_t port);
+  // Called by the EntryStore when an entry changes state
+  void state_changed(EntryStore::Slot slot, EntryState old_state, EntryState new_state);
+
+  // Same as the ones of Bucket, buckets are scheduled when they get their first node
+  std::optional<u160::U160> refresh(const RefreshWheel::Tick &tick, const std::pair<u160::U160, size_t> &item);
+
+  void encode(std::ostream &os) const;
+
+  EntryStore::Slot search(const u160::U160 &id) const;
+
+ private:
+  void schedule_refresh(size_t i);
+  // Move one entry of bucket i from old_state to new_state, nullopt for an entry added or removed
+  void count(size_t i, std::optional<EntryState> old_state, std::optional<EntryState> new_state);
+  [[nodiscard]]
+  bool bucket_full(size_t i) const;
+  // Move end_ back over the buckets that became empty
+  void shrink_end();
+
+ private:
+  const RoutingTable *owner_;
+  EntryStore *store_;
+  RefreshWheel *refresh_wheel_;
+  struct Item {
+    u160::U160 id;
+    // Of the entry in owner's EntryStore
+    EntryStore::Slot slot;
+  };
+  std::array<std::vector<Item>, BucketCount> buckets_{};
+  // One past the last non empty bucket, the buckets after it are not visited
+  size_t end_ = 0;
+  // Id to the index of its item in buckets_[bucket_index(id)]
+  common::OpenHashMap<u160::U160, uint32_t> positions_;
+  std::array<StateCounts, BucketCount> counts_{};
+  // Full buckets, not counting the last one which never gets full
+  size_t full_bucket_count_ = 0;
+  size_t good_bucket_count_ = 0;
+
+  static constexpr RefreshWheel::Tick NotScheduled = 0;
+  std::array<common::CoarseClock::time_point, BucketCount> changed_at_{};
+  std::array<RefreshWheel::Tick, BucketCount> refresh_scheduled_{};
+};
+
+}
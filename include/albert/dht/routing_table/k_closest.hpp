@@ -0,0 +1,93 @@
+#pragma once
+#include <cstddef>
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+#include <albert/common/coarse_clock.hpp>
+#include <albert/common/fixed_vector.hpp>
+#include <albert/krpc/krpc.hpp>
+#include <albert/u160/u160.hpp>
+
+namespace albert::dht::routing_table {
+
+// Most nodes one k closest query returns
+constexpr size_t MaxClosestNodes = 32;
+// Nodes sorted by distance to the target, closest first
+using ClosestNodes = common::FixedVector<krpc::NodeInfo, MaxClosestNodes>;
+
+/**
+ * Collects the k nodes closest to a target by XOR distance.
+ *
+ * Keeps a bounded max heap on distance, so each candidate costs one comparison once the heap is full.
+ * Buckets can ask may_contain_closer() with their prefix to skip themselves.
+ */
+class KClosest {
+ public:
+  // k is clamped to MaxClosestNodes
+  KClosest(const u160::U160 &target, size_t k)
+      :target_(target), k_(std::min(k, MaxClosestNodes)), now_(common::CoarseClock::now()) { }
+
+  [[nodiscard]]
+  const u160::U160 &target() const { return target_; }
+  // Time of the query, to check whether nodes are good
+  [[nodiscard]]
+  std::chrono::high_resolution_clock::time_point now() const { return now_; }
+  [[nodiscard]]
+  bool full() const { return heap_.size() >= k_; }
+
+  // Whether any id starting with the prefix_length bits of prefix could be added
+  [[nodiscard]]
+  bool may_contain_closer(const u160::U160 &prefix, size_t prefix_length) const {
+    if (!full()) {
+      return true;
+    }
+    auto min_distance = (prefix ^ target_) & u160::U160::high_mask(prefix_length);
+    return min_distance < heap_.front().first;
+  }
+
+  // Whether a node with this id would be added, cheaper than checking if the node is good first
+  [[nodiscard]]
+  bool accepts(const u160::U160 &id) const {
+    return k_ > 0 && (!full() || (id ^ target_) < heap_.front().first);
+  }
+
+  void add(const krpc::NodeInfo &node) {
+    if (!accepts(node.id())) {
+      return;
+    }
+    auto distance = node.id() ^ target_;
+    if (full()) {
+      std::pop_heap(heap_.begin(), heap_.end(), Less());
+      heap_.pop_back();
+    }
+    heap_.push_back({distance, node});
+    std::push_heap(heap_.begin(), heap_.end(), Less());
+  }
+
+  [[nodiscard]]
+  ClosestNodes result() const {
+    auto sorted = heap_;
+    std::sort_heap(sorted.begin(), sorted.end(), Less());
+    ClosestNodes ret;
+    for (auto &item : sorted) {
+      ret.push_back(item.second);
+    }
+    return ret;
+  }
+
+ private:
+  using Item = std::pair<u160::U160, krpc::NodeInfo>;
+  struct Less {
+    bool operator()(const Item &lhs, const Item &rhs) const { return lhs.first < rhs.first; }
+  };
+
+ private:
+  u160::U160 target_;
+  size_t k_;
+  std::chrono::high_resolution_clock::time_point now_;
+  common::FixedVector<Item, MaxClosestNodes> heap_;
+};
+
+}
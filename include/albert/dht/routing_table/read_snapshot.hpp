@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+#include <albert/dht/routing_table/k_closest.hpp>
+#include <albert/krpc/krpc.hpp>
+#include <albert/u160/u160.hpp>
+
+namespace albert::dht::routing_table {
+
+/**
+ * Immutable copy of the good nodes of a routing table, read by any thread without locks.
+ *
+ * The thread owning the table builds a new one with RoutingTable::publish() and swaps it in atomically,
+ *   readers keep the one they loaded alive through its shared_ptr, and the last reader of a replaced one frees it.
+ * Nodes are sorted by id, so the nodes sharing a prefix with the target are contiguous
+ *   and the k closest are found by binary searches instead of visiting buckets.
+ */
+class ReadSnapshot {
+ public:
+  ReadSnapshot() = default;
+  // version is the change counter of the table when the nodes were copied
+  ReadSnapshot(uint64_t version, std::vector<krpc::NodeInfo> nodes);
+
+  [[nodiscard]]
+  uint64_t version() const { return version_; }
+  [[nodiscard]]
+  size_t size() const { return nodes_.size(); }
+  [[nodiscard]]
+  size_t memory_size() const { return sizeof(*this) + nodes_.capacity() * sizeof(krpc::NodeInfo); }
+
+  // Same as RoutingTable::k_nearest_good_nodes(), as of the version
+  [[nodiscard]]
+  ClosestNodes k_nearest_good_nodes(const u160::U160 &id, size_t k) const;
+
+ private:
+  using Iterator = std::vector<krpc::NodeInfo>::const_iterator;
+  // Append the k nodes of [first, last) closest to target, all of them share their first depth bits
+  static void closest(Iterator first, Iterator last, size_t depth, const u160::U160 &target, size_t k,
+                      ClosestNodes &result);
+
+ private:
+  uint64_t version_ = 0;
+  std::vector<krpc::NodeInfo> nodes_;
+};
+
+}
@@ -3,7 +3,9 @@
 
 #include <cstdint>
 
+#include <atomic>
 #include <chrono>
+#include <deque>
 #include <exception>
 #include <functional>
 #include <iostream>
@@ -13,82 +15,46 @@
 #include <optional>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include <boost/asio/ip/address_v4.hpp>
-
+#include <gsl/span>
+
+#include <albert/common/coarse_clock.hpp>
+#include <albert/common/open_hash_map.hpp>
+#include <albert/common/timing_wheel.hpp>
+#include <albert/dht/routing_table/entry.hpp>
+#include <albert/dht/routing_table/k_closest.hpp>
+#include <albert/dht/routing_table/read_snapshot.hpp>
 #include <albert/u160/u160.hpp>
 
 namespace albert::dht::routing_table {
 
-const int MaxGoodNodeAliveMinutes = 15;
-
-class Entry {
- public:
-  explicit Entry(krpc::NodeInfo info, const std::string &version) :info_(std::move(info)), version_(version) { }
-  Entry(u160::U160 id, uint32_t ip, uint16_t port, const std::string &version)
-      :info_(id, ip, port), version_(version) { }
-
-  Entry(const Entry &rhs) = default;
-  Entry(Entry &&rhs) = default;
-
-  [[nodiscard]]
-  krpc::NodeInfo node_info() const { return info_; }
-
-  [[nodiscard]]
-  u160::U160 id() const { return info_.id(); }
-
-  [[nodiscard]]
-  uint32_t ip() const { return info_.ip(); }
-
-  [[nodiscard]]
-  uint16_t port() const { return info_.port(); }
-
-  [[nodiscard]]
-  std::string version() const { return version_; }
-
-  bool operator<(const Entry &rhs) const {
-    return info_.id() < rhs.info_.id();
-  }
-
-  [[nodiscard]]
-  bool is_good() const noexcept ;
-
-  [[nodiscard]]
-  bool is_bad() const;
-
-  void make_good_now();
-  void make_bad();
-  bool require_response_now();
-
-  [[nodiscard]]
-  std::string to_string() const {
-    return info_.to_string() + "@" + version();
-  }
-
- private:
-  const krpc::NodeInfo info_;
-  const std::string version_;
-
-  std::chrono::high_resolution_clock::time_point last_seen_{};
-  bool response_required = false;
-  std::chrono::high_resolution_clock::time_point last_require_response_{};
-
-  bool bad_ = false;
-};
-
 // ref:
 //  Each bucket can only hold K nodes, currently eight, before becoming "full."
 const size_t BucketMaxGoodItems = 8;
 const size_t BucketMaxItems = 32;
+// ref:
+//  Buckets that have not been changed in 15 minutes should be "refreshed."
+const int BucketRefreshMinutes = 15;
+// A snapshot is rebuilt once this fraction of its size changed, or when it is this old and anything changed
+const size_t PublishChangeDivisor = 16;
+const int PublishMaxAgeSeconds = 30;
+
+// Bucket refresh deadlines, items are the prefix and prefix length of a bucket
+using RefreshWheel = common::TimingWheel<std::pair<u160::U160, size_t>>;
+
 class RoutingTable;
 class Bucket {
  public:
-  Bucket(const RoutingTable *owner, bool fat_mode)
-      :parent_(nullptr), owner_(owner), fat_mode_(fat_mode) {}
+  Bucket(const RoutingTable *owner, EntryStore *store, RefreshWheel *refresh_wheel, bool fat_mode)
+      :parent_(nullptr), owner_(owner), store_(store), refresh_wheel_(refresh_wheel), fat_mode_(fat_mode) {}
 
   Bucket(Bucket *parent, const RoutingTable *owner)
       :parent_(parent),
        owner_(owner),
+       store_(parent ? parent->store_ : nullptr),
+       refresh_wheel_(parent ? parent->refresh_wheel_ : nullptr),
        fat_mode_(parent ? parent->fat_mode_ : false) {
     if (parent == nullptr) {
       throw std::invalid_argument("Bucket constructor, parent should not be nullptr");
@@ -99,16 +65,22 @@ class Bucket {
   bool self_in_bucket() const;
   bool in_bucket(u160::U160 id) const;
   bool is_leaf() const;
-  bool is_full() const;
+  bool is_full() const { return non_full_leaf_count_ == 0; }
   size_t prefix_length() const;
   u160::U160 prefix() const { return prefix_; }
-  size_t leaf_count() const;
-  size_t total_good_node_count() const;
-  size_t good_node_count() const;
-  size_t total_known_node_count() const;
+
+  // Aggregates of the subtree, kept current on every change, as of the last EntryStore::expire()
+  size_t leaf_count() const { return leaf_count_; }
+  size_t good_leaf_count() const { return good_leaf_count_; }
+  size_t max_prefix_length() const { return max_prefix_length_; }
+  size_t total_good_node_count() const { return counts_.good; }
+  size_t total_known_node_count() const { return counts_.known(); }
+  size_t memory_size() const { return memory_size_; }
+  // Of a leaf
+  size_t good_node_count() const { return counts_.good; }
   size_t known_node_count() const;
-  size_t memory_size() const;
-  std::list<Entry> k_nearest_good_nodes(const u160::U160 &id, size_t k) const;
+  // Add the good nodes that may be closer than the ones in result
+  void k_closest_good_nodes(KClosest &result) const;
 
 
   // Node manipulating functions
@@ -127,11 +99,23 @@ class Bucket {
   bool make_good_now(const u160::U160 &id);
   bool make_good_now(uint32_t ip, uint16_t port);
   void make_bad(uint32_t ip, uint16_t port);
+  // Called by the EntryStore when an entry of this subtree changes state
+  void state_changed(EntryStore::Slot slot, EntryState old_state, EntryState new_state);
+  // Recompute the aggregates of this bucket and its ancestors
+  void update_aggregates();
+
+  // Slot of the entry with this id, EntryStore::npos if there is none
+  EntryStore::Slot search(const u160::U160 &id) const;
+
+  // Schedule the refresh of this leaf BucketRefreshMinutes after it last changed
+  void schedule_refresh();
+  // Handle a due refresh item, returns a random id in the leaf to look up if it has not changed since
+  std::optional<u160::U160> refresh(const RefreshWheel::Tick &tick, const std::pair<u160::U160, size_t> &item);
 
   void encode(std::ostream &os);
 
   [[nodiscard]]
-  std::list<std::tuple<Entry, u160::U160>> find_some_node_for_filling_bucket(size_t k) const;
+  std::list<std::tuple<krpc::NodeInfo, u160::U160>> find_some_node_for_filling_bucket(size_t k) const;
 
  private:
   static std::string indent(int n);
@@ -142,11 +126,11 @@ class Bucket {
   void merge();
 
  private:
-  // NOTE:
-  //  This function is quite dangerous.
-  //  as changing `entry.id_` may cause the map key and value.id inconsistent
-  bool dfs_w(const std::function<bool (Bucket&)> &cb);
-  Entry *search(const u160::U160 &id);
+  // The leaf bucket id belongs to
+  Bucket *leaf(const u160::U160 &id);
+  const Bucket *leaf(const u160::U160 &id) const;
+  // Record a change of a leaf for refreshing
+  void touch() { changed_at_ = common::CoarseClock::now(); }
 
   [[nodiscard]]
   u160::U160 min() const;
@@ -158,8 +142,8 @@ class Bucket {
   }
 
  private:
-  // nodes are sorted in one buckets
-  std::map<u160::U160, Entry> known_nodes_{};
+  // Slots of the entries in owner's EntryStore
+  common::OpenHashMap<u160::U160, EntryStore::Slot> known_nodes_{};
 
   /**
    * How `prefix`, `min` and `max` Are Related.
@@ -187,32 +171,45 @@ class Bucket {
   std::unique_ptr<Bucket> left_{}, right_{};
   Bucket *parent_;
 
+  // Entries by state in the subtree, a leaf updates its own on every change
+  StateCounts counts_{};
+  size_t leaf_count_ = 1;
+  size_t non_full_leaf_count_ = 1;
+  // Leaves with at least one good node
+  size_t good_leaf_count_ = 0;
+  size_t max_prefix_length_ = 0;
+  size_t memory_size_ = sizeof(Bucket);
+
+  // When a node was added, removed or responded, of a leaf
+  common::CoarseClock::time_point changed_at_ = common::CoarseClock::now();
+  // Tick of the live refresh item of this leaf, older ones are skipped
+  RefreshWheel::Tick refresh_scheduled_ = 0;
+
   const RoutingTable *owner_;
+  EntryStore *store_;
+  RefreshWheel *refresh_wheel_;
   bool fat_mode_ = false;
 };
 
+class FlatTable;
 class RoutingTable {
  public:
+  // flat_mode selects the FlatTable backend, which only supports non fat routing tables.
+  // Tables given the same store share the entries and liveness of the nodes they have in common,
+  //   a table without one gets its own
   explicit RoutingTable(
       u160::U160 self_id, std::string name, std::string save_path, size_t max_bucket_size, size_t max_known_nodes,
-      bool delete_good, bool fat_mode, std::function<void(uint32_t, uint16_t)> black_list_node)
-      :root_(this, fat_mode),
-       self_id_(self_id),
-       save_path_(std::move(save_path)),
-       name_(std::move(name)),
-       max_bucket_size_(max_bucket_size),
-       delete_good_nodes_(delete_good),
-       fat_mode_(fat_mode),
-       max_known_nodes_(max_known_nodes),
-       black_list_node_(std::move(black_list_node)) { }
-
-      ~RoutingTable();
+      bool delete_good, bool fat_mode, bool flat_mode, std::function<void(uint32_t, uint16_t)> black_list_node,
+      std::shared_ptr<EntryStore> store = nullptr);
 
+  ~RoutingTable();
+
+  // Queries that depend on node states first count the state changes due now
   [[nodiscard]]
-  bool is_full() const;
+  bool is_full();
 
   [[nodiscard]]
-  size_t good_node_count() const;
+  size_t good_node_count();
 
   [[nodiscard]]
   size_t max_prefix_length() const;
@@ -224,12 +221,21 @@ class RoutingTable {
   bool empty() const { return known_node_count() == 0; }
 
   [[nodiscard]]
-  size_t bucket_count() const;
+  size_t bucket_count();
 
-  void stat() const;
+  void stat();
   // encode to json
   void encode(std::ostream &os);
 
+  // Binary snapshot of all nodes but bad ones, see snapshot.hpp
+  [[nodiscard]]
+  std::vector<uint8_t> snapshot() const;
+  // Bulk load the nodes of a snapshot, without the checks of add_node(). Throws snapshot::InvalidSnapshot
+  size_t load_snapshot(gsl::span<const uint8_t> data);
+  [[nodiscard]]
+  const std::string &save_path() const { return save_path_; }
+
+  // Legacy bencoded format of good nodes, only read to migrate old save files
   void serialize(std::ostream &os) const;
   static std::unique_ptr<RoutingTable> deserialize(
       std::istream &is,
@@ -239,9 +245,15 @@ class RoutingTable {
       size_t max_known_nodes,
       bool delete_good_nodes,
       bool fat_mode,
-      std::function<void(uint32_t, uint16_t)> black_list_node);
+      bool flat_mode,
+      std::function<void(uint32_t, uint16_t)> black_list_node,
+      std::shared_ptr<EntryStore> store = nullptr);
 
-  std::list<std::tuple<Entry, u160::U160>> select_expand_route_targets();
+  std::list<std::tuple<krpc::NodeInfo, u160::U160>> select_expand_route_targets();
+  // Buckets due for a BEP 5 refresh, with a node to send find_node for the target to
+  std::list<std::tuple<krpc::NodeInfo, u160::U160>> select_refresh_targets();
+  // Up to max questionable nodes to ping, marked as requiring a response
+  std::vector<krpc::NodeInfo> select_nodes_to_ping(size_t max);
 
   // This is the only function that insert a node into routing table
   bool add_node(Entry entry);
@@ -251,12 +263,25 @@ class RoutingTable {
   bool make_good_now(const u160::U160 &id);
   bool make_good_now(uint32_t ip, uint16_t port);
   void make_bad(uint32_t ip, uint16_t port);
+  // Whether a response was not required yet
   bool require_response_now(const u160::U160 &target);
+  // Count the node state changes that only come from time passing, as of common::CoarseClock::now()
+  void update_states();
 
   void iterate_nodes(const std::function<void (const Entry &)> &callback) const;
 
+  // The k good nodes closest to id by XOR distance, closest first, k is at most MaxClosestNodes
+  [[nodiscard]]
+  ClosestNodes k_nearest_good_nodes(const u160::U160 &id, size_t k) const;
+
+  // Replace the published snapshot with the current good nodes, if they changed since it was taken.
+  // Building one copies and sorts all good nodes, so it waits until the changes are at least
+  //   1/PublishChangeDivisor of the snapshot or PublishMaxAgeSeconds passed.
+  // Only the thread owning the table may call it
+  void publish();
+  // The last published snapshot, safe to call from any thread. It is never nullptr
   [[nodiscard]]
-  std::list<Entry> k_nearest_good_nodes(const u160::U160 &id, size_t k) const;
+  std::shared_ptr<const ReadSnapshot> published() const { return published_.load(std::memory_order_acquire); }
 
   [[nodiscard]]
   const std::string &name() const { return name_; }
@@ -265,6 +290,10 @@ class RoutingTable {
   [[nodiscard]]
   u160::U160 self() const { return self_id_; }
 
+  // The id of this table in its EntryStore
+  [[nodiscard]]
+  EntryStore::TableId table() const { return table_; }
+
   [[nodiscard]]
   size_t max_bucket_size() const { return max_bucket_size_; }
   [[nodiscard]]
@@ -272,10 +301,21 @@ class RoutingTable {
 
   void black_list_node(uint32_t ip, uint16_t port) const;
 
+  // Not counting the EntryStore if it is shared
   size_t memory_size() const;
 
  private:
+  EntryStore::Slot search(const u160::U160 &id) const;
+
+ private:
+  bool shared_store_;
+  // Entries and refresh deadlines of all buckets, must be constructed before them
+  std::shared_ptr<EntryStore> entries_;
+  EntryStore::TableId table_{};
+  RefreshWheel refresh_wheel_;
   Bucket root_;
+  // Used instead of root_ when not nullptr
+  std::unique_ptr<FlatTable> flat_;
   u160::U160 self_id_;
   std::string save_path_;
 
@@ -284,6 +324,14 @@ class RoutingTable {
   size_t total_good_node_deleted_{};
   size_t total_questionable_node_deleted_{};
 
+  // Ids of nodes that turned questionable, pinged a few at a time. Stale ids are skipped
+  std::deque<u160::U160> questionable_nodes_;
+
+  // Counts the changes of the good nodes, a snapshot with the same count is current
+  uint64_t version_ = 1;
+  common::CoarseClock::time_point published_at_{};
+  std::atomic<std::shared_ptr<const ReadSnapshot>> published_{std::make_shared<const ReadSnapshot>()};
+
   std::string name_;
   size_t max_bucket_size_ = BucketMaxGoodItems;
   bool delete_good_nodes_ = true;
@@ -292,8 +340,6 @@ class RoutingTable {
   size_t max_known_nodes_;
 
   std::function<void(uint32_t, uint16_t)> black_list_node_;
-
-  std::map<std::tuple<uint32_t, uint16_t>, u160::U160> reverse_map_;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,77 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gsl/span>
+
+#include <albert/u160/u160.hpp>
+
+namespace albert::dht::routing_table::snapshot {
+
+/**
+ * Binary routing table snapshot.
+ *
+ * A Header followed by Header::record_count fixed size Records, in host byte order,
+ *   so a memory mapped file is read in place without parsing.
+ * The checksum is the CRC32 of the header with a zero checksum, then of all records.
+ * Bump Version whenever Header or Record changes, older versions are rejected.
+ */
+constexpr uint32_t Version = 1;
+constexpr char Magic[8] = {'a', 'l', 'b', 'e', 'r', 't', 'r', 't'};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t record_count;
+  // Unix time in seconds when the snapshot was taken
+  int64_t saved_at;
+  uint8_t self_id[u160::U160Length];
+  uint32_t checksum;
+  uint8_t reserved[8];
+};
+static_assert(sizeof(Header) == 64);
+
+// Same values as EntryState
+enum class RecordState : uint8_t {
+  Good = 0,
+  Questionable = 1,
+  Bad = 2,
+};
+
+struct Record {
+  uint8_t id[u160::U160Length];
+  uint32_t ip;
+  uint16_t port;
+  RecordState state;
+  // Client version of the node, the "v" of its messages, at most 4 bytes
+  uint8_t version_length;
+  uint8_t version[4];
+  // Unix time in seconds
+  int64_t last_seen;
+};
+static_assert(sizeof(Record) == 40);
+
+class InvalidSnapshot :public std::runtime_error {
+ public:
+  using runtime_error::runtime_error;
+};
+
+// Whether data starts with the snapshot magic
+bool is_snapshot(gsl::span<const uint8_t> data);
+
+// The records of a snapshot after checking its header and checksum, throws InvalidSnapshot
+gsl::span<const Record> records(gsl::span<const uint8_t> data);
+
+// A snapshot of the records, as the bytes of the file
+std::vector<uint8_t> encode(const u160::U160 &self, const std::vector<Record> &records);
+
+// Write data to a temporary file and rename it to path, so path always holds a complete snapshot.
+// Throws std::runtime_error
+void write(const std::string &path, const std::vector<uint8_t> &data);
+
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <chrono>
+#include <string>
+
+#include <albert/common/coarse_clock.hpp>
+#include <albert/common/open_hash_map.hpp>
+
+namespace albert::dht {
+
+/**
+ * Round trip times of queries, per node and over all nodes, and the timeouts of queries derived from them.
+ *
+ * Estimates are the smoothed RTT and RTT variation of RFC 6298, a timeout is SRTT + 4 * RTTVAR.
+ *   A node that has not answered yet gets the timeout of all nodes. The timeout of a node doubles for each
+ *   of its queries in a row that timed out, and is clamped to [min_timeout, max_timeout].
+ * Samples of all nodes are also counted in a histogram of power of two milliseconds.
+ */
+class RttEstimator {
+ public:
+  using duration = std::chrono::microseconds;
+  using TimePoint = common::CoarseClock::time_point;
+  // [0, 1ms), [1ms, 2ms), [2ms, 4ms) ... [16384ms, inf)
+  static constexpr size_t HistogramBuckets = 16;
+
+  RttEstimator(duration initial_timeout, duration min_timeout, duration max_timeout);
+
+  void on_response(uint32_t ip, uint16_t port, duration rtt);
+  // Returns how many queries to the node timed out in a row, this one included
+  size_t on_timeout(uint32_t ip, uint16_t port);
+
+  // Of a query to the node
+  [[nodiscard]]
+  duration timeout(uint32_t ip, uint16_t port) const;
+  // Of a query to a node that has not answered yet
+  [[nodiscard]]
+  duration timeout() const;
+  [[nodiscard]]
+  duration srtt() const { return duration(global_.srtt); }
+  [[nodiscard]]
+  duration rttvar() const { return duration(global_.rttvar); }
+
+  [[nodiscard]]
+  const std::array<size_t, HistogramBuckets> &histogram() const { return histogram_; }
+  [[nodiscard]]
+  size_t samples() const { return samples_; }
+  [[nodiscard]]
+  size_t timeouts() const { return timeouts_; }
+  // "<1ms:n 1ms:n 2ms:n ...", the empty buckets after the last sample are left out
+  [[nodiscard]]
+  std::string histogram_string() const;
+
+  // Forget the nodes without a response or timeout since before
+  void gc(TimePoint before);
+  [[nodiscard]]
+  size_t size() const { return nodes_.size(); }
+  [[nodiscard]]
+  size_t memory_size() const;
+
+ private:
+  struct Estimate {
+    // Microseconds, 0 srtt for no sample
+    uint32_t srtt = 0;
+    uint32_t rttvar = 0;
+
+    void update(uint32_t rtt);
+    [[nodiscard]]
+    uint64_t timeout() const { return uint64_t(srtt) + 4 * uint64_t(rttvar); }
+  };
+  struct Node {
+    Estimate estimate;
+    // Whole seconds of the clock of the last response or timeout
+    uint32_t updated_at = 0;
+    uint8_t timeouts_in_row = 0;
+  };
+  static uint64_t endpoint_key(uint32_t ip, uint16_t port) { return (uint64_t(ip) << 16u) | port; }
+  [[nodiscard]]
+  duration clamp(uint64_t us, size_t backoff) const;
+
+ private:
+  duration initial_timeout_;
+  duration min_timeout_;
+  duration max_timeout_;
+
+  Estimate global_;
+  common::OpenHashMap<uint64_t, Node> nodes_;
+
+  std::array<size_t, HistogramBuckets> histogram_{};
+  size_t samples_ = 0;
+  size_t timeouts_ = 0;
+};
+
+}
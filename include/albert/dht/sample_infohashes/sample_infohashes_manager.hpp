@@ -2,10 +2,11 @@
 
 #include <memory>
 #include <set>
+#include <unordered_set>
 
 #include <boost/asio/steady_timer.hpp>
 
-#include <albert/krpc/krpc.hpp>
+#include <albert/krpc/wire.hpp>
 #include <albert/u160/u160.hpp>
 
 namespace boost::asio {
@@ -26,7 +27,7 @@ class SampleInfohashesManager {
  public:
   SampleInfohashesManager(boost::asio::io_service &io, DHT &dht,
                           DHTImpl &impl, std::function<void (const u160::U160 &)> handler);
-  void handle(const krpc::SampleInfohashesResponse &response);
+  void handle(const krpc::wire::SampleInfohashesResponse &response);
 
  private:
 
@@ -39,7 +40,7 @@ class SampleInfohashesManager {
   u160::U160 current_target_;
   dht::routing_table::RoutingTable *routing_table_;
   std::function<void (const u160::U160 &)> handler_;
-  std::set<u160::U160> traversed_;
+  std::unordered_set<u160::U160> traversed_;
 
   boost::asio::steady_timer action_timer_;
 };
@@ -1,52 +1,153 @@
 #pragma once
-#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <queue>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
-#include <functional>
-#include <mutex>
-#include <sstream>
-#include <exception>
-
-#include <albert/bencode/bencoding.hpp>
 
-namespace albert::krpc {
-class Query;
-}
+#include <albert/common/coarse_clock.hpp>
+#include <albert/u160/u160.hpp>
 
 namespace albert::dht {
 namespace routing_table {
 class RoutingTable;
 }
 
+// What is kept of a sent query until its response arrives
 struct Transaction {
-  std::string id_;
-  std::string method_name_;
-  std::shared_ptr<krpc::Query> query_node_;
-  routing_table::RoutingTable *routing_table_;
-  std::chrono::high_resolution_clock::time_point start_time_;
+  // One of the krpc::MethodName constants
+  const char *method_name_ = nullptr;
+  // The target of find_node and sample_infohashes, the info hash of get_peers, zero for the others
+  u160::U160 target_{};
+  routing_table::RoutingTable *routing_table_ = nullptr;
+  // The node the query is sent to
+  uint32_t ip_ = 0;
+  uint16_t port_ = 0;
+  common::CoarseClock::time_point start_time_{};
+  // The transaction times out if there is no response by then
+  common::CoarseClock::time_point deadline_{};
+  // Set when the deadline passed, the transaction is kept for a late response until it expires
+  bool timed_out_ = false;
 };
 
-class TransactionError : std::runtime_error {
+class TransactionError :public std::runtime_error {
  public:
   explicit TransactionError(const std::string& s) :runtime_error(s) { }
 };
 
+/**
+ * Outstanding queries, in a slot array.
+ *
+ * A transaction id encodes the slot and a generation of the slot in 2 to 4 bytes, so ending a transaction is
+ *   an index and a compare, without hashing. The generation changes each time a slot is freed,
+ *   so a late response to an expired transaction does not end the one that reuses its slot.
+ * Slots are reused oldest freed first, to make that even less likely.
+ * Each transaction has its own timeout, expire() reports the ones past their deadline in deadline order.
+ *   A timed out transaction keeps its slot until expiration_time after its start, a late response still ends it.
+ * Only the thread of the DHT may use it.
+ */
 class TransactionManager {
  public:
+  // No transaction lasts longer than expiration_time, whatever its timeout
   explicit TransactionManager(std::chrono::milliseconds expiration_time) :expiration_time_(expiration_time) { }
-  void start(const std::function<void (Transaction &transaction)> &callback);
-  void end(const std::string& id, const std::function<void (const Transaction &transaction)> &callback);
-  bool has_transaction(const std::string &id) const;
 
-  void gc();
+  // Start a transaction that times out after timeout, returns its id.
+  // Throws TransactionError if there are MaxSlots transactions
+  std::string start(const Transaction &transaction, std::chrono::microseconds timeout);
+  // Call callback with the transaction and end it, throws TransactionError if there is no transaction with the id
+  template <typename F>
+  void end(std::string_view id, F &&callback);
+  [[nodiscard]]
+  bool has_transaction(std::string_view id) const { return find(id) != npos; }
+
+  // Call on_timeout with each transaction past its deadline at now, returns how many timed out.
+  // Ends the transactions past their expiration time
+  template <typename F>
+  size_t expire(common::CoarseClock::time_point now, F &&on_timeout);
+  [[nodiscard]]
   size_t memory_size() const;
-  size_t size() const { return transactions_.size(); }
+  // Transactions waiting for a response, the timed out ones included
+  [[nodiscard]]
+  size_t size() const { return size_; }
+
+ private:
+  using Slot = uint32_t;
+  static constexpr Slot npos = ~Slot(0);
+  static constexpr size_t GenerationBits = 8;
+  static constexpr size_t MaxSlots = size_t(1) << 24;
+
+  // Slot of the transaction with this id, npos if it has ended or the id is not one of ours
+  [[nodiscard]]
+  Slot find(std::string_view id) const;
+  void free(Slot slot);
+
  private:
-  std::map<std::string, Transaction> transactions_;
-  uint64_t transaction_counter_ = 0;
-  std::mutex lock_;
+  struct Record {
+    Transaction transaction;
+    uint8_t generation = 0;
+    bool active = false;
+  };
+  std::vector<Record> records_;
+  std::deque<Slot> free_slots_;
+  // Earliest deadline first. Items of ended transactions are skipped
+  struct Deadline {
+    common::CoarseClock::time_point at;
+    Slot slot;
+    uint8_t generation;
+
+    bool operator>(const Deadline &rhs) const { return at > rhs.at; }
+  };
+  std::priority_queue<Deadline, std::vector<Deadline>, std::greater<>> deadlines_;
+  size_t size_ = 0;
 
   std::chrono::milliseconds expiration_time_;
 };
 
-}
\ No newline at end of file
+template <typename F>
+void TransactionManager::end(std::string_view id, F &&callback) {
+  auto slot = find(id);
+  if (slot == npos) {
+    throw TransactionError("Transaction not found");
+  }
+  callback(std::as_const(records_[slot].transaction));
+  free(slot);
+}
+
+template <typename F>
+size_t TransactionManager::expire(common::CoarseClock::time_point now, F &&on_timeout) {
+  size_t ret = 0;
+  while (!deadlines_.empty() && deadlines_.top().at <= now) {
+    auto [at, slot, generation] = deadlines_.top();
+    deadlines_.pop();
+    auto &record = records_[slot];
+    if (!record.active || record.generation != generation) {
+      continue;
+    }
+    if (record.transaction.timed_out_) {
+      free(slot);
+      continue;
+    }
+    record.transaction.timed_out_ = true;
+    auto expiration = record.transaction.start_time_ + expiration_time_;
+    if (expiration > at) {
+      deadlines_.push({expiration, slot, generation});
+    }
+    // Copied, on_timeout may start transactions that grow records_
+    auto transaction = record.transaction;
+    if (expiration <= at) {
+      free(slot);
+    }
+    on_timeout(std::as_const(transaction));
+    ret++;
+  }
+  return ret;
+}
+
+}
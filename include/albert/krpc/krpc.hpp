@@ -9,12 +9,26 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <tuple>
 #include <utility>
 #include <vector>
 
 #include <albert/bencode/bencoding.hpp>
+#include <albert/bencode/schema.hpp>
+#include <albert/bencode/writer.hpp>
 #include <albert/u160/u160.hpp>
 
+namespace albert::bencoding::schema {
+
+// Node ids and info hashes are 20 bytes strings
+template <>
+struct Codec<u160::U160> {
+  static void decode(Parser &parser, Token token, u160::U160 &out);
+  static void encode(Writer &w, const u160::U160 &in);
+};
+
+}
+
 namespace albert::krpc {
 constexpr const char *ClientVersion = "WTF0.0";
 
@@ -30,8 +44,13 @@ class NodeInfo {
   NodeInfo() { }
   NodeInfo(u160::U160 node_id, uint32_t ip, uint32_t port)
       :node_id_(node_id), ip_(ip), port_(port) { }
+  // Size of the compact node info, node id followed by ip and port in network byte order
+  static constexpr size_t CompactSize = u160::U160Length + sizeof(uint32_t) + sizeof(uint16_t);
   static NodeInfo decode(std::istream &is);
   void encode(std::ostream &os) const;
+  // Write/read exactly CompactSize bytes
+  void encode(uint8_t *out) const;
+  static NodeInfo decode(const uint8_t *in);
   std::string to_string() const;
   u160::U160 id() const { return node_id_; }
   uint32_t ip() const { return ip_; }
@@ -64,6 +83,26 @@ constexpr int ErrorServerError = 202;
 constexpr int ErrorProtocolError = 203;
 constexpr int ErrorMethodUnknown = 204;
 
+// Schema codec for a vector written as one string of fixed size items, like "nodes" and "samples"
+template <typename T, size_t ItemSize>
+struct CompactCodec {
+  static void encode(bencoding::Writer &w, const std::vector<T> &in) {
+    w.string_header(in.size() * ItemSize);
+    for (auto &item : in) {
+      item.encode(w.reserve(ItemSize));
+    }
+  }
+};
+// Schema codec for the "values" list of a get_peers response, one compact peer string per item
+struct CompactPeersCodec {
+  static void encode(bencoding::Writer &w, const std::vector<std::tuple<uint32_t, uint16_t>> &in);
+};
+
+// Transaction ids of our own queries are never longer than this
+constexpr size_t MaxQueryTransactionIdLength = 16;
+// Every query we send fits in a buffer of this size, checked at compile time in krpc.cpp
+constexpr size_t MaxQuerySize = 256;
+
 class Message {
  public:
   Message(std::string type)
@@ -75,11 +114,8 @@ class Message {
 
   virtual ~Message() = default;
 
-  static std::shared_ptr<Message> decode(
-      const bencoding::Node &node,
-      const std::function<std::string (std::string)>& get_method_name
-      );
-  void build_bencoding_node(std::map<std::string, std::shared_ptr<bencoding::Node>> &dict) const;
+  // Write the "t", "v" and "y" entries, they are the last keys of every message
+  void write_common(bencoding::Writer &w) const;
 
   void set_transaction_id(std::string transaction_id) { this->transaction_id_ = std::move(transaction_id); }
   std::string transaction_id() const { return this->transaction_id_; }
@@ -102,11 +138,6 @@ class Error :public Message {
     return message_;
   }
 
-  static std::shared_ptr<Message> decode(
-      const std::map<std::string, std::shared_ptr<bencoding::Node>> &dict,
-      const std::string &t,
-      const std::string &v,
-      const std::string &method_name);
  private:
   int error_code_;
   std::string message_;
@@ -122,13 +153,13 @@ class Query :public Message {
   Query(std::string transaction_id, std::string client_version, std::string method_name)
       :Message(std::move(transaction_id), MessageTypeQuery, std::move(client_version)), method_name_(std::move(method_name)) { }
 
-  void encode(std::ostream &os, bencoding::EncodeMode mode);
-  static std::shared_ptr<Message> decode(const std::map<std::string, std::shared_ptr<bencoding::Node>> &, const std::string& t, const std::string& v);
+  void encode(bencoding::Writer &w) const;
 
   std::string method_name() const { return method_name_; }
 
  protected:
-  virtual std::shared_ptr<bencoding::Node> get_arguments_node() const = 0;
+  // Write the "a" dict
+  virtual void write_arguments(bencoding::Writer &w) const = 0;
  private:
   std::string method_name_;
 };
@@ -141,9 +172,14 @@ class PingQuery :public Query {
       : Query(MethodNamePing), sender_id_(sender_id) { }
   u160::U160 sender_id() const { return sender_id_; }
 
+  static constexpr auto bencoding_fields() {
+    using namespace bencoding::schema;
+    return std::make_tuple(
+        required("id", &PingQuery::sender_id_));
+  }
+
  protected:
-  [[nodiscard]]
-  std::shared_ptr<bencoding::Node> get_arguments_node() const override;
+  void write_arguments(bencoding::Writer &w) const override;
 
  private:
   u160::U160 sender_id_;
@@ -160,7 +196,14 @@ class FindNodeQuery :public Query {
   const u160::U160 &sender_id() const { return sender_id_; }
   const u160::U160 &target_id() const { return target_id_; }
 
-  std::shared_ptr<bencoding::Node> get_arguments_node() const override;
+  static constexpr auto bencoding_fields() {
+    using namespace bencoding::schema;
+    return std::make_tuple(
+        required("id", &FindNodeQuery::sender_id_),
+        required("target", &FindNodeQuery::target_id_));
+  }
+
+  void write_arguments(bencoding::Writer &w) const override;
 
  protected:
  private:
@@ -179,7 +222,14 @@ class SampleInfohashesQuery :public Query {
   const u160::U160 &sender_id() const { return sender_id_; }
   const u160::U160 &target_id() const { return target_id_; }
 
-  std::shared_ptr<bencoding::Node> get_arguments_node() const override;
+  static constexpr auto bencoding_fields() {
+    using namespace bencoding::schema;
+    return std::make_tuple(
+        required("id", &SampleInfohashesQuery::sender_id_),
+        required("target", &SampleInfohashesQuery::target_id_));
+  }
+
+  void write_arguments(bencoding::Writer &w) const override;
 
  protected:
  private:
@@ -198,8 +248,15 @@ class GetPeersQuery :public Query {
   const u160::U160 &sender_id() const { return sender_id_; }
   const u160::U160 &info_hash() const { return info_hash_; }
 
+  static constexpr auto bencoding_fields() {
+    using namespace bencoding::schema;
+    return std::make_tuple(
+        required("id", &GetPeersQuery::sender_id_),
+        required("info_hash", &GetPeersQuery::info_hash_));
+  }
+
  protected:
-  std::shared_ptr<bencoding::Node> get_arguments_node() const override;
+  void write_arguments(bencoding::Writer &w) const override;
  private:
   u160::U160 sender_id_;
   u160::U160 info_hash_;
@@ -225,8 +282,18 @@ class AnnouncePeerQuery :public Query {
   const u160::U160 &sender_id() const { return sender_id_; }
   const u160::U160 &info_hash() const { return info_hash_; }
 
+  static constexpr auto bencoding_fields() {
+    using namespace bencoding::schema;
+    return std::make_tuple(
+        required("id", &AnnouncePeerQuery::sender_id_),
+        required("implied_port", &AnnouncePeerQuery::implied_port_),
+        required("info_hash", &AnnouncePeerQuery::info_hash_),
+        required("port", &AnnouncePeerQuery::port_),
+        required("token", &AnnouncePeerQuery::token_));
+  }
+
  protected:
-  std::shared_ptr<bencoding::Node> get_arguments_node() const override;
+  void write_arguments(bencoding::Writer &w) const override;
 
  private:
   u160::U160 sender_id_;
@@ -243,11 +310,11 @@ class Response :public Message {
   Response(std::string transaction_id, std::string client_version)
       :Message(std::move(transaction_id), MessageTypeResponse, std::move(client_version)) { }
 
-  void encode(std::ostream &os, bencoding::EncodeMode mode) const ;
-  static std::shared_ptr<Message> decode(const std::map<std::string, std::shared_ptr<bencoding::Node>> &, const std::string &t, const std::string &v, const std::string &method_name);
+  void encode(bencoding::Writer &w) const;
 
  protected:
-  virtual std::shared_ptr<bencoding::Node> get_response_node() const = 0;
+  // Write the "r" dict
+  virtual void write_response(bencoding::Writer &w) const = 0;
 };
 
 class PingResponse :public Response {
@@ -257,8 +324,14 @@ class PingResponse :public Response {
   PingResponse(std::string transaction_id, u160::U160 node_id)
       :Response(std::move(transaction_id)), node_id_(node_id) { }
   u160::U160 node_id() const { return node_id_; }
+  static constexpr auto bencoding_fields() {
+    using namespace bencoding::schema;
+    return std::make_tuple(
+        required("id", &PingResponse::node_id_));
+  }
+
  protected:
-  std::shared_ptr<bencoding::Node> get_response_node() const override;
+  void write_response(bencoding::Writer &w) const override;
  private:
   u160::U160 node_id_;
 };
@@ -279,8 +352,15 @@ class FindNodeResponse :public Response {
   void print_nodes();
   const std::vector<NodeInfo> &nodes() const { return nodes_; }
   const u160::U160 &sender_id() const { return node_id_; }
+  static constexpr auto bencoding_fields() {
+    using namespace bencoding::schema;
+    return std::make_tuple(
+        required("id", &FindNodeResponse::node_id_),
+        required<CompactCodec<NodeInfo, NodeInfo::CompactSize>>("nodes", &FindNodeResponse::nodes_));
+  }
+
  protected:
-  std::shared_ptr<bencoding::Node> get_response_node() const override;
+  void write_response(bencoding::Writer &w) const override;
  private:
   u160::U160 node_id_;
   std::vector<NodeInfo> nodes_;
@@ -317,8 +397,17 @@ class GetPeersResponse :public Response {
   bool has_nodes() const { return nodes_.size() > 0; }
   std::vector<NodeInfo> nodes() const { return nodes_; };
   std::vector<std::tuple<uint32_t, uint16_t>> peers() const { return peers_; };
+  static constexpr auto bencoding_fields() {
+    using namespace bencoding::schema;
+    return std::make_tuple(
+        required("id", &GetPeersResponse::sender_id_),
+        required<CompactCodec<NodeInfo, NodeInfo::CompactSize>>("nodes", &GetPeersResponse::nodes_),
+        required("token", &GetPeersResponse::token_),
+        optional<CompactPeersCodec>("values", &GetPeersResponse::peers_));
+  }
+
  protected:
-  std::shared_ptr<bencoding::Node> get_response_node() const override;
+  void write_response(bencoding::Writer &w) const override;
  private:
   u160::U160 sender_id_;
   std::string token_;
@@ -333,8 +422,14 @@ class AnnouncePeerResponse :public Response {
       u160::U160 sender_id)
       : Response(std::move(transaction_id)), node_id_(sender_id) { }
   const u160::U160 &sender_id() const { return node_id_; }
+  static constexpr auto bencoding_fields() {
+    using namespace bencoding::schema;
+    return std::make_tuple(
+        required("id", &AnnouncePeerResponse::node_id_));
+  }
+
  protected:
-  std::shared_ptr<bencoding::Node> get_response_node() const override;
+  void write_response(bencoding::Writer &w) const override;
  private:
   u160::U160 node_id_;
 };
@@ -355,8 +450,17 @@ class SampleInfohashesResponse :public Response {
       samples_(std::move(samples)) { }
   const std::vector<u160::U160> &samples() const { return samples_; }
   const u160::U160 sender_id() const { return node_id_; }
+  static constexpr auto bencoding_fields() {
+    using namespace bencoding::schema;
+    return std::make_tuple(
+        required("id", &SampleInfohashesResponse::node_id_),
+        required("interval", &SampleInfohashesResponse::interval_),
+        required("num", &SampleInfohashesResponse::num_),
+        required<CompactCodec<u160::U160, u160::U160Length>>("samples", &SampleInfohashesResponse::samples_));
+  }
+
  protected:
-  std::shared_ptr<bencoding::Node> get_response_node() const override { return nullptr; }
+  void write_response(bencoding::Writer &w) const override;
  private:
   u160::U160 node_id_;
   int64_t interval_{};
@@ -0,0 +1,325 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include <iterator>
+#include <string_view>
+#include <tuple>
+#include <variant>
+
+#include <gsl/span>
+
+#include <albert/bencode/parser.hpp>
+#include <albert/bencode/schema.hpp>
+#include <albert/krpc/krpc.hpp>
+#include <albert/u160/u160.hpp>
+
+/**
+ * Typed KRPC wire codec.
+ *
+ * A datagram is read once by scan() into an Envelope, decode() then turns it into one of the value types below.
+ * Strings and compact lists are views into the datagram, so a decoded message must not outlive the receive buffer.
+ * Errors are reported as krpc::InvalidMessage.
+ */
+namespace albert::krpc::wire {
+
+// Read only view over a compact list of fixed size items, T must have a static T decode(const uint8_t *)
+template <typename T, size_t ItemSize>
+class CompactList {
+ public:
+  class iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = T;
+
+    explicit iterator(const uint8_t *p) :p_(p) { }
+    T operator*() const { return T::decode(p_); }
+    iterator &operator++() { p_ += ItemSize; return *this; }
+    bool operator==(const iterator &rhs) const { return p_ == rhs.p_; }
+    bool operator!=(const iterator &rhs) const { return p_ != rhs.p_; }
+   private:
+    const uint8_t *p_;
+  };
+
+  CompactList() = default;
+  // Trailing bytes that do not make up a whole item are ignored
+  explicit CompactList(std::string_view data)
+      :data_(reinterpret_cast<const uint8_t*>(data.data())), size_(data.size() / ItemSize) { }
+
+  [[nodiscard]]
+  size_t size() const { return size_; }
+  [[nodiscard]]
+  bool empty() const { return size_ == 0; }
+  T operator[](size_t i) const { return T::decode(data_ + i * ItemSize); }
+  iterator begin() const { return iterator(data_); }
+  iterator end() const { return iterator(data_ + size_ * ItemSize); }
+
+ private:
+  const uint8_t *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+typedef CompactList<NodeInfo, NodeInfo::CompactSize> CompactNodes;
+typedef CompactList<u160::U160, u160::U160Length> CompactIds;
+
+// Compact peer size, ip and port in network byte order
+constexpr size_t CompactPeerSize = sizeof(uint32_t) + sizeof(uint16_t);
+
+// View over the "values" list of a get_peers response, items that are not compact peers are skipped
+class PeerList {
+ public:
+  class iterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = std::tuple<uint32_t, uint16_t>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = value_type;
+
+    explicit iterator(gsl::span<const uint8_t> data);
+    value_type operator*() const { return peer_; }
+    iterator &operator++();
+    bool operator==(const iterator &rhs) const { return end_ == rhs.end_; }
+    bool operator!=(const iterator &rhs) const { return end_ != rhs.end_; }
+   private:
+    bencoding::Parser parser_;
+    value_type peer_;
+    bool end_ = false;
+  };
+
+  PeerList() = default;
+  // data is the encoded list, count is the number of compact peers in it
+  PeerList(gsl::span<const uint8_t> data, size_t count) :data_(data), count_(count) { }
+
+  [[nodiscard]]
+  size_t size() const { return count_; }
+  [[nodiscard]]
+  bool empty() const { return count_ == 0; }
+  iterator begin() const { return iterator(data_); }
+  iterator end() const { return iterator({}); }
+
+ private:
+  gsl::span<const uint8_t> data_;
+  size_t count_ = 0;
+};
+
+struct PingQuery {
+  std::string_view transaction_id;
+  std::string_view version;
+  u160::U160 sender_id;
+};
+
+struct FindNodeQuery {
+  std::string_view transaction_id;
+  std::string_view version;
+  u160::U160 sender_id;
+  u160::U160 target_id;
+};
+
+struct GetPeersQuery {
+  std::string_view transaction_id;
+  std::string_view version;
+  u160::U160 sender_id;
+  u160::U160 info_hash;
+};
+
+struct AnnouncePeerQuery {
+  std::string_view transaction_id;
+  std::string_view version;
+  u160::U160 sender_id;
+  bool implied_port;
+  u160::U160 info_hash;
+  uint16_t port;
+  std::string_view token;
+};
+
+struct PingResponse {
+  std::string_view transaction_id;
+  std::string_view version;
+  u160::U160 sender_id;
+};
+
+struct FindNodeResponse {
+  std::string_view transaction_id;
+  std::string_view version;
+  u160::U160 sender_id;
+  CompactNodes nodes;
+};
+
+struct GetPeersResponse {
+  std::string_view transaction_id;
+  std::string_view version;
+  u160::U160 sender_id;
+  std::string_view token;
+  CompactNodes nodes;
+  PeerList peers;
+};
+
+struct AnnouncePeerResponse {
+  std::string_view transaction_id;
+  std::string_view version;
+  u160::U160 sender_id;
+};
+
+struct SampleInfohashesResponse {
+  std::string_view transaction_id;
+  std::string_view version;
+  u160::U160 sender_id;
+  int64_t interval;
+  size_t num;
+  CompactIds samples;
+};
+
+struct Error {
+  std::string_view transaction_id;
+  std::string_view version;
+  int64_t code;
+  std::string_view message;
+};
+
+typedef std::variant<
+    PingQuery,
+    FindNodeQuery,
+    GetPeersQuery,
+    AnnouncePeerQuery,
+    PingResponse,
+    FindNodeResponse,
+    GetPeersResponse,
+    AnnouncePeerResponse,
+    SampleInfohashesResponse,
+    Error> Message;
+
+// Every key of "a" and "r" that any message understands, collected in one pass
+struct Fields {
+  // Bits of the present mask, in key order, see bencoding::schema::field_bit
+  enum : uint64_t {
+    Id = 1u << 0,
+    ImpliedPort = 1u << 1,
+    InfoHash = 1u << 2,
+    Interval = 1u << 3,
+    Nodes = 1u << 4,
+    Num = 1u << 5,
+    Port = 1u << 6,
+    Samples = 1u << 7,
+    Target = 1u << 8,
+    Token = 1u << 9,
+    Values = 1u << 10,
+  };
+  // Set by the Codec<Fields> specialization below
+  uint64_t present = 0;
+
+  u160::U160 id;
+  int64_t implied_port = 0;
+  u160::U160 info_hash;
+  int64_t interval = 0;
+  CompactNodes nodes;
+  int64_t num = 0;
+  int64_t port = 0;
+  CompactIds samples;
+  u160::U160 target;
+  std::string_view token;
+  PeerList values;
+
+  [[nodiscard]]
+  bool has(uint64_t field) const { return (present & field) != 0; }
+
+  static constexpr auto bencoding_fields() {
+    using namespace bencoding::schema;
+    return std::make_tuple(
+        optional("id", &Fields::id),
+        optional("implied_port", &Fields::implied_port),
+        optional("info_hash", &Fields::info_hash),
+        optional("interval", &Fields::interval),
+        optional("nodes", &Fields::nodes),
+        optional("num", &Fields::num),
+        optional("port", &Fields::port),
+        optional("samples", &Fields::samples),
+        optional("target", &Fields::target),
+        optional("token", &Fields::token),
+        optional("values", &Fields::values));
+  }
+};
+
+// The "e" list of an error message
+struct ErrorBody {
+  int64_t code = 0;
+  std::string_view message;
+};
+
+// Result of the single pass over a datagram
+struct Envelope {
+  uint64_t present = 0;
+
+  // Contents of "a" for queries and "r" for responses
+  Fields fields;
+  ErrorBody error;
+  std::string_view method_name;
+  std::string_view transaction_id;
+  std::string_view version;
+  std::string_view type;
+
+  [[nodiscard]]
+  bool has_body() const;
+  [[nodiscard]]
+  bool has_error() const;
+  [[nodiscard]]
+  bool is_query() const { return type == MessageTypeQuery; }
+  // Responses and errors belong to one of our transactions
+  [[nodiscard]]
+  bool is_reply() const { return type == MessageTypeResponse || type == MessageTypeError; }
+
+  static constexpr auto bencoding_fields() {
+    using namespace bencoding::schema;
+    return std::make_tuple(
+        optional("a", &Envelope::fields),
+        optional("e", &Envelope::error),
+        optional("q", &Envelope::method_name),
+        optional("r", &Envelope::fields),
+        required("t", &Envelope::transaction_id),
+        optional("v", &Envelope::version),
+        required("y", &Envelope::type));
+  }
+};
+
+// Throws InvalidMessage if the datagram is not a KRPC message and bencoding::ParseError if it is not bencoded
+Envelope scan(gsl::span<const uint8_t> datagram);
+
+// method_name is the method of the query a response or an error replies to, it is ignored for queries
+Message decode(const Envelope &envelope, std::string_view method_name);
+
+}
+
+namespace albert::bencoding::schema {
+
+template <typename T, size_t ItemSize>
+struct Codec<krpc::wire::CompactList<T, ItemSize>> {
+  static void decode(Parser &parser, Token token, krpc::wire::CompactList<T, ItemSize> &out) {
+    if (token != Token::String) {
+      throw SchemaError("expected a string");
+    }
+    out = krpc::wire::CompactList<T, ItemSize>(parser.string());
+  }
+};
+
+// Like any schema struct, and keeps the mask of the fields present
+template <>
+struct Codec<krpc::wire::Fields> {
+  static void decode(Parser &parser, Token token, krpc::wire::Fields &out) {
+    out.present = schema::decode(parser, token, out);
+  }
+};
+
+template <>
+struct Codec<krpc::wire::PeerList> {
+  static void decode(Parser &parser, Token token, krpc::wire::PeerList &out);
+};
+
+template <>
+struct Codec<krpc::wire::ErrorBody> {
+  static void decode(Parser &parser, Token token, krpc::wire::ErrorBody &out);
+};
+
+}
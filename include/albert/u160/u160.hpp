@@ -3,7 +3,10 @@
 #include <cstddef>
 #include <cstdint>
 
+#include <algorithm>
 #include <array>
+#include <bit>
+#include <functional>
 #include <string>
 #include <iostream>
 
@@ -18,41 +21,143 @@ class InvalidFormat :public std::runtime_error {
 
 constexpr size_t U160Length = 20;
 constexpr size_t U160Bits = U160Length * 8;
+
+/**
+ * 160 bits unsigned integer, e.g. a node id or an info hash.
+ *
+ * Stored as three 64 bits words in big endian logical order: words_[0] holds the most significant bits,
+ *   the last word holds the 32 least significant bits in its upper half and zeros below.
+ * Bit r counts from the least significant bit, r = 159 is the first bit on the wire.
+ */
 class U160 {
  public:
-  U160() {
-    data_.fill(0);
-  }
+  static constexpr size_t Words = 3;
 
-  static U160 pow2(size_t r);
-  static U160 pow2m1(size_t r);
+  constexpr U160() = default;
+
+  static constexpr U160 pow2(size_t r);
+  static constexpr U160 pow2m1(size_t r);
   static U160 from_string(std::string s);
   static U160 from_hex(const std::string &s);
   void encode(std::ostream &os) const;
   static U160 decode(std::istream &is);
+  // Write/read exactly U160Length bytes
+  constexpr void encode(uint8_t *out) const;
+  static constexpr U160 decode(const uint8_t *in);
   static U160 random();
+  // Random value whose prefix_length most significant bits are the ones of prefix
   static U160 random_from_prefix(const U160 &prefix, size_t prefix_length);
-  static size_t common_prefix_length(const U160 &lhs, const U160 &rhs);
+  static constexpr size_t common_prefix_length(const U160 &lhs, const U160 &rhs);
   static U160 hash(const uint8_t *data, size_t size);
 
   std::string to_string() const;
 
-  bool operator<(const U160 &rhs) const;
-  bool operator==(const U160 &rhs) const;
-  bool operator!=(const U160 &rhs) const;
-  bool operator<=(const U160 &rhs) const;
-  U160 operator&(const U160 &rhs) const;
-  U160 operator|(const U160 &rhs) const;
-  U160 operator^(const U160 &rhs) const;
-  uint8_t bit(size_t r) const;
-  U160 distance(const U160 &rhs) const { return *this ^ rhs; }
-
-  U160 fake(const U160 &target, size_t prefix_length = 128) const;
+  constexpr bool operator<(const U160 &rhs) const {
+    // The first differing word decides
+    size_t i = words_[0] != rhs.words_[0] ? 0 : (words_[1] != rhs.words_[1] ? 1 : 2);
+    return words_[i] < rhs.words_[i];
+  }
+  constexpr bool operator==(const U160 &rhs) const {
+    return ((words_[0] ^ rhs.words_[0]) | (words_[1] ^ rhs.words_[1]) | (words_[2] ^ rhs.words_[2])) == 0;
+  }
+  constexpr bool operator!=(const U160 &rhs) const { return !(*this == rhs); }
+  constexpr bool operator<=(const U160 &rhs) const { return !(rhs < *this); }
+  constexpr U160 operator&(const U160 &rhs) const {
+    return U160(words_[0] & rhs.words_[0], words_[1] & rhs.words_[1], words_[2] & rhs.words_[2]);
+  }
+  constexpr U160 operator|(const U160 &rhs) const {
+    return U160(words_[0] | rhs.words_[0], words_[1] | rhs.words_[1], words_[2] | rhs.words_[2]);
+  }
+  constexpr U160 operator^(const U160 &rhs) const {
+    return U160(words_[0] ^ rhs.words_[0], words_[1] ^ rhs.words_[1], words_[2] ^ rhs.words_[2]);
+  }
+  constexpr U160 operator~() const {
+    return U160(~words_[0], ~words_[1], ~words_[2] & LastWordMask);
+  }
+  constexpr uint8_t bit(size_t r) const {
+    size_t p = U160Bits - 1 - r;
+    return (words_[p / 64] >> (63 - p % 64)) & 1u;
+  }
+  constexpr U160 distance(const U160 &rhs) const { return *this ^ rhs; }
+  // Word i in big endian logical order, see the class comment
+  [[nodiscard]]
+  constexpr uint64_t word(size_t i) const { return words_[i]; }
+
+  // The prefix_length least significant bits of this and the rest of target
+  constexpr U160 fake(const U160 &target, size_t prefix_length = 128) const;
+
+  // Value with the n most significant bits set
+  static constexpr U160 high_mask(size_t n);
+
  private:
-  void bit(size_t r, size_t value);
+  static constexpr uint64_t LastWordMask = 0xffffffff00000000ull;
+
+  constexpr U160(uint64_t w0, uint64_t w1, uint64_t w2) :words_{w0, w1, w2} { }
 
  private:
-  // network byte order
-  std::array<uint8_t, U160Length> data_{};
+  std::array<uint64_t, Words> words_{};
+};
+
+constexpr U160 U160::high_mask(size_t n) {
+  U160 ret;
+  n = std::min(n, U160Bits);
+  for (size_t i = 0; i < Words; i++) {
+    size_t k = n > 64 * i ? std::min<size_t>(n - 64 * i, 64) : 0;
+    ret.words_[i] = k == 0 ? 0 : ~uint64_t(0) << (64 - k);
+  }
+  ret.words_[Words - 1] &= LastWordMask;
+  return ret;
+}
+
+constexpr U160 U160::pow2(size_t r) {
+  size_t p = U160Bits - 1 - r;
+  U160 ret;
+  ret.words_[p / 64] = uint64_t(1) << (63 - p % 64);
+  return ret;
+}
+
+constexpr U160 U160::pow2m1(size_t r) {
+  return ~high_mask(U160Bits - r);
+}
+
+constexpr void U160::encode(uint8_t *out) const {
+  for (size_t i = 0; i < U160Length; i++) {
+    out[i] = static_cast<uint8_t>(words_[i / 8] >> (56 - 8 * (i % 8)));
+  }
+}
+
+constexpr U160 U160::decode(const uint8_t *in) {
+  U160 ret;
+  for (size_t i = 0; i < U160Length; i++) {
+    ret.words_[i / 8] |= uint64_t(in[i]) << (56 - 8 * (i % 8));
+  }
+  return ret;
+}
+
+constexpr size_t U160::common_prefix_length(const U160 &lhs, const U160 &rhs) {
+  for (size_t i = 0; i < Words; i++) {
+    auto x = lhs.words_[i] ^ rhs.words_[i];
+    if (x != 0) {
+      return 64 * i + std::countl_zero(x);
+    }
+  }
+  return U160Bits;
+}
+
+constexpr U160 U160::fake(const U160 &target, size_t prefix_length) const {
+  auto mask = high_mask(U160Bits - std::min(prefix_length, U160Bits));
+  return (*this & ~mask) | (target & mask);
+}
+
+}
+
+template <>
+struct std::hash<albert::u160::U160> {
+  size_t operator()(const albert::u160::U160 &id) const noexcept {
+    // Ids are random or SHA1 output, every word is mixed in so ids that share a long prefix still spread
+    uint64_t h = id.word(0) * 0x9e3779b97f4a7c15ull;
+    h ^= id.word(1) * 0xc2b2ae3d27d4eb4full;
+    h ^= id.word(2) * 0x165667b19e3779f9ull;
+    return h ^ (h >> 29);
+  }
 };
-}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <string>
+
+#include <gsl/span>
+
+namespace albert::utils {
+
+/**
+ * Read only memory mapping of a whole file, pages are loaded by the kernel as they are touched.
+ */
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string &path);
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  [[nodiscard]]
+  gsl::span<const uint8_t> data() const { return {data_, size_}; }
+  [[nodiscard]]
+  size_t size() const { return size_; }
+
+ private:
+  const uint8_t *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+}
@@ -1,6 +1,102 @@
-#include <albert/bencode/bencoding.hpp>
+#include <cstdio>
+#include <cstring>
 
-int main() {
-  albert::bencoding::Node::decode(std::cin)->encode(std::cout, albert::bencoding::EncodeMode::JSON, 0);
+#include <array>
+#include <iostream>
+#include <string>
+
+#include <albert/bencode/visitor.hpp>
+#include <albert/utils/mapped_file.hpp>
+
+using namespace albert;
+
+void usage() {
+  std::cerr << "Usage: b2j [--ndjson] [--binary=escape|hex|base64] [file]" << std::endl
+            << "  Convert bencoding to JSON, reads stdin if no file is given" << std::endl
+            << "  --ndjson  convert every concatenated value, one compact JSON value per line" << std::endl
+            << "  --binary  how strings that are not UTF-8 text are written, escape by default" << std::endl;
+}
+
+// Feed input to the decoder, with ndjson every value in the input is decoded, otherwise only the first one
+class Converter {
+ public:
+  Converter(bencoding::Visitor &visitor, bool ndjson) :decoder_(visitor), ndjson_(ndjson) { }
+
+  // Returns false once no more input is wanted
+  bool feed(gsl::span<const uint8_t> data) {
+    while (!data.empty()) {
+      if (!in_value_) {
+        // Newlines between values are allowed
+        if (isspace(data[0])) {
+          data = data.subspan(1);
+          continue;
+        }
+        in_value_ = true;
+      }
+      data = data.subspan(decoder_.feed(data));
+      if (decoder_.done()) {
+        if (!ndjson_) {
+          return false;
+        }
+        decoder_.reset();
+        in_value_ = false;
+        values_++;
+      }
+    }
+    return true;
+  }
+
+  void finish() {
+    if (in_value_ || (values_ == 0 && !decoder_.done())) {
+      decoder_.finish();
+    }
+  }
+
+ private:
+  bencoding::StreamDecoder decoder_;
+  bool ndjson_;
+  bool in_value_ = false;
+  size_t values_ = 0;
+};
+
+int main(int argc, char **argv) {
+  bencoding::JsonOptions options;
+  std::string file;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--ndjson") {
+      options.compact = true;
+    } else if (arg.rfind("--binary=", 0) == 0) {
+      try {
+        options.binary = bencoding::parse_binary_mode(arg.substr(strlen("--binary=")));
+      } catch (const std::invalid_argument &e) {
+        std::cerr << e.what() << std::endl;
+        usage();
+        return 1;
+      }
+    } else if (arg == "-h" || arg == "--help" || !file.empty()) {
+      usage();
+      return 1;
+    } else {
+      file = arg;
+    }
+  }
+
+  bencoding::JsonVisitor visitor(std::cout, options);
+  Converter converter(visitor, options.compact);
+  if (!file.empty()) {
+    utils::MappedFile mapped(file);
+    converter.feed(mapped.data());
+  } else {
+    // The input is streamed so its size is not limited by memory
+    std::array<uint8_t, 64 * 1024> buffer{};
+    while (true) {
+      auto n = fread(buffer.data(), 1, buffer.size(), stdin);
+      if (n == 0 || !converter.feed(gsl::span<const uint8_t>(buffer.data(), n))) {
+        break;
+      }
+    }
+  }
+  converter.finish();
   return 0;
-}
\ No newline at end of file
+}
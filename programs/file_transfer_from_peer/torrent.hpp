@@ -1,7 +1,9 @@
 #pragma once
 
 
-#include <fstream>
+#include <cstring>
+
+#include <array>
 #include <map>
 #include <set>
 #include <random>
@@ -14,45 +16,135 @@
 #include <albert/bt/peer.hpp>
 #include <albert/log/log.hpp>
 #include <albert/bencode/bencoding.hpp>
+#include <albert/bencode/visitor.hpp>
 #include <albert/flow_control/rps_throttler.hpp>
+#include <albert/utils/mapped_file.hpp>
 
 using namespace albert;
 using namespace albert::common;
 
+/**
+ * Picks what Torrent needs out of the decoding events of a .torrent file.
+ * File paths and other metadata are never stored, so memory does not grow with the torrent size.
+ */
+class TorrentVisitor :public bencoding::Visitor {
+ public:
+  void decode(gsl::span<const uint8_t> data) {
+    decoder_.feed(data);
+    decoder_.finish();
+  }
+
+  void begin_dict() override {
+    if (depth_ == 1 && keys_[0] == "info") {
+      // The decoder is just past the 'd'
+      info_begin = decoder_.offset() - 1;
+    } else if (depth_ == 3 && in_info("files")) {
+      files++;
+    }
+    depth_++;
+  }
+  void begin_list() override {
+    depth_++;
+  }
+  void end() override {
+    depth_--;
+    if (depth_ == 1 && keys_[0] == "info") {
+      info_end = decoder_.offset();
+    }
+  }
+  void key(std::string_view key) override {
+    if (depth_ <= keys_.size()) {
+      keys_[depth_ - 1] = key;
+    }
+  }
+  void integer(int64_t i) override {
+    if (depth_ == 2 && in_info("piece length")) {
+      piece_length = i;
+    } else if (depth_ == 4 && in_info("files") && keys_[3] == "length") {
+      total_size += i;
+    }
+  }
+  void string_begin(size_t length) override {
+    if (depth_ == 2 && in_info("name")) {
+      target_ = Target::Name;
+    } else if (depth_ == 2 && in_info("pieces")) {
+      target_ = Target::Pieces;
+    }
+  }
+  void string_chunk(std::string_view data) override {
+    if (target_ == Target::Name) {
+      name.append(data);
+    } else if (target_ == Target::Pieces) {
+      // A hash may be split over two chunks
+      while (!data.empty()) {
+        auto n = std::min(data.size(), carry_.size() - carry_size_);
+        memcpy(carry_.data() + carry_size_, data.data(), n);
+        carry_size_ += n;
+        data.remove_prefix(n);
+        if (carry_size_ == carry_.size()) {
+          piece_hashes.emplace_back(u160::U160::decode(carry_.data()));
+          carry_size_ = 0;
+        }
+      }
+    }
+  }
+  void string_end() override {
+    target_ = Target::None;
+  }
+
+  size_t info_begin = 0;
+  size_t info_end = 0;
+  size_t piece_length = 0;
+  size_t total_size = 0;
+  size_t files = 0;
+  std::string name;
+  std::vector<u160::U160> piece_hashes;
+
+ private:
+  enum class Target {
+    None,
+    Name,
+    Pieces,
+  };
+
+  bool in_info(std::string_view key) const {
+    return keys_[0] == "info" && keys_[1] == key;
+  }
+
+ private:
+  bencoding::StreamDecoder decoder_{*this};
+  size_t depth_ = 0;
+  // Last key seen in the dicts at the first levels
+  std::array<std::string, 4> keys_;
+  Target target_ = Target::None;
+  std::array<uint8_t, u160::U160Length> carry_{};
+  size_t carry_size_ = 0;
+};
+
 struct Torrent {
   void parse_file(const std::string &file) {
-    std::ifstream ifs(file, std::ios::binary);
-    auto torrent = std::dynamic_pointer_cast<bencoding::DictNode>(bencoding::Node::decode(ifs));
-    auto info = bencoding::get<bencoding::DictNode>(*torrent, "info");
-    piece_length = bencoding::get<size_t>(info, "piece length");
-
-    auto pieces_s = bencoding::get<std::string>(info, "pieces");
-    std::stringstream ss_pieces(pieces_s);
-    while (ss_pieces.peek() != EOF) {
-      piece_hashes.emplace_back(u160::U160::decode(ss_pieces));
+    utils::MappedFile mapped(file);
+    TorrentVisitor visitor;
+    visitor.decode(mapped.data());
+    if (visitor.info_end == 0) {
+      throw bencoding::InvalidBencoding("Invalid torrent file, 'info' dict not found");
     }
+    // The info hash is the hash of the exact info bytes, which stay in the mapped file
+    auto info = mapped.data().subspan(visitor.info_begin, visitor.info_end - visitor.info_begin);
+    info_hash = u160::U160::hash(info.data(), info.size());
 
-    std::stringstream ss;
-    info.encode(ss, bencoding::EncodeMode::Bencoding);
-    info_hash = u160::U160::hash((const uint8_t*)ss.str().data(), ss.str().size());
-
-    name = bencoding::get<std::string>(info, "name");
+    piece_length = visitor.piece_length;
+    piece_hashes = std::move(visitor.piece_hashes);
+    name = std::move(visitor.name);
 
     total_pieces = piece_hashes.size();
-    if (info.dict().find("files") == info.dict().end()) {
+    if (visitor.files == 0) {
       // single file mode
       LOG(error) << "single file mode not implemented";
       assert(0);
     } else {
       // multi file mode
-      auto files_node = bencoding::get<std::vector<std::shared_ptr<bencoding::DictNode>>>(info, "files");
-      size_t current_offset = 0;
-      for (auto file_node : files_node) {
-        auto length = bencoding::get<size_t>(*file_node, "length");
-        auto path = bencoding::get<bencoding::ListNode>(*file_node, "path");
-        current_offset += length;
-      }
-      total_size = current_offset;
+      total_size = visitor.total_size;
     }
   }
   u160::U160 info_hash;
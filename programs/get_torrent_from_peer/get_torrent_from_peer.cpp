@@ -4,8 +4,10 @@
 #include <boost/asio/signal_set.hpp>
 
 #include <albert/bt/peer_connection.hpp>
+#include <albert/bt/torrent_resolver.hpp>
 #include <albert/log/log.hpp>
 #include <albert/bencode/bencoding.hpp>
+#include <albert/bencode/parser.hpp>
 
 using namespace albert;
 
@@ -52,13 +54,7 @@ int main (int argc, char **argv) {
     if (all_ok) {
       auto calculated_hash = u160::U160::hash(metadata.data(), metadata.size());
       if (calculated_hash == target) {
-        std::stringstream ss(std::string((const char *)metadata.data(), metadata.size()));
-        auto info = bencoding::Node::decode(ss);
-        std::map<std::string, std::shared_ptr<bencoding::Node>> dict;
-        dict["announce"] =
-            std::make_shared<bencoding::DictNode>(std::map<std::string, std::shared_ptr<bencoding::Node>>());
-        dict["info"] = info;
-        bencoding::DictNode torrent(std::move(dict));
+        auto torrent = bt::make_torrent(metadata);
 
         auto file_name = target.to_string() + ".torrent";
         std::ofstream ofs(file_name, std::ios::binary);
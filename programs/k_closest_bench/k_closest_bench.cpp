@@ -0,0 +1,283 @@
+#include <cstdint>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <albert/dht/routing_table/routing_table.hpp>
+#include <albert/log/log.hpp>
+#include <albert/u160/u160.hpp>
+
+/**
+ * Measures RoutingTable::k_nearest_good_nodes.
+ *
+ * 1. Checks results against a brute force scan of the table and reports ns per query for the trie, the flat
+ *    backend and a fat trie.
+ * 2. Simulates iterative lookups in a synthetic network where every node answers either with the k closest
+ *    nodes it knows, or with the nodes the old trie walk returned: the leaves on the side of the target first,
+ *    the first nodes of each leaf in id order. Reports queries per lookup and how often the closest node is found.
+ */
+
+using namespace albert;
+using dht::routing_table::RoutingTable;
+using dht::routing_table::Entry;
+
+namespace {
+
+constexpr size_t K = 8;
+constexpr size_t Alpha = 3;
+
+std::unique_ptr<RoutingTable> make_table(const u160::U160 &self, bool flat) {
+  return std::make_unique<RoutingTable>(self, "bench", "", K, SIZE_MAX, true, false, flat, nullptr);
+}
+
+void add_good(RoutingTable &rt, const krpc::NodeInfo &node) {
+  rt.add_node(Entry(node, ""));
+  rt.make_good_now(node.id());
+}
+
+std::vector<krpc::NodeInfo> brute_force(const std::vector<krpc::NodeInfo> &nodes, const u160::U160 &target, size_t k) {
+  auto ret = nodes;
+  k = std::min(k, ret.size());
+  std::partial_sort(ret.begin(), ret.begin() + k, ret.end(), [&target](const krpc::NodeInfo &a, const krpc::NodeInfo &b) {
+    return (a.id() ^ target) < (b.id() ^ target);
+  });
+  ret.resize(k);
+  return ret;
+}
+
+// What the trie returned before it searched by distance: from the root, the child on the side of the target
+//   first, and the first k nodes of each leaf in id order, good or not, until there are k.
+// The leaves are rebuilt from the table, the trie only split the leaf of self while it had more than
+//   BucketMaxGoodItems nodes
+std::vector<krpc::NodeInfo> legacy_nearest(const RoutingTable &rt, const u160::U160 &target, size_t k) {
+  constexpr size_t Depths = u160::U160Bits;
+  auto self = rt.self();
+  std::vector<std::vector<krpc::NodeInfo>> leaves(Depths);
+  rt.iterate_nodes([&leaves, &self](const Entry &entry) {
+    auto i = std::min(u160::U160::common_prefix_length(self, entry.id()), Depths - 1);
+    leaves[i].push_back(entry.node_info());
+  });
+  // Depth of the leaf of self, it has the nodes of all deeper buckets
+  size_t depth = Depths - 1;
+  size_t deeper = leaves[Depths - 1].size();
+  while (depth > 0 && deeper + leaves[depth - 1].size() <= dht::routing_table::BucketMaxGoodItems) {
+    depth--;
+    deeper += leaves[depth].size();
+  }
+  for (size_t i = depth + 1; i < Depths; i++) {
+    leaves[depth].insert(leaves[depth].end(), leaves[i].begin(), leaves[i].end());
+  }
+  leaves.resize(depth + 1);
+  for (auto &leaf : leaves) {
+    std::sort(leaf.begin(), leaf.end(), [](const krpc::NodeInfo &x, const krpc::NodeInfo &y) { return x.id() < y.id(); });
+  }
+
+  std::vector<krpc::NodeInfo> ret;
+  auto take = [&ret, k](const std::vector<krpc::NodeInfo> &leaf) {
+    for (size_t i = 0; i < leaf.size() && ret.size() < k; i++) {
+      ret.push_back(leaf[i]);
+    }
+  };
+  // Leaf d holds the ids that differ from self first at bit d, the subtree below depth d the ones that do not
+  std::function<void(size_t)> visit = [&](size_t d) {
+    if (ret.size() >= k) {
+      return;
+    }
+    if (d == depth) {
+      take(leaves[d]);
+      return;
+    }
+    auto bit = u160::U160Bits - 1 - d;
+    if (target.bit(bit) != self.bit(bit)) {
+      take(leaves[d]);
+      visit(d + 1);
+    } else {
+      visit(d + 1);
+      take(leaves[d]);
+    }
+  };
+  visit(0);
+  return ret;
+}
+
+void bench_queries(size_t n_nodes, size_t n_queries) {
+  std::vector<krpc::NodeInfo> nodes;
+  for (size_t i = 0; i < n_nodes; i++) {
+    nodes.emplace_back(u160::U160::random(), uint32_t(i + 1), 6881);
+  }
+  std::vector<u160::U160> targets;
+  for (size_t i = 0; i < n_queries; i++) {
+    targets.push_back(u160::U160::random());
+  }
+
+  auto self = u160::U160::random();
+  for (std::string mode : {"trie", "flat", "fat"}) {
+    auto rt = std::make_unique<RoutingTable>(self, "bench", "", K, SIZE_MAX, true, mode == "fat", mode == "flat", nullptr);
+    for (auto &node : nodes) {
+      add_good(*rt, node);
+    }
+    // Non fat tables keep max_bucket_size nodes per bucket after gc, like a running table
+    if (mode != "fat") {
+      rt->gc();
+    }
+    std::vector<krpc::NodeInfo> in_table;
+    rt->iterate_nodes([&in_table](const Entry &entry) { in_table.push_back(entry.node_info()); });
+
+    size_t wrong = 0;
+    size_t n_checked = std::min<size_t>(n_queries, 1000);
+    for (size_t i = 0; i < n_checked; i++) {
+      auto result = rt->k_nearest_good_nodes(targets[i], K);
+      auto expected = brute_force(in_table, targets[i], K);
+      if (!std::equal(result.begin(), result.end(), expected.begin(), expected.end(),
+                      [](const krpc::NodeInfo &a, const krpc::NodeInfo &b) { return a.id() == b.id(); })) {
+        wrong++;
+      }
+    }
+
+    size_t checksum = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (auto &target : targets) {
+      checksum += rt->k_nearest_good_nodes(target, K).size();
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    auto ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / targets.size();
+
+    t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n_checked; i++) {
+      checksum += brute_force(in_table, targets[i], K).size();
+    }
+    t1 = std::chrono::steady_clock::now();
+    auto brute_ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / n_checked;
+
+    std::cout << std::setw(4) << mode << " nodes " << std::setw(7) << in_table.size()
+              << "  k_nearest " << std::setw(8) << std::fixed << std::setprecision(0) << ns << " ns/query"
+              << "  brute force " << std::setw(8) << brute_ns << " ns/query"
+              << "  mismatches " << wrong << "/" << n_checked
+              << "  (" << checksum << ")" << std::endl;
+  }
+}
+
+struct LookupStats {
+  size_t lookups = 0;
+  size_t queries = 0;
+  size_t found_closest = 0;
+};
+
+// Iterative lookup with Alpha parallel queries, stops when the K closest nodes seen have all been queried
+template <typename Answer>
+void lookup(const std::vector<std::unique_ptr<RoutingTable>> &network, size_t origin, const u160::U160 &target,
+            const Answer &answer, const krpc::NodeInfo &closest, LookupStats &stats) {
+  std::vector<std::pair<krpc::NodeInfo, bool>> shortlist;
+  auto merge = [&shortlist, &target](const std::vector<krpc::NodeInfo> &nodes) {
+    for (auto &node : nodes) {
+      bool known = std::any_of(shortlist.begin(), shortlist.end(), [&node](const auto &item) {
+        return item.first.id() == node.id();
+      });
+      if (!known) {
+        shortlist.emplace_back(node, false);
+      }
+    }
+    std::sort(shortlist.begin(), shortlist.end(), [&target](const auto &a, const auto &b) {
+      return (a.first.id() ^ target) < (b.first.id() ^ target);
+    });
+  };
+  merge(answer(*network[origin], target));
+
+  while (true) {
+    size_t sent = 0;
+    std::vector<krpc::NodeInfo> answers;
+    for (size_t i = 0; i < std::min(K, shortlist.size()) && sent < Alpha; i++) {
+      if (!shortlist[i].second) {
+        shortlist[i].second = true;
+        sent++;
+        // Node ip is its index in the network plus one
+        auto nodes = answer(*network[shortlist[i].first.ip() - 1], target);
+        answers.insert(answers.end(), nodes.begin(), nodes.end());
+      }
+    }
+    if (sent == 0) {
+      break;
+    }
+    stats.queries += sent;
+    merge(answers);
+  }
+  stats.lookups++;
+  if (!shortlist.empty() && shortlist.front().first.id() == closest.id()) {
+    stats.found_closest++;
+  }
+}
+
+void bench_convergence(size_t n_nodes, size_t n_known, size_t n_lookups) {
+  std::mt19937_64 rng(2);
+  std::vector<krpc::NodeInfo> nodes;
+  for (size_t i = 0; i < n_nodes; i++) {
+    nodes.emplace_back(u160::U160::random(), uint32_t(i + 1), 6881);
+  }
+
+  // Every node knows n_known random nodes, and its 4 closest neighbours so the network is connected near each id
+  std::vector<std::unique_ptr<RoutingTable>> network;
+  std::uniform_int_distribution<size_t> pick(0, n_nodes - 1);
+  for (auto &self : nodes) {
+    auto rt = make_table(self.id(), true);
+    for (size_t i = 0; i < n_known; i++) {
+      auto &node = nodes[pick(rng)];
+      if (node.id() != self.id()) {
+        add_good(*rt, node);
+      }
+    }
+    for (auto &node : brute_force(nodes, self.id(), 5)) {
+      if (node.id() != self.id()) {
+        add_good(*rt, node);
+      }
+    }
+    network.push_back(std::move(rt));
+  }
+
+  auto closest_answer = [](const RoutingTable &rt, const u160::U160 &target) {
+    auto nodes = rt.k_nearest_good_nodes(target, K);
+    return std::vector<krpc::NodeInfo>(nodes.begin(), nodes.end());
+  };
+  auto legacy_answer = [](const RoutingTable &rt, const u160::U160 &target) {
+    return legacy_nearest(rt, target, K);
+  };
+
+  LookupStats closest_stats, legacy_stats;
+  for (size_t i = 0; i < n_lookups; i++) {
+    auto target = u160::U160::random();
+    auto origin = pick(rng);
+    auto closest = brute_force(nodes, target, 1).front();
+    lookup(network, origin, target, closest_answer, closest, closest_stats);
+    lookup(network, origin, target, legacy_answer, closest, legacy_stats);
+  }
+
+  auto print = [](const std::string &name, const LookupStats &stats) {
+    std::cout << std::setw(8) << name
+              << "  queries/lookup " << std::setw(6) << std::fixed << std::setprecision(1)
+              << double(stats.queries) / stats.lookups
+              << "  found closest " << std::setw(5) << std::setprecision(1)
+              << 100.0 * stats.found_closest / stats.lookups << "%" << std::endl;
+  };
+  std::cout << "network of " << n_nodes << " nodes, " << n_known << " random contacts each, "
+            << n_lookups << " lookups, k=" << K << " alpha=" << Alpha << std::endl;
+  print("closest", closest_stats);
+  print("legacy", legacy_stats);
+}
+
+}
+
+int main(int argc, char **argv) {
+  log::initialize_logger(false);
+  size_t scale = argc > 1 ? std::stoul(argv[1]) : 1;
+
+  for (size_t n : {1000, 10000}) {
+    bench_queries(n * scale, 20000);
+  }
+  bench_convergence(2000 * scale, 20, 500);
+}
@@ -1,5 +1,6 @@
 #include <exception>
 #include <list>
+#include <map>
 #include <random>
 #include <sstream>
 #include <string>
@@ -175,13 +176,17 @@ class Scanner :public std::enable_shared_from_this<Scanner> {
                   }
                 }
               }
+              std::vector<albert::u160::U160> info_hashes;
               for (size_t i = 0; i < results.size() && i < scanner->max_add_count_at_a_time; i++) {
                 try {
-                  scanner->resolve_s(albert::u160::U160::from_hex(results[i]));
+                  info_hashes.push_back(albert::u160::U160::from_hex(results[i]));
                 } catch (const std::runtime_error &e) {
                   LOG(error) << "Failed to resolve info hash: " << e.what();
                 }
               }
+              if (!info_hashes.empty()) {
+                scanner->resolve_s(std::move(info_hashes));
+              }
             }
 
             LOG(info) << "Scanner: BTResolver count: " << resolver_count
@@ -200,10 +205,16 @@ class Scanner :public std::enable_shared_from_this<Scanner> {
     });
   }
 
-  void resolve_s(const albert::u160::U160 &ih) {
-    bt_service.post([weak_scanner = weak_from_this(), ih]() {
-      if (auto scanner = weak_scanner.lock(); scanner) {
-        auto resolver_weak = scanner->bt.resolve_torrent(ih, [ih, weak_scanner](const albert::bencoding::DictNode &torrent) {
+  // Resolve the torrents, the peers of all of them are looked up in one DHT batch
+  void resolve_s(std::vector<albert::u160::U160> info_hashes) {
+    bt_service.post([weak_scanner = weak_from_this(), info_hashes = std::move(info_hashes)]() {
+      auto scanner = weak_scanner.lock();
+      if (!scanner) {
+        return;
+      }
+      std::map<albert::u160::U160, std::weak_ptr<albert::bt::TorrentResolver>> resolvers;
+      for (auto &ih : info_hashes) {
+        resolvers[ih] = scanner->bt.resolve_torrent(ih, [ih, weak_scanner](const albert::bencoding::LazyNode &torrent) {
           if (auto scanner = weak_scanner.lock(); scanner) {
             scanner->main_service.post([ih, torrent, weak_scanner]() {
               if (auto scanner = weak_scanner.lock(); scanner) {
@@ -223,17 +234,18 @@ class Scanner :public std::enable_shared_from_this<Scanner> {
             });
           }
         });
-        using namespace std::placeholders;
-        scanner->dht_service.post([weak_scanner, ih, resolver_weak]() {
-          if (auto scanner = weak_scanner.lock(); scanner) {
-            scanner->dht.get_peers(ih, [weak_scanner, resolver_weak](uint32_t ip, uint16_t port) {
-              if (auto scanner = weak_scanner.lock()) {
-                scanner->handle_get_peers_s(resolver_weak, ip, port);
-              }
-            });
-          }
-        });
       }
+      scanner->dht_service.post([weak_scanner, info_hashes, resolvers = std::move(resolvers)]() {
+        if (auto scanner = weak_scanner.lock(); scanner) {
+          scanner->dht.get_peers_batch(
+              info_hashes,
+              [weak_scanner, resolvers](const albert::u160::U160 &ih, uint32_t ip, uint16_t port) {
+                if (auto scanner = weak_scanner.lock()) {
+                  scanner->handle_get_peers_s(resolvers.at(ih), ip, port);
+                }
+              });
+        }
+      });
     });
   }
 
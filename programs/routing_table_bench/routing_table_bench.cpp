@@ -0,0 +1,173 @@
+#include <cstdint>
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <albert/dht/routing_table/routing_table.hpp>
+#include <albert/log/log.hpp>
+#include <albert/u160/u160.hpp>
+
+/**
+ * Baseline of RoutingTable operations, to hold data structure changes against.
+ *
+ * For the trie, flat and fat backends at 10k, 100k and 1M synthetic random nodes, reports ns per operation of
+ *   add_node, make_good_now by id and by endpoint, k_nearest_good_nodes on the table and on its published
+ *   snapshot, gc, the legacy serialize/deserialize and the binary snapshot, and the memory per node.
+ * Nodes are added and made good like DHTImpl::good_sender() does, so buckets split as in a running table.
+ * Non fat tables only keep max_bucket_size nodes per bucket, so like a running table they are collected
+ *   every GcInterval additions, outside of the measured time. Only the buckets around self split, so they hold
+ *   about max_bucket_size nodes per bit of the common prefix length, each line shows how many nodes the table held.
+ *
+ * Usage: routing-table-bench [max nodes], sizes above max nodes are skipped.
+ */
+
+using namespace albert;
+using dht::routing_table::RoutingTable;
+using dht::routing_table::Entry;
+
+namespace {
+
+constexpr size_t K = 8;
+constexpr size_t GcInterval = 1000;
+constexpr size_t Queries = 10000;
+
+using Clock = std::chrono::steady_clock;
+
+double elapsed_ns(Clock::time_point t0, Clock::time_point t1) {
+  return std::chrono::duration<double, std::nano>(t1 - t0).count();
+}
+
+// nodes is the size of the table the operation ran on
+void report(const std::string &mode, size_t n, size_t nodes, const std::string &op, double ns, size_t ops) {
+  std::cout << std::setw(4) << mode << " " << std::setw(8) << n << " " << std::setw(8) << nodes << " nodes  "
+            << std::left << std::setw(28) << op
+            << std::right << std::setw(12) << std::fixed << std::setprecision(0) << ns / std::max<size_t>(ops, 1)
+            << " ns/op" << std::endl;
+}
+
+std::unique_ptr<RoutingTable> make_table(const u160::U160 &self, const std::string &mode) {
+  return std::make_unique<RoutingTable>(self, "bench", "", K, SIZE_MAX, true, mode == "fat", mode == "flat", nullptr);
+}
+
+void bench(const std::string &mode, size_t n) {
+  std::vector<krpc::NodeInfo> nodes;
+  nodes.reserve(n);
+  for (size_t i = 0; i < n; i++) {
+    nodes.emplace_back(u160::U160::random(), uint32_t(i + 1), 6881);
+  }
+  auto self = u160::U160::random();
+  auto rt = make_table(self, mode);
+
+  double add_ns = 0;
+  double good_ns = 0;
+  for (size_t i = 0; i < n; i++) {
+    auto t0 = Clock::now();
+    rt->add_node(Entry(nodes[i], "UT\x01\x02"));
+    auto t1 = Clock::now();
+    rt->make_good_now(nodes[i].id());
+    add_ns += elapsed_ns(t0, t1);
+    good_ns += elapsed_ns(t1, Clock::now());
+    if (mode != "fat" && (i + 1) % GcInterval == 0) {
+      rt->gc();
+    }
+  }
+  auto known = rt->known_node_count();
+  report(mode, n, known, "add_node", add_ns, n);
+  report(mode, n, known, "make_good_now(id) after add", good_ns, n);
+
+  // Operations on nodes in the table, repeated up to n operations
+  std::vector<krpc::NodeInfo> in_table;
+  rt->iterate_nodes([&in_table](const Entry &entry) { in_table.push_back(entry.node_info()); });
+  size_t ops = std::max(n, in_table.size());
+
+  auto t0 = Clock::now();
+  for (size_t i = 0; i < ops; i++) {
+    rt->make_good_now(in_table[i % in_table.size()].id());
+  }
+  report(mode, n, known, "make_good_now(id)", elapsed_ns(t0, Clock::now()), ops);
+
+  t0 = Clock::now();
+  for (size_t i = 0; i < ops; i++) {
+    auto &node = in_table[i % in_table.size()];
+    rt->make_good_now(node.ip(), node.port());
+  }
+  report(mode, n, known, "make_good_now(ip, port)", elapsed_ns(t0, Clock::now()), ops);
+
+  std::vector<u160::U160> targets;
+  for (size_t i = 0; i < Queries; i++) {
+    targets.push_back(u160::U160::random());
+  }
+  size_t checksum = 0;
+  t0 = Clock::now();
+  for (auto &target : targets) {
+    checksum += rt->k_nearest_good_nodes(target, K).size();
+  }
+  report(mode, n, known, "k_nearest_good_nodes", elapsed_ns(t0, Clock::now()), Queries);
+
+  t0 = Clock::now();
+  rt->publish();
+  auto published = rt->published();
+  report(mode, n, published->size(), "publish", elapsed_ns(t0, Clock::now()), 1);
+  t0 = Clock::now();
+  for (auto &target : targets) {
+    checksum += published->k_nearest_good_nodes(target, K).size();
+  }
+  report(mode, n, published->size(), "published k_nearest", elapsed_ns(t0, Clock::now()), Queries);
+
+  std::cout << std::setw(4) << mode << " " << std::setw(8) << n << " " << std::setw(8) << known << " nodes  "
+            << std::left << std::setw(28) << "memory_size"
+            << std::right << std::setw(12) << std::fixed << std::setprecision(1)
+            << double(rt->memory_size()) / std::max<size_t>(known, 1) << " bytes/node" << std::endl;
+
+  std::stringstream ss;
+  t0 = Clock::now();
+  rt->serialize(ss);
+  report(mode, n, known, "serialize", elapsed_ns(t0, Clock::now()), known);
+  t0 = Clock::now();
+  auto loaded = RoutingTable::deserialize(ss, "bench", "", K, SIZE_MAX, true, mode == "fat", mode == "flat", nullptr);
+  report(mode, n, loaded->known_node_count(), "deserialize", elapsed_ns(t0, Clock::now()), known);
+  checksum += loaded->known_node_count();
+  loaded.reset();
+
+  t0 = Clock::now();
+  auto data = rt->snapshot();
+  report(mode, n, known, "snapshot", elapsed_ns(t0, Clock::now()), known);
+  loaded = make_table(self, mode);
+  t0 = Clock::now();
+  loaded->load_snapshot(data);
+  report(mode, n, loaded->known_node_count(), "load_snapshot", elapsed_ns(t0, Clock::now()), known);
+  checksum += loaded->known_node_count();
+  loaded.reset();
+
+  // Half of the nodes stop responding
+  for (size_t i = 0; i < in_table.size(); i += 2) {
+    rt->make_bad(in_table[i].ip(), in_table[i].port());
+  }
+  t0 = Clock::now();
+  rt->gc();
+  report(mode, n, known, "gc", elapsed_ns(t0, Clock::now()), known);
+
+  std::cout << "     (" << checksum << ")" << std::endl;
+}
+
+}
+
+int main(int argc, char **argv) {
+  log::initialize_logger(false);
+  size_t max_nodes = argc > 1 ? std::stoul(argv[1]) : 1000000;
+
+  for (size_t n : {10000, 100000, 1000000}) {
+    if (n > max_nodes) {
+      break;
+    }
+    for (std::string mode : {"trie", "flat", "fat"}) {
+      bench(mode, n);
+    }
+  }
+}
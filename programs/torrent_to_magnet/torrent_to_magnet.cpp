@@ -4,15 +4,14 @@
 
 #include <albert/u160/u160.hpp>
 #include <albert/bencode/bencoding.hpp>
+#include <albert/bencode/lazy.hpp>
 
 using namespace albert;
 
-std::string torrent_to_magnet(const bencoding::DictNode &torrent) {
-  auto info = bencoding::get<bencoding::DictNode>(torrent, "info");
-  std::stringstream ss;
-  info.encode(ss, bencoding::EncodeMode::Bencoding);
-  auto s = ss.str();
-  auto info_hash = u160::U160::hash((const uint8_t*)s.data(), s.size());
+std::string torrent_to_magnet(const bencoding::LazyNode &torrent) {
+  // Hash the info dict as it is in the file
+  auto info = bencoding::get<bencoding::LazyNode>(torrent, "info").raw();
+  auto info_hash = u160::U160::hash(info.data(), info.size());
   return "magnet:?xt=urn:btih:" + info_hash.to_string();
 }
 
@@ -22,11 +21,12 @@ void process(std::string file_path) {
   if (!ifs) {
     throw std::invalid_argument("Invalid file path '" + file_path + "'");
   }
-  auto node = bencoding::Node::decode(ifs);
-  if (auto torrent = std::dynamic_pointer_cast<bencoding::DictNode>(node); !torrent) {
+  std::vector<uint8_t> data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+  auto torrent = bencoding::LazyNode::decode(std::move(data));
+  if (!torrent.is_dict()) {
     throw std::runtime_error("Invalid torrent file '" + file_path + "', root node not a dict node");
   } else {
-    std::cout << torrent_to_magnet(*torrent) << std::endl;
+    std::cout << torrent_to_magnet(torrent) << std::endl;
   }
 }
 
@@ -0,0 +1,256 @@
+#include <albert/bencode/arena.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include <albert/bencode/json.hpp>
+#include <albert/bencode/parser.hpp>
+
+namespace albert::bencoding {
+
+void *Arena::allocate(size_t size, size_t align) {
+  while (current_ < chunks_.size()) {
+    auto &chunk = chunks_[current_];
+    auto base = reinterpret_cast<uintptr_t>(chunk.data.get());
+    auto aligned = (base + offset_ + align - 1) & ~(uintptr_t)(align - 1);
+    if (aligned + size <= base + chunk.size) {
+      offset_ = aligned + size - base;
+      allocated_ += size;
+      return reinterpret_cast<void*>(aligned);
+    }
+
+    // Move on to the next chunk, bring a large enough one forward if the next is too small
+    current_++;
+    offset_ = 0;
+    for (size_t i = current_; i < chunks_.size(); i++) {
+      if (chunks_[i].size >= size + align) {
+        std::swap(chunks_[current_], chunks_[i]);
+        break;
+      }
+    }
+  }
+
+  auto chunk_size = std::max(chunk_size_, size + align);
+  chunks_.push_back(Chunk{std::make_unique<uint8_t[]>(chunk_size), chunk_size});
+  current_ = chunks_.size() - 1;
+  offset_ = 0;
+  return allocate(size, align);
+}
+
+std::string_view Arena::copy(std::string_view s) {
+  if (s.empty()) {
+    return {};
+  }
+  auto p = static_cast<char*>(allocate(s.size(), 1));
+  memcpy(p, s.data(), s.size());
+  return {p, s.size()};
+}
+
+void Arena::reset() {
+  current_ = 0;
+  offset_ = 0;
+  allocated_ = 0;
+  list_stack_.clear();
+  dict_stack_.clear();
+}
+
+size_t Arena::memory_size() const {
+  size_t ret = sizeof(*this);
+  for (auto &chunk : chunks_) {
+    ret += chunk.size;
+  }
+  ret += chunks_.capacity() * sizeof(Chunk);
+  ret += list_stack_.capacity() * sizeof(ArenaNode);
+  ret += dict_stack_.capacity() * sizeof(ArenaEntry);
+  return ret;
+}
+
+static uint32_t checked_size(size_t size) {
+  if (size > std::numeric_limits<uint32_t>::max()) {
+    throw InvalidBencoding("ArenaNode, size too large " + std::to_string(size));
+  }
+  return static_cast<uint32_t>(size);
+}
+
+ArenaNode ArenaNode::string(std::string_view s) {
+  ArenaNode node(Type::String, checked_size(s.size()));
+  node.str_ = s.data();
+  return node;
+}
+ArenaNode ArenaNode::integer(int64_t i) {
+  ArenaNode node(Type::Int, 0);
+  node.int_ = i;
+  return node;
+}
+ArenaNode ArenaNode::list(const ArenaNode *items, size_t size) {
+  ArenaNode node(Type::List, checked_size(size));
+  node.items_ = items;
+  return node;
+}
+ArenaNode ArenaNode::dict(const ArenaEntry *entries, size_t size) {
+  ArenaNode node(Type::Dict, checked_size(size));
+  node.entries_ = entries;
+  return node;
+}
+
+std::string_view ArenaNode::as_string() const {
+  if (type_ != Type::String) {
+    throw std::invalid_argument("bencoding::ArenaNode, not a string");
+  }
+  return {str_, size_};
+}
+int64_t ArenaNode::as_int() const {
+  if (type_ != Type::Int) {
+    throw std::invalid_argument("bencoding::ArenaNode, not an integer");
+  }
+  return int_;
+}
+gsl::span<const ArenaNode> ArenaNode::as_list() const {
+  if (type_ != Type::List) {
+    throw std::invalid_argument("bencoding::ArenaNode, not a list");
+  }
+  return {items_, size_};
+}
+gsl::span<const ArenaEntry> ArenaNode::as_dict() const {
+  if (type_ != Type::Dict) {
+    throw std::invalid_argument("bencoding::ArenaNode, not a dict");
+  }
+  return {entries_, size_};
+}
+
+const ArenaNode *ArenaNode::find(std::string_view key) const {
+  if (type_ != Type::Dict) {
+    return nullptr;
+  }
+  // Dicts in messages are small, a linear scan beats anything fancier.
+  // Search backwards so that the last duplicated key wins, as it does with DictNode
+  for (size_t i = size_; i > 0; i--) {
+    if (entries_[i - 1].key == key) {
+      return &entries_[i - 1].value;
+    }
+  }
+  return nullptr;
+}
+
+static ArenaNode build_node(Arena &arena, Parser &parser, Token token,
+    std::vector<ArenaNode> &list_stack, std::vector<ArenaEntry> &dict_stack) {
+  switch (token) {
+    case Token::String:
+      return ArenaNode::string(parser.string());
+    case Token::Int:
+      return ArenaNode::integer(parser.integer());
+    case Token::ListBegin: {
+      auto base = list_stack.size();
+      for (auto t = parser.next(); t != Token::End; t = parser.next()) {
+        auto item = build_node(arena, parser, t, list_stack, dict_stack);
+        list_stack.push_back(item);
+      }
+      auto n = list_stack.size() - base;
+      auto items = arena.allocate_array<ArenaNode>(n);
+      std::copy(list_stack.begin() + base, list_stack.end(), items);
+      list_stack.resize(base);
+      return ArenaNode::list(items, n);
+    }
+    case Token::DictBegin: {
+      auto base = dict_stack.size();
+      while (parser.next() != Token::End) {
+        auto key = parser.string();
+        auto value = build_node(arena, parser, parser.next(), list_stack, dict_stack);
+        dict_stack.push_back(ArenaEntry{key, value});
+      }
+      auto n = dict_stack.size() - base;
+      auto entries = arena.allocate_array<ArenaEntry>(n);
+      std::copy(dict_stack.begin() + base, dict_stack.end(), entries);
+      dict_stack.resize(base);
+      return ArenaNode::dict(entries, n);
+    }
+    default:
+      throw ParseError("Expected a value", parser.token_offset());
+  }
+}
+
+ArenaNode ArenaNode::decode(Arena &arena, Parser &parser) {
+  auto list_base = arena.list_stack_.size();
+  auto dict_base = arena.dict_stack_.size();
+  try {
+    return build_node(arena, parser, parser.next(), arena.list_stack_, arena.dict_stack_);
+  } catch (...) {
+    arena.list_stack_.resize(list_base);
+    arena.dict_stack_.resize(dict_base);
+    throw;
+  }
+}
+
+ArenaNode ArenaNode::decode(Arena &arena, gsl::span<const uint8_t> data) {
+  Parser parser(data);
+  return decode(arena, parser);
+}
+
+void ArenaNode::encode(std::ostream &os, EncodeMode mode, size_t depth) const {
+  if (mode == EncodeMode::JSON) {
+    JsonWriter writer(os, {}, depth);
+    encode(writer);
+    return;
+  }
+  switch (type_) {
+    case Type::String: {
+      auto s = as_string();
+      os << s.size() << ':' << s;
+      break;
+    }
+    case Type::Int: {
+      os << 'i' << int_ << 'e';
+      break;
+    }
+    case Type::List: {
+      os << 'l';
+      for (size_t i = 0; i < size_; i++) {
+        items_[i].encode(os, mode, depth+1);
+      }
+      os << 'e';
+      break;
+    }
+    case Type::Dict: {
+      os << 'd';
+      for (size_t i = 0; i < size_; i++) {
+        os << entries_[i].key.size() << ':' << entries_[i].key;
+        entries_[i].value.encode(os, mode, depth+1);
+      }
+      os << 'e';
+      break;
+    }
+  }
+}
+
+void ArenaNode::encode(JsonWriter &writer) const {
+  switch (type_) {
+    case Type::String: {
+      writer.string(as_string());
+      break;
+    }
+    case Type::Int: {
+      writer.integer(int_);
+      break;
+    }
+    case Type::List: {
+      writer.begin_list();
+      for (size_t i = 0; i < size_; i++) {
+        items_[i].encode(writer);
+      }
+      writer.end();
+      break;
+    }
+    case Type::Dict: {
+      writer.begin_dict();
+      for (size_t i = 0; i < size_; i++) {
+        writer.key(entries_[i].key);
+        entries_[i].value.encode(writer);
+      }
+      writer.end();
+      break;
+    }
+  }
+}
+
+}
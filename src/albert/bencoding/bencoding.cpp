@@ -1,7 +1,7 @@
 #include "albert/bencode/bencoding.hpp"
 
+#include <albert/bencode/json.hpp>
 #include <albert/log/log.hpp>
-#include <iomanip>
 
 namespace albert::bencoding {
 
@@ -84,42 +84,42 @@ std::shared_ptr<Node> Node::decode(std::istream &is) {
 
   }
 }
-std::ostream &Node::make_indent(std::ostream &os, size_t depth) {
-  for (size_t i = 0; i < depth; i++) {
-    os << "  ";
-  }
-  return os;
-}
-
-static std::string json_string(const std::string& s) {
-  std::stringstream ss;
-  ss << '"';
+std::string json_string(std::string_view s) {
+  constexpr char hex[] = "0123456789abcdef";
+  std::string ret;
+  ret.reserve(s.size() + 2);
+  ret.push_back('"');
   for (char c : s) {
+    auto u = static_cast<uint8_t>(c);
     if (c == '"' || c == '\\') {
       // this works for utf-8 string
-      ss << "\\" << c;
+      ret.push_back('\\');
+      ret.push_back(c);
+    } else if (u >= 0x20 && u < 0x7f) {
+      ret.push_back(c);
     } else {
-      if (std::isprint(c)) {
-        ss.put(c);
-      } else {
-        std::stringstream ss2;
-        ss2 << std::hex << std::setfill('0') << std::setw(4) << (uint32_t)(uint8_t)c;
-        ss << "\\u" << ss2.str();
-      }
+      ret.append("\\u00");
+      ret.push_back(hex[u >> 4]);
+      ret.push_back(hex[u & 0xf]);
     }
   }
-  ss << '"';
-  return ss.str();
+  ret.push_back('"');
+  return ret;
 }
 
 void StringNode::encode(std::ostream &os, EncodeMode mode, size_t depth) const {
   if (mode == EncodeMode::Bencoding) {
     os << s_.size() << ':' << s_;
   } else if (mode == EncodeMode::JSON) {
-    os << json_string(s_);
+    JsonWriter writer(os, {}, depth);
+    encode(writer);
   }
 }
 
+void StringNode::encode(JsonWriter &writer) const {
+  writer.string(s_);
+}
+
 void ListNode::encode(std::ostream &os, EncodeMode mode, size_t depth) const {
   if (mode == EncodeMode::Bencoding) {
     os << 'l';
@@ -128,20 +128,19 @@ void ListNode::encode(std::ostream &os, EncodeMode mode, size_t depth) const {
     }
     os << 'e';
   } else if (mode == EncodeMode::JSON) {
-    os << '[';
-    os << std::endl;
-    for (size_t i = 0; i < list_.size(); i++) {
-      make_indent(os, depth+1);
-      list_[i]->encode(os, mode, depth+1);
-      if (i != list_.size() - 1) {
-        os << ", ";
-      }
-      os << std::endl;
-    }
-    make_indent(os, depth) << ']';
+    JsonWriter writer(os, {}, depth);
+    encode(writer);
   }
 }
 
+void ListNode::encode(JsonWriter &writer) const {
+  writer.begin_list();
+  for (auto &node : list_) {
+    node->encode(writer);
+  }
+  writer.end();
+}
+
 ListNode::operator std::vector<std::shared_ptr<DictNode>>() const {
   std::vector<std::shared_ptr<DictNode>> ret;
   for (const auto& item : list_) {
@@ -163,22 +162,30 @@ void DictNode::encode(std::ostream &os, EncodeMode mode, size_t depth) const {
     }
     os << 'e';
   } else if (mode == EncodeMode::JSON) {
-    os << '{' << std::endl;
-    for (auto it = dict_.begin(); it != dict_.end(); it++) {
-      if (it != dict_.begin())
-        os << ", " << std::endl;
-      make_indent(os, depth+1) << json_string(it->first) << ": ";
-      it->second->encode(os, mode, depth+1);
-      os << std::endl;
-    }
-    make_indent(os, depth) << '}';
+    JsonWriter writer(os, {}, depth);
+    encode(writer);
+  }
+}
+
+void DictNode::encode(JsonWriter &writer) const {
+  writer.begin_dict();
+  for (const auto& item : dict_) {
+    writer.key(item.first);
+    item.second->encode(writer);
   }
+  writer.end();
 }
+
 void IntNode::encode(std::ostream &os, EncodeMode mode, size_t depth) const {
   if (mode == EncodeMode::Bencoding) {
     os << 'i' << i_ << 'e';
   } else if (mode == EncodeMode::JSON) {
-    os << i_;
+    JsonWriter writer(os, {}, depth);
+    encode(writer);
   }
 }
+
+void IntNode::encode(JsonWriter &writer) const {
+  writer.integer(i_);
+}
 }
\ No newline at end of file
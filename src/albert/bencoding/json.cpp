@@ -0,0 +1,411 @@
+#include <albert/bencode/json.hpp>
+
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+namespace albert::bencoding {
+
+namespace {
+
+constexpr uint64_t Ones = 0x0101010101010101ull;
+constexpr uint64_t Highs = 0x8080808080808080ull;
+constexpr char HexDigits[] = "0123456789abcdef";
+constexpr char Base64Digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+uint64_t load_word(const char *p) {
+  uint64_t w;
+  memcpy(&w, p, sizeof(w));
+  return w;
+}
+
+// High bit set in the bytes that are zero, exact as long as we only test for any
+uint64_t zero_bytes(uint64_t w) {
+  return (w - Ones) & ~w & Highs;
+}
+
+// High bit set in the bytes that need escaping: controls, '"', '\\', DEL, and non ASCII unless raw_utf8
+uint64_t escape_bytes(uint64_t w, bool raw_utf8) {
+  uint64_t m = (w - Ones * 0x20) & ~w & Highs;
+  m |= zero_bytes(w ^ (Ones * '"'));
+  m |= zero_bytes(w ^ (Ones * '\\'));
+  m |= zero_bytes(w ^ (Ones * 0x7f));
+  if (!raw_utf8) {
+    m |= w & Highs;
+  }
+  return m;
+}
+
+bool needs_escape(uint8_t c, bool raw_utf8) {
+  return c < 0x20 || c == '"' || c == '\\' || c == 0x7f || (!raw_utf8 && c >= 0x80);
+}
+
+bool is_control(uint8_t c) {
+  return (c < 0x20 && c != '\t' && c != '\n' && c != '\r') || c == 0x7f;
+}
+
+// Valid UTF-8 without control characters other than tab and newlines
+bool is_text(std::string_view s) {
+  auto p = reinterpret_cast<const uint8_t*>(s.data());
+  size_t n = s.size();
+  size_t i = 0;
+  while (i < n) {
+    if (i + 8 <= n) {
+      auto w = load_word(s.data() + i);
+      // Plain printable ASCII
+      if (((w - Ones * 0x20) & ~w & Highs) == 0 && zero_bytes(w ^ (Ones * 0x7f)) == 0 && (w & Highs) == 0) {
+        i += 8;
+        continue;
+      }
+    }
+    uint8_t c = p[i];
+    if (c < 0x80) {
+      if (is_control(c)) {
+        return false;
+      }
+      i++;
+      continue;
+    }
+    size_t length;
+    uint32_t code;
+    if ((c & 0xe0) == 0xc0) {
+      length = 2;
+      code = c & 0x1f;
+    } else if ((c & 0xf0) == 0xe0) {
+      length = 3;
+      code = c & 0x0f;
+    } else if ((c & 0xf8) == 0xf0) {
+      length = 4;
+      code = c & 0x07;
+    } else {
+      return false;
+    }
+    if (i + length > n) {
+      return false;
+    }
+    for (size_t j = 1; j < length; j++) {
+      if ((p[i + j] & 0xc0) != 0x80) {
+        return false;
+      }
+      code = (code << 6) | (p[i + j] & 0x3f);
+    }
+    // Overlong forms, surrogates and out of range code points
+    constexpr uint32_t min_code[] = {0, 0, 0x80, 0x800, 0x10000};
+    if (code < min_code[length] || (code >= 0xd800 && code <= 0xdfff) || code > 0x10ffff) {
+      return false;
+    }
+    i += length;
+  }
+  return true;
+}
+
+}
+
+BinaryMode parse_binary_mode(std::string_view name) {
+  if (name == "escape") {
+    return BinaryMode::Escape;
+  } else if (name == "hex") {
+    return BinaryMode::Hex;
+  } else if (name == "base64") {
+    return BinaryMode::Base64;
+  } else {
+    throw std::invalid_argument("Unknown binary mode '" + std::string(name) + "', expected escape, hex or base64");
+  }
+}
+
+JsonWriter::JsonWriter(std::ostream &os, JsonOptions options, size_t indent)
+    :os_(os), options_(options), indent_(indent), buffer_(BufferSize) { }
+
+JsonWriter::~JsonWriter() {
+  flush();
+}
+
+void JsonWriter::flush() {
+  if (used_ > 0) {
+    os_.write(buffer_.data(), used_);
+    used_ = 0;
+  }
+}
+
+void JsonWriter::write(std::string_view s) {
+  if (s.size() > buffer_.size() - used_) {
+    flush();
+    if (s.size() >= buffer_.size()) {
+      os_.write(s.data(), s.size());
+      return;
+    }
+  }
+  memcpy(buffer_.data() + used_, s.data(), s.size());
+  used_ += s.size();
+}
+
+void JsonWriter::put(char c) {
+  if (used_ == buffer_.size()) {
+    flush();
+  }
+  buffer_[used_++] = c;
+}
+
+void JsonWriter::indent(size_t depth) {
+  for (size_t i = 0; i < depth; i++) {
+    write("  ");
+  }
+}
+
+void JsonWriter::write_escaped(std::string_view s, bool raw_utf8) {
+  size_t n = s.size();
+  size_t run = 0;
+  size_t i = 0;
+  auto escape = [&](size_t end) {
+    for (; i < end; i++) {
+      uint8_t c = s[i];
+      if (!needs_escape(c, raw_utf8)) {
+        continue;
+      }
+      if (run < i) {
+        write(s.substr(run, i - run));
+      }
+      run = i + 1;
+      // Longest escape is \u00XX
+      if (buffer_.size() - used_ < 6) {
+        flush();
+      }
+      auto out = buffer_.data() + used_;
+      if (c == '"' || c == '\\') {
+        // this works for utf-8 string
+        out[0] = '\\';
+        out[1] = c;
+        used_ += 2;
+      } else {
+        out[0] = '\\';
+        out[1] = 'u';
+        out[2] = '0';
+        out[3] = '0';
+        out[4] = HexDigits[c >> 4];
+        out[5] = HexDigits[c & 0xf];
+        used_ += 6;
+      }
+    }
+  };
+  while (i + 8 <= n) {
+    if (escape_bytes(load_word(s.data() + i), raw_utf8) == 0) {
+      i += 8;
+    } else {
+      escape(i + 8);
+    }
+  }
+  escape(n);
+  write(s.substr(run));
+}
+
+void JsonWriter::write_hex(std::string_view s) {
+  char tmp[512];
+  size_t used = 0;
+  for (char ch : s) {
+    auto c = static_cast<uint8_t>(ch);
+    tmp[used++] = HexDigits[c >> 4];
+    tmp[used++] = HexDigits[c & 0xf];
+    if (used == sizeof(tmp)) {
+      write({tmp, used});
+      used = 0;
+    }
+  }
+  write({tmp, used});
+}
+
+void JsonWriter::write_base64(std::string_view s) {
+  char tmp[512];
+  size_t used = 0;
+  auto encode = [&](uint8_t a, uint8_t b, uint8_t c) {
+    uint32_t v = (uint32_t(a) << 16) | (uint32_t(b) << 8) | c;
+    tmp[used++] = Base64Digits[(v >> 18) & 0x3f];
+    tmp[used++] = Base64Digits[(v >> 12) & 0x3f];
+    tmp[used++] = Base64Digits[(v >> 6) & 0x3f];
+    tmp[used++] = Base64Digits[v & 0x3f];
+    if (used == sizeof(tmp)) {
+      write({tmp, used});
+      used = 0;
+    }
+  };
+
+  size_t i = 0;
+  // A triple may be split over two chunks
+  while (carry_size_ > 0 && carry_size_ < carry_.size() && i < s.size()) {
+    carry_[carry_size_++] = s[i++];
+  }
+  if (carry_size_ == carry_.size()) {
+    encode(carry_[0], carry_[1], carry_[2]);
+    carry_size_ = 0;
+  }
+  for (; i + 3 <= s.size(); i += 3) {
+    encode(s[i], s[i + 1], s[i + 2]);
+  }
+  for (; i < s.size(); i++) {
+    carry_[carry_size_++] = s[i];
+  }
+  write({tmp, used});
+}
+
+void JsonWriter::finish_base64() {
+  if (carry_size_ == 0) {
+    return;
+  }
+  uint32_t v = uint32_t(carry_[0]) << 16;
+  if (carry_size_ == 2) {
+    v |= uint32_t(carry_[1]) << 8;
+  }
+  char tmp[] = {
+      Base64Digits[(v >> 18) & 0x3f],
+      Base64Digits[(v >> 12) & 0x3f],
+      carry_size_ == 2 ? Base64Digits[(v >> 6) & 0x3f] : '=',
+      '='};
+  write({tmp, sizeof(tmp)});
+  carry_size_ = 0;
+}
+
+void JsonWriter::write_quoted(std::string_view s) {
+  put('"');
+  if (options_.binary == BinaryMode::Escape) {
+    write_escaped(s, false);
+  } else if (is_text(s)) {
+    write_escaped(s, true);
+  } else if (options_.binary == BinaryMode::Hex) {
+    write_hex(s);
+  } else {
+    write_base64(s);
+    finish_base64();
+  }
+  put('"');
+}
+
+// Values in a dict follow their key, values in a list start a new line
+void JsonWriter::begin_value() {
+  if (!is_dict_.empty() && !is_dict_.back()) {
+    if (items_.back() > 0) {
+      write(options_.compact ? "," : ", \n");
+    }
+    if (!options_.compact) {
+      indent(indent_ + is_dict_.size());
+    }
+    items_.back()++;
+  }
+}
+
+void JsonWriter::end_value() {
+  if (options_.compact) {
+    if (is_dict_.empty()) {
+      put('\n');
+    }
+  } else if (!is_dict_.empty() && is_dict_.back()) {
+    put('\n');
+  }
+}
+
+void JsonWriter::begin_container(bool is_dict) {
+  begin_value();
+  put(is_dict ? '{' : '[');
+  if (!options_.compact) {
+    put('\n');
+  }
+  is_dict_.push_back(is_dict);
+  items_.push_back(0);
+}
+
+void JsonWriter::begin_dict() {
+  begin_container(true);
+}
+
+void JsonWriter::begin_list() {
+  begin_container(false);
+}
+
+void JsonWriter::end() {
+  bool is_dict = is_dict_.back();
+  size_t items = items_.back();
+  is_dict_.pop_back();
+  items_.pop_back();
+  if (!options_.compact) {
+    if (!is_dict && items > 0) {
+      put('\n');
+    }
+    indent(indent_ + is_dict_.size());
+  }
+  put(is_dict ? '}' : ']');
+  end_value();
+}
+
+void JsonWriter::key(std::string_view key) {
+  if (items_.back() > 0) {
+    write(options_.compact ? "," : ", \n");
+  }
+  items_.back()++;
+  if (!options_.compact) {
+    indent(indent_ + is_dict_.size());
+  }
+  write_quoted(key);
+  write(options_.compact ? ":" : ": ");
+}
+
+void JsonWriter::integer(int64_t i) {
+  begin_value();
+  char tmp[24];
+  auto result = std::to_chars(tmp, tmp + sizeof(tmp), i);
+  write({tmp, size_t(result.ptr - tmp)});
+  end_value();
+}
+
+void JsonWriter::string(std::string_view s) {
+  begin_value();
+  write_quoted(s);
+  end_value();
+}
+
+void JsonWriter::string_begin(size_t length) {
+  begin_value();
+  if (options_.binary == BinaryMode::Escape) {
+    string_state_ = StringState::Escaped;
+    put('"');
+  } else if (length <= MaxBufferedString) {
+    string_state_ = StringState::Buffered;
+    pending_.clear();
+  } else {
+    string_state_ = options_.binary == BinaryMode::Hex ? StringState::Hex : StringState::Base64;
+    carry_size_ = 0;
+    put('"');
+  }
+}
+
+void JsonWriter::string_chunk(std::string_view data) {
+  switch (string_state_) {
+    case StringState::Escaped:
+      write_escaped(data, false);
+      break;
+    case StringState::Buffered:
+      pending_.append(data);
+      break;
+    case StringState::Hex:
+      write_hex(data);
+      break;
+    case StringState::Base64:
+      write_base64(data);
+      break;
+  }
+}
+
+void JsonWriter::string_end() {
+  switch (string_state_) {
+    case StringState::Buffered:
+      write_quoted(pending_);
+      break;
+    case StringState::Base64:
+      finish_base64();
+      put('"');
+      break;
+    default:
+      put('"');
+      break;
+  }
+  end_value();
+}
+
+}
@@ -0,0 +1,141 @@
+#include <albert/bencode/lazy.hpp>
+
+#include <albert/bencode/parser.hpp>
+
+namespace albert::bencoding {
+
+LazyNode::LazyNode(std::shared_ptr<const Buffer> data, size_t offset, size_t size)
+    :data_(std::move(data)), offset_(offset), size_(size) {
+  switch ((*data_)[offset_]) {
+    case 'i':
+      type_ = Type::Int;
+      break;
+    case 'l':
+      type_ = Type::List;
+      break;
+    case 'd':
+      type_ = Type::Dict;
+      break;
+    default:
+      type_ = Type::String;
+      break;
+  }
+}
+
+LazyNode LazyNode::decode(Buffer data) {
+  return decode(std::make_shared<const Buffer>(std::move(data)));
+}
+
+LazyNode LazyNode::decode(std::shared_ptr<const Buffer> data) {
+  // Only find where the value ends, which also validates all of it
+  Parser parser(*data);
+  parser.skip();
+  return LazyNode(std::move(data), 0, parser.offset());
+}
+
+gsl::span<const uint8_t> LazyNode::raw() const {
+  if (!data_) {
+    return {};
+  }
+  return gsl::span<const uint8_t>(*data_).subspan(offset_, size_);
+}
+
+std::string_view LazyNode::as_string() const {
+  if (!is_string()) {
+    throw std::invalid_argument("bencoding::LazyNode is not a string");
+  }
+  Parser parser(raw());
+  parser.next();
+  return parser.string();
+}
+
+int64_t LazyNode::as_int() const {
+  if (!is_int()) {
+    throw std::invalid_argument("bencoding::LazyNode is not an int");
+  }
+  Parser parser(raw());
+  parser.next();
+  return parser.integer();
+}
+
+// Call f(key, child) for each child until it returns false, key is empty for list items
+template <typename F>
+void LazyNode::for_each_child(F &&f) const {
+  if (!is_list() && !is_dict()) {
+    return;
+  }
+  Parser parser(raw());
+  parser.next();
+  while (true) {
+    auto token = parser.next();
+    if (token == Token::End) {
+      break;
+    }
+    std::string_view key;
+    if (is_dict()) {
+      key = parser.string();
+      token = parser.next();
+    }
+    auto start = parser.token_offset();
+    parser.skip(token);
+    if (!f(key, LazyNode(data_, offset_ + start, parser.offset() - start))) {
+      break;
+    }
+  }
+}
+
+std::vector<LazyNode> LazyNode::items() const {
+  std::vector<LazyNode> ret;
+  for_each_child([&ret](std::string_view, LazyNode node) {
+    ret.emplace_back(std::move(node));
+    return true;
+  });
+  return ret;
+}
+
+std::vector<std::pair<std::string_view, LazyNode>> LazyNode::entries() const {
+  std::vector<std::pair<std::string_view, LazyNode>> ret;
+  for_each_child([&ret](std::string_view key, LazyNode node) {
+    ret.emplace_back(key, std::move(node));
+    return true;
+  });
+  return ret;
+}
+
+size_t LazyNode::size() const {
+  size_t ret = 0;
+  for_each_child([&ret](std::string_view, const LazyNode &) {
+    ret++;
+    return true;
+  });
+  return ret;
+}
+
+std::optional<LazyNode> LazyNode::find(std::string_view key) const {
+  std::optional<LazyNode> ret;
+  if (is_dict()) {
+    for_each_child([&ret, key](std::string_view k, LazyNode node) {
+      if (k == key) {
+        ret = std::move(node);
+        return false;
+      }
+      return true;
+    });
+  }
+  return ret;
+}
+
+std::shared_ptr<Node> LazyNode::materialize() const {
+  return Node::decode(raw());
+}
+
+void LazyNode::encode(std::ostream &os, EncodeMode mode, size_t depth) const {
+  if (mode == EncodeMode::Bencoding) {
+    auto data = raw();
+    os.write(reinterpret_cast<const char*>(data.data()), data.size());
+  } else {
+    materialize()->encode(os, mode, depth);
+  }
+}
+
+}
@@ -0,0 +1,231 @@
+#include <albert/bencode/parser.hpp>
+
+#include <limits>
+
+namespace albert::bencoding {
+
+void Parser::fail(const std::string &reason, size_t offset) const {
+  throw ParseError(reason, offset);
+}
+
+void Parser::push(bool is_dict) {
+  if (depth_ >= MaxDepth) {
+    fail("Nesting too deep, max depth " + std::to_string(MaxDepth), offset_);
+  }
+  uint64_t bit = uint64_t(1) << depth_;
+  if (is_dict) {
+    dict_bits_ |= bit;
+    key_bits_ |= bit;
+  } else {
+    dict_bits_ &= ~bit;
+    key_bits_ &= ~bit;
+  }
+  depth_++;
+}
+
+int64_t Parser::parse_integer(char terminator) {
+  auto start = offset_;
+  bool negative = false;
+  if (offset_ < data_.size() && data_[offset_] == '-') {
+    negative = true;
+    offset_++;
+  }
+  uint64_t value = 0;
+  // The magnitude of INT64_MIN is one more than INT64_MAX
+  const uint64_t limit = uint64_t(std::numeric_limits<int64_t>::max()) + (negative ? 1u : 0u);
+  auto digits_start = offset_;
+  while (offset_ < data_.size() && data_[offset_] >= '0' && data_[offset_] <= '9') {
+    uint64_t digit = data_[offset_] - '0';
+    if (value > (limit - digit) / 10) {
+      fail("Integer overflow", start);
+    }
+    value = value * 10 + digit;
+    offset_++;
+  }
+  if (offset_ == digits_start) {
+    fail("Invalid integer, no digits", start);
+  }
+  if (offset_ >= data_.size()) {
+    fail("Unexpected EOF in integer", offset_);
+  }
+  if (data_[offset_] != terminator) {
+    fail(std::string("Invalid integer, expected '") + terminator + "'", offset_);
+  }
+  offset_++;
+  return negative ? int64_t(0 - value) : int64_t(value);
+}
+
+Token Parser::peek() const {
+  if (done()) {
+    return Token::Eof;
+  }
+  if (offset_ >= data_.size()) {
+    return Token::Eof;
+  }
+  switch (data_[offset_]) {
+    case 'i': return Token::Int;
+    case 'l': return Token::ListBegin;
+    case 'd': return Token::DictBegin;
+    case 'e': return Token::End;
+    default: {
+      if (data_[offset_] >= '0' && data_[offset_] <= '9') {
+        return Token::String;
+      }
+      fail("Unexpected character", offset_);
+    }
+  }
+}
+
+Token Parser::next() {
+  if (done()) {
+    return Token::Eof;
+  }
+  token_offset_ = offset_;
+  if (offset_ >= data_.size()) {
+    if (depth_ > 0) {
+      fail("Unexpected EOF, " + std::to_string(depth_) + " containers not closed", offset_);
+    }
+    fail("Unexpected EOF, empty input", offset_);
+  }
+  started_ = true;
+
+  auto ch = data_[offset_];
+  if (ch == 'e') {
+    if (depth_ == 0) {
+      fail("Unexpected 'e' at top level", offset_);
+    }
+    if (in_dict() && !expecting_key()) {
+      fail("Dict key without value", offset_);
+    }
+    offset_++;
+    depth_--;
+    return Token::End;
+  }
+
+  bool key = expecting_key();
+  if (key && !(ch >= '0' && ch <= '9')) {
+    fail("Dict key is not a string", offset_);
+  }
+  if (in_dict()) {
+    flip_key_bit();
+  }
+
+  switch (ch) {
+    case 'i': {
+      offset_++;
+      integer_ = parse_integer('e');
+      return Token::Int;
+    }
+    case 'l': {
+      offset_++;
+      push(false);
+      return Token::ListBegin;
+    }
+    case 'd': {
+      offset_++;
+      push(true);
+      return Token::DictBegin;
+    }
+    default: {
+      if (!(ch >= '0' && ch <= '9')) {
+        fail("Unexpected character", offset_);
+      }
+      auto length = parse_integer(':');
+      if (uint64_t(length) > data_.size() - offset_) {
+        fail("String length " + std::to_string(length) + " exceeds input", token_offset_);
+      }
+      string_ = std::string_view(reinterpret_cast<const char*>(data_.data()) + offset_, length);
+      offset_ += length;
+      return Token::String;
+    }
+  }
+}
+
+void Parser::skip() {
+  auto d = depth_;
+  auto token = next();
+  if (token == Token::End || token == Token::Eof) {
+    fail("Expected a value", token_offset_);
+  }
+  while (depth_ > d) {
+    next();
+  }
+}
+void Parser::skip(Token first) {
+  if (first == Token::End || first == Token::Eof) {
+    fail("Expected a value", token_offset_);
+  }
+  if (first == Token::ListBegin || first == Token::DictBegin) {
+    auto d = depth_;
+    while (depth_ >= d) {
+      next();
+    }
+  }
+}
+
+std::string_view Parser::read_string() {
+  if (next() != Token::String) {
+    fail("Expected a string", token_offset_);
+  }
+  return string_;
+}
+int64_t Parser::read_integer() {
+  if (next() != Token::Int) {
+    fail("Expected an integer", token_offset_);
+  }
+  return integer_;
+}
+void Parser::read_list_begin() {
+  if (next() != Token::ListBegin) {
+    fail("Expected a list", token_offset_);
+  }
+}
+void Parser::read_dict_begin() {
+  if (next() != Token::DictBegin) {
+    fail("Expected a dict", token_offset_);
+  }
+}
+
+static std::shared_ptr<Node> build_node(Parser &parser, Token token) {
+  switch (token) {
+    case Token::String:
+      return std::make_shared<StringNode>(std::string(parser.string()));
+    case Token::Int:
+      return std::make_shared<IntNode>(parser.integer());
+    case Token::ListBegin: {
+      std::vector<std::shared_ptr<Node>> list;
+      for (auto t = parser.next(); t != Token::End; t = parser.next()) {
+        list.push_back(build_node(parser, t));
+      }
+      return std::make_shared<ListNode>(std::move(list));
+    }
+    case Token::DictBegin: {
+      std::map<std::string, std::shared_ptr<Node>> dict;
+      while (parser.next() != Token::End) {
+        std::string key(parser.string());
+        dict[key] = build_node(parser, parser.next());
+      }
+      return std::make_shared<DictNode>(std::move(dict));
+    }
+    default:
+      throw ParseError("Expected a value", parser.token_offset());
+  }
+}
+
+std::shared_ptr<Node> Node::decode(Parser &parser) {
+  return build_node(parser, parser.next());
+}
+
+std::shared_ptr<Node> Node::decode(gsl::span<const uint8_t> data) {
+  Parser parser(data);
+  return decode(parser);
+}
+
+std::shared_ptr<Node> Node::decode(gsl::span<const uint8_t> data, size_t &consumed) {
+  Parser parser(data);
+  auto node = decode(parser);
+  consumed = parser.offset();
+  return node;
+}
+
+}
@@ -0,0 +1,184 @@
+#include <albert/bencode/visitor.hpp>
+
+#include <algorithm>
+#include <limits>
+
+namespace albert::bencoding {
+
+void StreamDecoder::fail(const std::string &reason, size_t offset) const {
+  throw ParseError(reason, offset);
+}
+
+void StreamDecoder::accumulate_digit(uint8_t ch) {
+  uint64_t digit = ch - '0';
+  // The magnitude of INT64_MIN is one more than INT64_MAX
+  const uint64_t limit = uint64_t(std::numeric_limits<int64_t>::max()) + (negative_ ? 1u : 0u);
+  if (number_ > (limit - digit) / 10) {
+    fail("Integer overflow", token_offset_);
+  }
+  number_ = number_ * 10 + digit;
+  has_digits_ = true;
+}
+
+void StreamDecoder::begin_value(uint8_t ch) {
+  if (ch == 'e') {
+    if (depth_ == 0) {
+      fail("Unexpected 'e' at top level", token_offset_);
+    }
+    if (in_dict() && !expecting_key()) {
+      fail("Dict key without value", token_offset_);
+    }
+    depth_--;
+    visitor_.end();
+    end_value();
+    return;
+  }
+
+  bool key = expecting_key();
+  bool digit = ch >= '0' && ch <= '9';
+  if (key && !digit) {
+    fail("Dict key is not a string", token_offset_);
+  }
+  if (in_dict()) {
+    key_bits_ ^= (uint64_t(1) << (depth_ - 1));
+  }
+
+  if (ch == 'i' || digit) {
+    state_ = ch == 'i' ? State::Integer : State::Length;
+    number_ = 0;
+    negative_ = false;
+    has_digits_ = false;
+    is_key_ = key;
+    if (digit) {
+      accumulate_digit(ch);
+    }
+  } else if (ch == 'l' || ch == 'd') {
+    if (depth_ >= MaxDepth) {
+      fail("Nesting too deep, max depth " + std::to_string(MaxDepth), token_offset_);
+    }
+    uint64_t bit = uint64_t(1) << depth_;
+    if (ch == 'd') {
+      dict_bits_ |= bit;
+      key_bits_ |= bit;
+    } else {
+      dict_bits_ &= ~bit;
+      key_bits_ &= ~bit;
+    }
+    depth_++;
+    if (ch == 'd') {
+      visitor_.begin_dict();
+    } else {
+      visitor_.begin_list();
+    }
+  } else {
+    fail("Unexpected character", token_offset_);
+  }
+}
+
+void StreamDecoder::end_value() {
+  state_ = depth_ == 0 ? State::Done : State::Value;
+}
+
+size_t StreamDecoder::feed(gsl::span<const uint8_t> data) {
+  size_t i = 0;
+  while (i < data.size() && state_ != State::Done) {
+    if (state_ == State::Value) {
+      token_offset_ = offset_;
+      offset_++;
+      begin_value(data[i++]);
+    } else if (state_ == State::String) {
+      auto n = std::min(remaining_, data.size() - i);
+      std::string_view chunk(reinterpret_cast<const char*>(data.data()) + i, n);
+      i += n;
+      offset_ += n;
+      remaining_ -= n;
+      if (is_key_) {
+        if (remaining_ == 0 && key_.empty()) {
+          // The whole key is in this chunk, no copy
+          state_ = State::Value;
+          visitor_.key(chunk);
+        } else {
+          key_.append(chunk);
+          if (remaining_ == 0) {
+            state_ = State::Value;
+            visitor_.key(key_);
+          }
+        }
+      } else {
+        visitor_.string_chunk(chunk);
+        if (remaining_ == 0) {
+          visitor_.string_end();
+          end_value();
+        }
+      }
+    } else {
+      // State::Integer or State::Length
+      auto ch = data[i++];
+      offset_++;
+      char terminator = state_ == State::Integer ? 'e' : ':';
+      if (ch >= '0' && ch <= '9') {
+        accumulate_digit(ch);
+      } else if (ch == '-' && state_ == State::Integer && !has_digits_ && !negative_) {
+        negative_ = true;
+      } else if (ch == terminator && has_digits_) {
+        if (state_ == State::Integer) {
+          visitor_.integer(negative_ ? int64_t(0 - number_) : int64_t(number_));
+          end_value();
+        } else if (is_key_) {
+          if (number_ > MaxKeyLength) {
+            fail("Dict key longer than " + std::to_string(MaxKeyLength) + " bytes", token_offset_);
+          }
+          key_.clear();
+          remaining_ = number_;
+          state_ = State::String;
+          if (remaining_ == 0) {
+            state_ = State::Value;
+            visitor_.key({});
+          }
+        } else {
+          remaining_ = number_;
+          state_ = State::String;
+          visitor_.string_begin(remaining_);
+          if (remaining_ == 0) {
+            visitor_.string_end();
+            end_value();
+          }
+        }
+      } else if (!has_digits_) {
+        fail("Invalid integer, no digits", token_offset_);
+      } else {
+        fail(std::string("Invalid integer, expected '") + terminator + "'", offset_ - 1);
+      }
+    }
+  }
+  return i;
+}
+
+void StreamDecoder::finish() const {
+  if (state_ == State::Done) {
+    return;
+  }
+  if (offset_ == 0) {
+    fail("Unexpected EOF, empty input", offset_);
+  }
+  if (depth_ > 0) {
+    fail("Unexpected EOF, " + std::to_string(depth_) + " containers not closed", offset_);
+  }
+  fail("Unexpected EOF", offset_);
+}
+
+void StreamDecoder::reset() {
+  state_ = State::Value;
+  depth_ = 0;
+  dict_bits_ = 0;
+  key_bits_ = 0;
+}
+
+size_t visit(gsl::span<const uint8_t> data, Visitor &visitor) {
+  StreamDecoder decoder(visitor);
+  auto used = decoder.feed(data);
+  decoder.finish();
+  return used;
+}
+
+}
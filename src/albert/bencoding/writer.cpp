@@ -0,0 +1,41 @@
+#include <albert/bencode/writer.hpp>
+
+namespace albert::bencoding {
+
+// Format n in decimal right aligned into out[0, digits)
+static void write_decimal(uint8_t *out, size_t digits, uint64_t n) {
+  for (size_t i = digits; i > 0; i--) {
+    out[i - 1] = '0' + (n % 10);
+    n /= 10;
+  }
+}
+
+Writer &Writer::string_header(size_t length) {
+  auto digits = decimal_digits(length);
+  auto p = reserve(digits + 1);
+  write_decimal(p, digits, length);
+  p[digits] = ':';
+  return *this;
+}
+
+Writer &Writer::integer(int64_t i) {
+  auto size = integer_size(i);
+  auto p = reserve(size);
+  p[0] = 'i';
+  if (i < 0) {
+    p[1] = '-';
+    write_decimal(p + 2, size - 3, 0 - uint64_t(i));
+  } else {
+    write_decimal(p + 1, size - 2, uint64_t(i));
+  }
+  p[size - 1] = 'e';
+  return *this;
+}
+
+void Writer::overflow(size_t size) const {
+  throw WriterOverflow(
+      "bencoding::Writer overflow, writing " + std::to_string(size) + " bytes, " +
+      std::to_string(size_) + "/" + std::to_string(buffer_.size()) + " used");
+}
+
+}
@@ -20,12 +20,12 @@ BT::BT(boost::asio::io_service &io, Config config)
 
 std::weak_ptr<TorrentResolver> albert::bt::BT::resolve_torrent(
     const u160::U160 &info_hash,
-    std::function<void(const bencoding::DictNode &)> handler) {
+    std::function<void(const bencoding::LazyNode &)> handler) {
   if (resolvers_.find(info_hash) == resolvers_.end()) {
     auto bind_ip = boost::asio::ip::address_v4::from_string(config_.bind_ip).to_uint();
     auto resolver = std::make_shared<TorrentResolver>(io_, info_hash, self_, bind_ip, config_.bind_port, config_.use_utp,
         std::chrono::high_resolution_clock::now() + expiration_time_);
-    resolver->set_torrent_handler([h{std::move(handler)}, info_hash, this](const bencoding::DictNode &torrent) {
+    resolver->set_torrent_handler([h{std::move(handler)}, info_hash, this](const bencoding::LazyNode &torrent) {
       h(torrent);
       LOG(info) << "Torrent finished, deleting resolver";
       if (resolvers_.find(info_hash) != resolvers_.end()) {
@@ -83,9 +83,9 @@ size_t BT::peer_count() const {
   return n;
 }
 size_t BT::memory_size() const {
-  auto ret = sizeof(BT);
+  auto ret = sizeof(BT) + resolvers_.memory_size();
   for (auto &item : resolvers_) {
-    ret += sizeof(item.first) + item.second->memory_size();
+    ret += item.second->memory_size();
   }
   return ret;
 }
@@ -13,6 +13,9 @@
 #include <boost/bind.hpp>
 
 #include <albert/bencode/bencoding.hpp>
+#include <albert/bencode/parser.hpp>
+#include <albert/bencode/schema.hpp>
+#include <albert/bencode/writer.hpp>
 #include <albert/bt/bt.hpp>
 #include <albert/bt/peer.hpp>
 #include <albert/log/log.hpp>
@@ -23,52 +26,7 @@
 using boost::asio::ip::tcp;
 using boost::asio::ip::udp;
 
-namespace {
-
-using bdict = std::map<std::string, std::shared_ptr<albert::bencoding::Node>>;
-auto newdict(const bdict &dic) {
-  return std::make_shared<albert::bencoding::DictNode>(dic);
-};
-auto newint(int64_t i) {
-  return std::make_shared<albert::bencoding::IntNode>(i);
-};
-
-}
-
 namespace albert::bt::peer {
-static std::string get_string_or_throw(
-    const std::map<std::string, std::shared_ptr<bencoding::Node>> &dict, const std::string &key, const std::string &context) {
-  if (dict.find(key) == dict.end()) {
-    throw InvalidPeerMessage(context + ", '" + key + "' not found");
-  }
-  auto node = std::dynamic_pointer_cast<bencoding::StringNode>(dict.at(key));
-  if (!node) {
-    throw InvalidPeerMessage(context + ", '" + key + "' is not a string");
-  }
-  return *node;
-}
-static int64_t get_int64_or_throw(
-    const std::map<std::string, std::shared_ptr<bencoding::Node>> &dict, const std::string &key, const std::string &context) {
-  if (dict.find(key) == dict.end()) {
-    throw InvalidPeerMessage(context + ", '" + key + "' not found");
-  }
-  auto node = std::dynamic_pointer_cast<bencoding::IntNode>(dict.at(key));
-  if (!node) {
-    throw InvalidPeerMessage(context + ", '" + key + "' is not a int");
-  }
-  return *node;
-}
-static std::map<std::string, std::shared_ptr<bencoding::Node>> get_dict_or_throw(
-    const std::map<std::string, std::shared_ptr<bencoding::Node>> &dict, const std::string &key, const std::string &context) {
-  if (dict.find(key) == dict.end()) {
-    throw InvalidPeerMessage(context + ", '" + key + "' not found");
-  }
-  auto node = std::dynamic_pointer_cast<bencoding::DictNode>(dict.at(key));
-  if (!node) {
-    throw InvalidPeerMessage(context + ", '" + key + "' is not a int");
-  }
-  return node->dict();
-}
 namespace {
 std::string make_message(uint8_t type, const uint8_t *data, size_t size) {
   std::stringstream ss;
@@ -83,12 +41,13 @@ std::string make_message(uint8_t type, const uint8_t *data, size_t size) {
   }
   return ss.str();
 }
-std::string make_extended(const bencoding::Node &payload, uint8_t extended_id) {
-  std::stringstream ss;
-  ss.put(extended_id);
-  payload.encode(ss);
-  auto s = ss.str();
-  return make_message(MessageTypeExtended, (const uint8_t*)s.data(), s.size());
+template <typename T>
+std::string make_extended(const T &payload, uint8_t extended_id) {
+  std::array<uint8_t, 1024> buffer{};
+  bencoding::Writer w(buffer);
+  w.raw(&extended_id, sizeof(extended_id));
+  bencoding::schema::encode(w, payload);
+  return make_message(MessageTypeExtended, w.written().data(), w.size());
 }
 std::string make_empty_message(uint8_t message_type) {
   std::stringstream ss;
@@ -215,22 +174,16 @@ void PeerConnection::send_handshake() {
         }
       });
 
-  auto m = bdict();
+  // extended handshake
+  ExtendedHandshake handshake;
   for (auto &item : extended_message_id_) {
-    m[item.second] = std::make_shared<bencoding::IntNode>(item.first);
+    handshake.m[item.second] = item.first;
   }
-  // extended handshake
-  bencoding::DictNode node(
-      bdict({
-                {
-                    "m", newdict(m)
-                },
-                {"p", newint(6881)},
-                {"reqq", newint(500)},
-                {"v", std::make_shared<bencoding::StringNode>("wtf/0.0")}
-            }));
+  handshake.p = 6881;
+  handshake.reqq = 500;
+  handshake.v = "wtf/0.0";
   socket_->async_send(
-      boost::asio::buffer(make_extended(node, 0)),
+      boost::asio::buffer(make_extended(handshake, 0)),
       [pc_weak = weak_from_this()](const boost::system::error_code &err, size_t bytes_transferred) {
         if (err) {
           auto pc = pc_weak.lock();
@@ -286,20 +239,7 @@ void PeerConnection::handle_message(uint8_t type, gsl::span<uint8_t> data) {
   } else if (type == MessageTypeExtended) {
     if (data.size() > 0) {
       uint8_t extended_id = data[0];
-      auto content_size = data.size() - 1;
-      std::stringstream ss(std::string((const char*)data.data() + 1, content_size));
-      auto node = bencoding::Node::decode(ss);
-
-      std::istreambuf_iterator<char> eos;
-      std::string rest(std::istreambuf_iterator<char>(ss), eos);
-      std::vector<uint8_t> appended_data(rest.size());
-      std::copy(rest.begin(), rest.end(), appended_data.begin());
-      if (auto dict = std::dynamic_pointer_cast<bencoding::DictNode>(node); dict) {
-        handle_extended_message(extended_id, dict, appended_data);
-      } else {
-        LOG(error) << "Invalid extended message, root node is not a dict. Closing connection";
-        close();
-      }
+      handle_extended_message(extended_id, gsl::span<const uint8_t>(data.data() + 1, data.size() - 1));
     } else {
       LOG(error) << "PeerConnection: Invalid extended message, expected size";
       close();
@@ -309,21 +249,18 @@ void PeerConnection::handle_message(uint8_t type, gsl::span<uint8_t> data) {
   }
 }
 
-void PeerConnection::handle_extended_message(
-    uint8_t extended_id,
-    std::shared_ptr<bencoding::DictNode> msg,
-    const std::vector<uint8_t> &appended_data
-    ) {
-  auto &dict = msg->dict();
+void PeerConnection::handle_extended_message(uint8_t extended_id, gsl::span<const uint8_t> content) {
+  bencoding::Parser parser(content);
   if (extended_id == 0) {
     // extended handshake
-    std::stringstream ss;
-    msg->encode(ss, bencoding::EncodeMode::JSON);
-    extended_handshake_ = msg;
-
-    auto total_size = get_int64_or_throw(dict, "metadata_size", "ut_metadata");
-    m_dict_ = get_dict_or_throw(dict, "m", "ut_metadata");
+    ExtendedHandshake handshake;
+    bencoding::schema::decode(parser, handshake);
+    if (!handshake.metadata_size) {
+      throw InvalidPeerMessage("ut_metadata, 'metadata_size' not found");
+    }
+    auto total_size = *handshake.metadata_size;
     piece_count_ = ceil(double(total_size) / MetadataPieceSize);
+    extended_handshake_ = std::move(handshake);
 
     if (piece_count_ <= 0) {
       throw InvalidPeerMessage("piece count cannot <= zero");
@@ -336,7 +273,7 @@ void PeerConnection::handle_extended_message(
 
     LOG(debug) << "Extended handshake: from " << peer_->to_string() << std::endl
                << "total pieces: " << piece_count_
-               << "data: " << ss.str();
+               << ", client: '" << extended_handshake_->v << "'";
 
   } else {
     if (extended_message_id_.find(extended_id) == extended_message_id_.end()) {
@@ -344,14 +281,17 @@ void PeerConnection::handle_extended_message(
     } else {
       auto message_type = extended_message_id_[extended_id];
       if (message_type == "ut_metadata") {
-        auto msg_type = get_int64_or_throw(dict, "msg_type", "ut_metadata");
-        if (msg_type == ExtendedMessageTypeRequest) {
+        UtMetadataMessage msg;
+        bencoding::schema::decode(parser, msg);
+        if (msg.msg_type == ExtendedMessageTypeRequest) {
           LOG(error) << "msg_type request not implemented";
-        } else if (msg_type == ExtendedMessageTypeData) {
-          auto piece = get_int64_or_throw(dict, "piece", "ut_metadata");
-//          auto total_size = get_int64_or_throw(dict, "total_size", "ut_metadata");
-          piece_data_handler_(piece, appended_data);
-        } else if (msg_type == ExtendedMessageTypeReject) {
+        } else if (msg.msg_type == ExtendedMessageTypeData) {
+          if (!msg.piece) {
+            throw InvalidPeerMessage("ut_metadata, 'piece' not found");
+          }
+          auto rest = parser.remaining();
+          piece_data_handler_(*msg.piece, std::vector<uint8_t>(rest.begin(), rest.end()));
+        } else if (msg.msg_type == ExtendedMessageTypeReject) {
           LOG(error) << "msg_type reject not implemented";
         } else {
           LOG(error) << "unknown msg_type";
@@ -404,10 +344,10 @@ void PeerConnection::handle_receive(const boost::system::error_code &err, size_t
           read_ring_.pop_data(&received_handshake_, sizeof(Handshake));
           std::stringstream ss(
           std::string((char *) &received_handshake_.sender_id,
-                      sizeof(u160::U160)));
+                      u160::U160Length));
           peer_id_ = u160::U160::decode(ss);
           handshake_completed_ = true;
-          auto ss1 = std::stringstream(std::string((char *) &received_handshake_.sender_id, sizeof(u160::U160)));
+          auto ss1 = std::stringstream(std::string((char *) &received_handshake_.sender_id, u160::U160Length));
           auto received_info_hash = u160::U160::decode(ss1);
 //            if (received_info_hash != target_) {
 //              LOG(error) << "Peer info_hash not matched, closing connection. target: " << target_.to_string() << ", peer: " << received_info_hash.to_string();
@@ -479,23 +419,15 @@ void PeerConnection::send_metadata_request(int64_t piece) {
     throw InvalidStatus("Cannot send metadata request before receiving extended handshake");
   } else {
     if (!has_peer_extended_message(MetadataMessage)) {
-      throw InvalidStatus("Peer(" + peer_->to_string() + ") does not support metadata message");
+      throw InvalidPeerMessage("Peer(" + peer_->to_string() + ") does not support metadata message");
     } else {
       auto extended_id = get_peer_extended_message_id(MetadataMessage);
       // extended message
-      bencoding::DictNode node(
-          bdict({
-                    {
-                        "msg_type",
-                        newint(ExtendedMessageTypeRequest),
-                    },
-                    {
-                        "piece",
-                        newint(piece),
-                    }
-                }));
+      UtMetadataMessage msg;
+      msg.msg_type = ExtendedMessageTypeRequest;
+      msg.piece = piece;
       socket_->async_send(
-          boost::asio::buffer(make_extended(node, extended_id)),
+          boost::asio::buffer(make_extended(msg, extended_id)),
           [pc_weak = weak_from_this()](const boost::system::error_code &err, size_t bytes_transferred) {
             if (err) {
               auto pc = pc_weak.lock();
@@ -511,7 +443,11 @@ void PeerConnection::send_metadata_request(int64_t piece) {
   }
 }
 uint8_t PeerConnection::get_peer_extended_message_id(const std::string &message_name) {
-  return get_int64_or_throw(m_dict_, message_name, "PeerConenction::get_peer_extended_message_id");
+  auto it = extended_handshake_->m.find(message_name);
+  if (it == extended_handshake_->m.end()) {
+    throw InvalidPeerMessage("PeerConenction::get_peer_extended_message_id, '" + message_name + "' not found");
+  }
+  return it->second;
 }
 
 void PeerConnection::close() {
@@ -520,7 +456,7 @@ void PeerConnection::close() {
 }
 
 uint8_t PeerConnection::has_peer_extended_message(const std::string &message_name) const {
-  return extended_handshake_->dict().find(message_name) == extended_handshake_->dict().end();
+  return extended_handshake_->m.find(message_name) != extended_handshake_->m.end();
 }
 
 void PeerConnection::start_metadata_transfer(
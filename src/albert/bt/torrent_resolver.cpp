@@ -9,6 +9,8 @@
 #include <boost/bind/bind.hpp>
 
 #include <albert/bencode/bencoding.hpp>
+#include <albert/bencode/lazy.hpp>
+#include <albert/bencode/parser.hpp>
 #include <albert/bt/peer.hpp>
 #include <albert/bt/peer_connection.hpp>
 #include <albert/krpc/krpc.hpp>
@@ -17,6 +19,17 @@
 
 namespace albert::bt {
 
+bencoding::LazyNode make_torrent(gsl::span<const uint8_t> info) {
+  // d8:announcede4:info<info>e
+  const std::string_view head = "d8:announcede4:info";
+  bencoding::LazyNode::Buffer data;
+  data.reserve(head.size() + info.size() + 1);
+  data.insert(data.end(), head.begin(), head.end());
+  data.insert(data.end(), info.begin(), info.end());
+  data.push_back('e');
+  return bencoding::LazyNode::decode(std::move(data));
+}
+
 std::mutex TorrentResolver::pointers_lock_;
 std::set<TorrentResolver*> TorrentResolver::pointers_;
 
@@ -123,12 +136,7 @@ void TorrentResolver::piece_handler(wp<peer::PeerConnection> pc, int piece, cons
     auto info_data = merged_pieces();
     auto calculated_hash = u160::U160::hash(info_data.data(), info_data.size());
     if (calculated_hash == info_hash_) {
-      std::stringstream ss(std::string((const char*)info_data.data(), info_data.size()));
-      auto info = bencoding::Node::decode(ss);
-      std::map<std::string, std::shared_ptr<bencoding::Node>> dict;
-      dict["announce"] = std::make_shared<bencoding::DictNode>(std::map<std::string, std::shared_ptr<bencoding::Node>>());
-      dict["info"] = info;
-      bencoding::DictNode torrent(std::move(dict));
+      auto torrent = make_torrent(info_data);
       if (torrent_handler_) {
         torrent_handler_(torrent);
         // TODO: this will cause SEGV?
@@ -156,7 +164,7 @@ std::vector<uint8_t> TorrentResolver::merged_pieces() const {
 bool TorrentResolver::finished() const {
   return data_got() == metadata_size_;
 }
-void TorrentResolver::set_torrent_handler(std::function<void(const bencoding::DictNode &torrent)> handler) {
+void TorrentResolver::set_torrent_handler(std::function<void(const bencoding::LazyNode &torrent)> handler) {
   torrent_handler_ = std::move(handler);
 }
 void TorrentResolver::handshake_handler(wp<peer::PeerConnection> weak_pc, int total_pieces, size_t metadata_size) {
@@ -96,7 +96,7 @@ void CommandLineUI::start_search() {
   this->is_searching_ = true;
   auto ih = u160::U160::from_hex(target_info_hash_);
 
-  auto resolver = bt_.resolve_torrent(ih, [this, ih](const bencoding::DictNode &torrent) {
+  auto resolver = bt_.resolve_torrent(ih, [this, ih](const bencoding::LazyNode &torrent) {
     is_searching_ = false;
     auto file_name = ih.to_string() + ".torrent";
     std::ofstream f(file_name, std::ios::binary);
@@ -1,47 +1,238 @@
 #include <albert/dht/blacklist.hpp>
 
-#include <list>
+#include <algorithm>
+#include <bit>
+
+#include <albert/common/coarse_clock.hpp>
 
 namespace albert::dht {
 
-bool Blacklist::add(Blacklist::KeyType endpoint) {
-  if (items_.size() >= max_size_) {
+Blacklist::Blacklist(size_t max_size, std::chrono::microseconds duration, size_t subnet_threshold)
+    : max_size_(std::max<size_t>(max_size, 1)),
+      duration_seconds_(std::chrono::duration_cast<std::chrono::seconds>(duration).count()),
+      subnet_threshold_(subnet_threshold),
+      // 8 bits per record, the false positive rate is a few percent with 3 bits per key
+      filter_(std::bit_ceil(std::max<size_t>(max_size_ / 8, 1))),
+      records_(std::bit_ceil(max_size_ * 2)) { }
+
+uint64_t Blacklist::hash(uint64_t key) {
+  // Finalizer of MurmurHash3
+  key ^= key >> 33u;
+  key *= 0xff51afd7ed558ccdull;
+  key ^= key >> 33u;
+  key *= 0xc4ceb9fe1a85ec53ull;
+  key ^= key >> 33u;
+  return key;
+}
+
+uint32_t Blacklist::now_seconds() {
+  return std::chrono::duration_cast<std::chrono::seconds>(common::CoarseClock::now().time_since_epoch()).count();
+}
+
+uint64_t Blacklist::filter_mask(uint64_t h) {
+  // The low bits pick the word, three 6 bit fields of the high bits pick the bits
+  return (uint64_t(1) << ((h >> 40u) & 63u)) |
+      (uint64_t(1) << ((h >> 46u) & 63u)) |
+      (uint64_t(1) << ((h >> 52u) & 63u));
+}
+
+bool Blacklist::may_contain(uint64_t key) const {
+  auto h = hash(key);
+  auto mask = filter_mask(h);
+  return (filter_[h & (filter_.size() - 1)] & mask) == mask;
+}
+
+void Blacklist::filter_add(uint64_t key) {
+  auto h = hash(key);
+  filter_[h & (filter_.size() - 1)] |= filter_mask(h);
+}
+
+void Blacklist::rebuild_filter() {
+  std::fill(filter_.begin(), filter_.end(), 0);
+  for (auto &record : records_) {
+    if (record.key != 0 && (!is_subnet(record.key) || record.banned)) {
+      filter_add(record.key & ~Occupied);
+    }
+  }
+  filter_stale_ = 0;
+}
+
+size_t Blacklist::find(uint64_t key) const {
+  auto mask = records_.size() - 1;
+  for (size_t i = hash(key) & mask;; i = (i + 1) & mask) {
+    auto stored = records_[i].key;
+    if (stored == 0) {
+      return npos;
+    }
+    if (stored == (key | Occupied)) {
+      return i;
+    }
+  }
+}
+
+size_t Blacklist::insert(uint64_t key) {
+  if (size_ >= max_size_) {
+    evict();
+  }
+  auto mask = records_.size() - 1;
+  size_t i = hash(key) & mask;
+  while (records_[i].key != 0) {
+    i = (i + 1) & mask;
+  }
+  records_[i] = {};
+  records_[i].key = key | Occupied;
+  // A new record gets one pass of the clock hand, it is not evicted by the next insert
+  records_[i].referenced = true;
+  size_++;
+  return i;
+}
+
+void Blacklist::erase(size_t slot) {
+  auto &record = records_[slot];
+  if (!is_subnet(record.key)) {
+    endpoint_count_--;
+  } else if (record.banned) {
+    subnet_count_--;
+  }
+  size_--;
+  filter_stale_++;
+
+  // Shift the records after it back, so that no probe sequence has a hole
+  auto mask = records_.size() - 1;
+  size_t hole = slot;
+  for (size_t i = (slot + 1) & mask; records_[i].key != 0; i = (i + 1) & mask) {
+    size_t home = hash(records_[i].key & ~Occupied) & mask;
+    // Movable if its home is not in (hole, i]
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      records_[hole] = records_[i];
+      hole = i;
+    }
+  }
+  records_[hole] = {};
+}
+
+void Blacklist::evict() {
+  auto mask = records_.size() - 1;
+  while (true) {
+    auto slot = clock_hand_;
+    clock_hand_ = (clock_hand_ + 1) & mask;
+    auto &record = records_[slot];
+    if (record.key == 0) {
+      continue;
+    }
+    if (record.referenced) {
+      record.referenced = false;
+      continue;
+    }
+    erase(slot);
+    return;
+  }
+}
+
+bool Blacklist::hit(uint64_t key, uint32_t now) {
+  auto slot = find(key);
+  if (slot == npos) {
+    return false;
+  }
+  auto &record = records_[slot];
+  if (now >= record.expires_at || (is_subnet(key) && !record.banned)) {
+    return false;
+  }
+  record.referenced = true;
+  return true;
+}
+
+void Blacklist::ban(size_t slot, uint32_t now) {
+  auto &record = records_[slot];
+  record.expires_at = now + duration_seconds_;
+  expirations_.emplace_back(record.key & ~Occupied, record.expires_at);
+}
+
+bool Blacklist::has(const KeyType &item) {
+  auto [ip, port] = item;
+  auto key = endpoint_key(ip, port);
+  bool endpoint = may_contain(key);
+  bool subnet = subnet_threshold_ > 0 && may_contain(subnet_key(ip));
+  if (!endpoint && !subnet) {
     return false;
   }
-  bool success = false;
-  std::tie(std::ignore, success) = items_.insert({endpoint, BlacklistItem(banning_duration_)});
-  return success;
+  auto now = now_seconds();
+  return (endpoint && hit(key, now)) || (subnet && hit(subnet_key(ip), now));
 }
 
-bool Blacklist::has(const Blacklist::KeyType &item) const {
-  auto it = items_.find(item);
-  if (it == items_.end()) {
+bool Blacklist::add(KeyType endpoint) {
+  auto [ip, port] = endpoint;
+  auto now = now_seconds();
+  auto key = endpoint_key(ip, port);
+  auto slot = find(key);
+  if (slot != npos && now < records_[slot].expires_at) {
     return false;
   }
-  return it->second.expired();
+  if (slot == npos) {
+    slot = insert(key);
+    endpoint_count_++;
+    filter_add(key);
+  }
+  ban(slot, now);
+
+  if (subnet_threshold_ > 0) {
+    auto subnet = subnet_key(ip);
+    auto subnet_slot = find(subnet);
+    if (subnet_slot == npos) {
+      subnet_slot = insert(subnet);
+    } else if (now >= records_[subnet_slot].expires_at) {
+      // Expired but not collected yet, counting starts over
+      if (records_[subnet_slot].banned) {
+        subnet_count_--;
+      }
+      records_[subnet_slot].count = 0;
+      records_[subnet_slot].banned = false;
+    }
+    auto &record = records_[subnet_slot];
+    if (record.count < UINT16_MAX) {
+      record.count++;
+    }
+    if (!record.banned && record.count >= subnet_threshold_) {
+      record.banned = true;
+      subnet_count_++;
+      filter_add(subnet);
+    }
+    ban(subnet_slot, now);
+  }
+
+  // Without a limit, the queue keeps items of records evicted and banned again
+  if (expirations_.size() > 4 * max_size_) {
+    std::erase_if(expirations_, [this](const auto &item) {
+      auto slot = find(item.first);
+      return slot == npos || records_[slot].expires_at != item.second;
+    });
+  }
+  return true;
 }
 
 size_t Blacklist::gc() {
-  std::list<KeyType> to_delete;
-  for (auto &[key, item] : items_) {
-    if (item.expired()) {
-      to_delete.push_back(key);
+  auto now = now_seconds();
+  size_t ret = 0;
+  while (!expirations_.empty() && now >= expirations_.front().second) {
+    auto [key, expires_at] = expirations_.front();
+    expirations_.pop_front();
+    auto slot = find(key);
+    if (slot != npos && records_[slot].expires_at == expires_at) {
+      erase(slot);
+      ret++;
     }
   }
-  for (auto &item : to_delete) {
-    items_.erase(item);
+  if (filter_stale_ > size_) {
+    rebuild_filter();
   }
-  return to_delete.size();
+  return ret;
 }
 
-size_t Blacklist::BlacklistHash::operator()(const Blacklist::KeyType &item) const {
-  uint32_t ip = 0;
-  uint16_t port = 0;
-  std::tie(ip, port) = item;
-  return (ip << 16u) | port;
+size_t Blacklist::memory_size() const {
+  return sizeof(*this) +
+      filter_.capacity() * sizeof(uint64_t) +
+      records_.capacity() * sizeof(Record) +
+      expirations_.size() * sizeof(std::pair<uint64_t, uint32_t>);
 }
 
-bool BlacklistItem::expired() const {
-  return std::chrono::system_clock::now() > expired_at_;
-}
 }
@@ -39,12 +39,18 @@ void Config::serialize(std::ostream &os) const {
 
   os << "info_hash_save_path = " << info_hash_save_path << std::endl;
   os << "routing_table_save_path = " << routing_table_save_path << std::endl;
+  os << "routing_table_checkpoint_interval_seconds = " << routing_table_checkpoint_interval_seconds << std::endl;
 
   os << "discovery_interval_seconds = " << discovery_interval_seconds << std::endl;
   os << "report_interval_seconds = " << report_interval_seconds << std::endl;
   os << "refresh_nodes_check_interval_seconds = " << refresh_nodes_check_interval_seconds << std::endl;
+  os << "max_node_pings_per_second = " << max_node_pings_per_second << std::endl;
   os << "get_peers_refresh_interval_seconds = " << get_peers_refresh_interval_seconds << std::endl;
   os << "get_peers_request_expiration_seconds = " << get_peers_request_expiration_seconds << std::endl;
+  os << "get_peers_alpha = " << get_peers_alpha << std::endl;
+  os << "get_peers_shortlist_size = " << get_peers_shortlist_size << std::endl;
+  os << "get_peers_max_timeouts_in_row = " << get_peers_max_timeouts_in_row << std::endl;
+  os << "get_peers_unresponsive_seconds = " << get_peers_unresponsive_seconds << std::endl;
   os << "throttler_enabled " << throttler_enabled << std::endl;
   os << "throttler_max_rps " << throttler_max_rps << std::endl;
   os << "throttler_leak_probability " << throttler_leak_probability << std::endl;
@@ -59,8 +65,12 @@ void Config::serialize(std::ostream &os) const {
   os << "fake_id_prefix_length = " << fake_id_prefix_length << std::endl;
   os << "blacklist_hours = " << blacklist_hours << std::endl;
   os << "blacklist_size = " << blacklist_size << std::endl;
+  os << "blacklist_subnet_threshold = " << blacklist_subnet_threshold << std::endl;
   os << "fat_routing_table = " << fat_routing_table << std::endl;
+  os << "flat_routing_table = " << flat_routing_table << std::endl;
   os << "transaction_expiration_seconds = " << transaction_expiration_seconds << std::endl;
+  os << "transaction_initial_timeout_ms = " << transaction_initial_timeout_ms << std::endl;
+  os << "transaction_min_timeout_ms = " << transaction_min_timeout_ms << std::endl;
   os << "# end of config." << std::endl;
 }
 
@@ -82,11 +92,17 @@ Config::Config() {
   hidden.add_options()
       ("info-hash-save-path", po::value(&info_hash_save_path)->default_value("info_hash.txt"), "Received infohashes save path")
       ("routing-table-save-path", po::value(&routing_table_save_path)->default_value("route.txt"), "Received infohashes save path")
+      ("routing-table-checkpoint-interval", po::value(&routing_table_checkpoint_interval_seconds), "")
       ("discovery-interval-seconds", po::value(&discovery_interval_seconds), "DHT discovery interval in seconds")
       ("report-interval-seconds", po::value(&report_interval_seconds), "DHT routing table report interval in seconds")
       ("refresh-nodes-check-interval", po::value(&refresh_nodes_check_interval_seconds), "")
+      ("max-node-pings-per-second", po::value(&max_node_pings_per_second), "")
       ("get-peers-refresh-interval", po::value(&get_peers_refresh_interval_seconds), "")
       ("get-peers-request-expiration", po::value(&get_peers_request_expiration_seconds), "")
+      ("get-peers-alpha", po::value(&get_peers_alpha), "")
+      ("get-peers-shortlist-size", po::value(&get_peers_shortlist_size), "")
+      ("get-peers-max-timeouts-in-row", po::value(&get_peers_max_timeouts_in_row), "")
+      ("get-peers-unresponsive-seconds", po::value(&get_peers_unresponsive_seconds), "")
       ("throttler-enabled", po::value(&throttler_enabled))
       ("throttler-leak", po::value(&throttler_leak_probability))
       ("throttler-max-rps", po::value(&throttler_max_rps))
@@ -100,8 +116,12 @@ Config::Config() {
       ("fake-id-prefix-length", po::value(&fake_id_prefix_length), "")
       ("blacklist-hours", po::value(&blacklist_hours), "")
       ("blacklist-size", po::value(&blacklist_size), "")
+      ("blacklist-subnet-threshold", po::value(&blacklist_subnet_threshold), "")
       ("fat-routing-table", po::value(&fat_routing_table), "")
+      ("flat-routing-table", po::value(&flat_routing_table), "")
       ("transaction-expiration-seconds", po::value(&transaction_expiration_seconds), "")
+      ("transaction-initial-timeout-ms", po::value(&transaction_initial_timeout_ms), "")
+      ("transaction-min-timeout-ms", po::value(&transaction_min_timeout_ms), "")
       ;
 
   all_options_ = std::make_unique<po::options_description>();
@@ -126,6 +146,10 @@ void Config::after_parse(boost::program_options::variables_map &vm) {
     }
   }
 
+  if (fat_routing_table && flat_routing_table) {
+    throw std::invalid_argument("fat-routing-table and flat-routing-table can not be both enabled");
+  }
+
   if (self_node_id.empty()) {
     std::random_device device;
     std::mt19937 rng{std::random_device()()};
@@ -12,31 +12,53 @@
  */
 
 namespace albert::dht {
-std::string DHT::create_query(std::shared_ptr<krpc::Query> query, routing_table::RoutingTable *routing_table) {
-  transaction_manager.start([query, routing_table](Transaction &transaction) {
-    transaction.method_name_ = query->method_name();
-    transaction.query_node_ = query;
-    transaction.routing_table_ = routing_table;
-    query->set_transaction_id(transaction.id_);
-  });
-  std::stringstream ss;
-  query->encode(ss, bencoding::EncodeMode::Bencoding);
-  return ss.str();
+size_t DHT::create_query(
+    std::shared_ptr<krpc::Query> query,
+    routing_table::RoutingTable *routing_table,
+    uint32_t ip, uint16_t port,
+    gsl::span<uint8_t> buffer) {
+  Transaction transaction;
+  transaction.routing_table_ = routing_table;
+  transaction.ip_ = ip;
+  transaction.port_ = port;
+  if (auto q = dynamic_cast<const krpc::FindNodeQuery*>(query.get()); q) {
+    transaction.method_name_ = krpc::MethodNameFindNode;
+    transaction.target_ = q->target_id();
+  } else if (auto q = dynamic_cast<const krpc::GetPeersQuery*>(query.get()); q) {
+    transaction.method_name_ = krpc::MethodNameGetPeers;
+    transaction.target_ = q->info_hash();
+  } else if (auto q = dynamic_cast<const krpc::SampleInfohashesQuery*>(query.get()); q) {
+    transaction.method_name_ = krpc::MethodNameSampleInfohashes;
+    transaction.target_ = q->target_id();
+  } else if (auto q = dynamic_cast<const krpc::AnnouncePeerQuery*>(query.get()); q) {
+    transaction.method_name_ = krpc::MethodNameAnnouncePeer;
+    transaction.target_ = q->info_hash();
+  } else if (dynamic_cast<const krpc::PingQuery*>(query.get())) {
+    transaction.method_name_ = krpc::MethodNamePing;
+  } else {
+    throw TransactionError("Unknown query method '" + query->method_name() + "'");
+  }
+  query->set_transaction_id(transaction_manager.start(transaction, rtt_.timeout(ip, port)));
+  bencoding::Writer w(buffer);
+  query->encode(w);
+  return w.size();
 }
-std::string DHT::create_response(const krpc::Response &query) {
-  std::stringstream ss;
-  query.encode(ss, bencoding::EncodeMode::Bencoding);
-  return ss.str();
+size_t DHT::create_response(const krpc::Response &response, gsl::span<uint8_t> buffer) {
+  bencoding::Writer w(buffer);
+  response.encode(w);
+  return w.size();
 }
 void DHT::add_routing_table(std::unique_ptr<routing_table::RoutingTable> routing_table) {
   routing_tables_.push_front(std::move(routing_table));
 }
-bool DHT::in_black_list(uint32_t ip, uint16_t port) const {
+bool DHT::in_black_list(uint32_t ip, uint16_t port) {
   return blacklist_.has({ip, port});
 }
 bool DHT::add_to_black_list(uint32_t ip, uint16_t port) {
-  for (auto &rt : routing_tables_) {
-    rt->make_bad(ip, port);
+  // All routing tables share the node store, so the node turns bad in each of them
+  auto slot = node_store_->find(ip, port);
+  if (slot != routing_table::EntryStore::npos) {
+    node_store_->make_bad(slot);
   }
   return blacklist_.add({ip, port});
 }
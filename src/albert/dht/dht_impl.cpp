@@ -1,17 +1,25 @@
 #include "dht_impl.hpp"
 
+#include <iomanip>
 #include <string>
+#include <type_traits>
+#include <variant>
 
 #include <boost/asio/io_service.hpp>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 
+#include <albert/bencode/parser.hpp>
+#include <albert/common/coarse_clock.hpp>
 #include <albert/dht/config.hpp>
 #include <albert/dht/dht.hpp>
 #include <albert/dht/routing_table/routing_table.hpp>
+#include <albert/dht/routing_table/snapshot.hpp>
 #include <albert/dht/sample_infohashes/sample_infohashes_manager.hpp>
+#include <albert/krpc/wire.hpp>
 #include <albert/log/log.hpp>
 #include <albert/public_ip/public_ip.hpp>
+#include <albert/utils/mapped_file.hpp>
 #include <albert/utils/utils.hpp>
 #include <albert/u160/u160.hpp>
 #include <albert/io_latency/function_latency.hpp>
@@ -42,6 +50,8 @@ DHTImpl::DHTImpl(DHT *dht, boost::asio::io_service &io)
                        dht_->config_.report_interval_seconds);
   timers_.emplace_back(*this, "refresh-nodes",&DHTImpl::handle_refresh_nodes_timer,
                        dht_->config_.refresh_nodes_check_interval_seconds);
+  timers_.emplace_back(*this, "node-liveness",&DHTImpl::handle_node_liveness_timer, 1);
+  timers_.emplace_back(*this, "transaction-timeout",&DHTImpl::handle_transaction_timeout_timer, 1);
   timers_.emplace_back(*this, "get-peers",&DHTImpl::handle_get_peers_timer,
                        dht_->config_.get_peers_refresh_interval_seconds);
 }
@@ -52,6 +62,7 @@ void DHTImpl::handle_receive_from(const boost::system::error_code &error, std::s
     LOG(error) << "receive failed: " << error.message();
     return;
   }
+  common::CoarseClock::update();
 
   if (dht_->in_black_list(sender_endpoint.address().to_v4().to_uint(), sender_endpoint.port())) {
     continue_receive();
@@ -59,47 +70,61 @@ void DHTImpl::handle_receive_from(const boost::system::error_code &error, std::s
   }
 
   // parse receive data into a Message
-  std::stringstream ss(std::string(receive_buffer.data(), bytes_transferred));
-  std::shared_ptr<krpc::Message> message;
-  std::shared_ptr<krpc::Query> query_node;
-  std::shared_ptr<bencoding::Node> node;
-  try {
-    node = bencoding::Node::decode(ss);
-  } catch (const bencoding::InvalidBencoding &e) {
-    LOG(debug) << "Invalid bencoding, e: '" << e.what() << "', ignored " << std::endl
-               << utils::hexdump(receive_buffer.data(), bytes_transferred, true);
-    if (bad_sender()) {
-      LOG(debug) << "banned " << sender_endpoint << " due to invalid bencoding";
+  auto datagram = gsl::span<const uint8_t>(reinterpret_cast<const uint8_t*>(receive_buffer.data()), bytes_transferred);
+  // Only for logging and unknown messages, the datagram is decoded into a DOM on demand
+  auto datagram_node = [this, datagram]() {
+    try {
+      return bencoding::ArenaNode::decode(receive_arena_, datagram);
+    } catch (const bencoding::InvalidBencoding &) {
+      return bencoding::ArenaNode::string("<invalid bencoding>");
     }
-    continue_receive();
-    return;
-  }
+  };
+  auto datagram_json = [&datagram_node]() {
+    std::stringstream ss;
+    datagram_node().encode(ss, bencoding::EncodeMode::JSON);
+    return ss.str();
+  };
+
+  krpc::wire::Message message;
+  u160::U160 query_target{};
   routing_table::RoutingTable *routing_table = nullptr;
-  std::string query_method_name{};
+  std::string_view query_method_name{};
   try {
-    message = krpc::Message::decode(*node, [this, &query_method_name, &query_node, &node, &routing_table](std::string id) -> std::string {
+    auto envelope = krpc::wire::scan(datagram);
+    if (envelope.is_reply()) {
+      auto id = envelope.transaction_id;
       if (dht_->transaction_manager.has_transaction(id)) {
-        this->dht_->transaction_manager.end(id, [&query_method_name, &query_node, &routing_table](const dht::Transaction &transaction) {
+        dht_->transaction_manager.end(id, [this, &query_method_name, &query_target, &routing_table](const dht::Transaction &transaction) {
           query_method_name = transaction.method_name_;
-          query_node = transaction.query_node_;
+          query_target = transaction.target_;
           routing_table = transaction.routing_table_;
+          dht_->rtt_.on_response(
+              transaction.ip_, transaction.port_,
+              std::chrono::duration_cast<RttEstimator::duration>(common::CoarseClock::now() - transaction.start_time_));
         });
       } else {
+        // Most likely a response after the transaction expired, not worth a ban
         if (log::is_debug()) {
-          std::stringstream ss;
-          node->encode(ss, bencoding::EncodeMode::JSON);
-          LOG(debug) << "Invalid message, transaction not found, transaction_id: '"
-                     << utils::hexdump(id.data(), id.size(), false) << "', bencoding: " << ss.str();
+          LOG(debug) << "Response ignored, transaction not found, transaction_id: '"
+                     << utils::hexdump(id.data(), id.size(), false) << "', bencoding: " << datagram_json();
         }
+        continue_receive();
+        return;
       }
-      return query_method_name;
-    });
+    }
+    message = krpc::wire::decode(envelope, query_method_name);
+  } catch (const bencoding::InvalidBencoding &e) {
+    LOG(debug) << "Invalid bencoding, e: '" << e.what() << "', ignored " << std::endl
+               << utils::hexdump(receive_buffer.data(), bytes_transferred, true);
+    if (bad_sender()) {
+      LOG(debug) << "banned " << sender_endpoint << " due to invalid bencoding";
+    }
+    continue_receive();
+    return;
   } catch (const krpc::InvalidMessage &e) {
-    if (!try_to_handle_unknown_message(node)) {
+    if (!try_to_handle_unknown_message(datagram_node())) {
       if (log::is_debug()) {
-        std::stringstream ss;
-        node->encode(ss, bencoding::EncodeMode::JSON);
-        LOG(debug) << "InvalidMessage, e: '" << e.what() << "', ignored, bencoding '" << ss.str() << "'";
+        LOG(debug) << "InvalidMessage, e: '" << e.what() << "', ignored, bencoding '" << datagram_json() << "'";
       }
       if (bad_sender()) {
         LOG(debug) << "banned " << sender_endpoint << " due to invalid message";
@@ -109,48 +134,40 @@ void DHTImpl::handle_receive_from(const boost::system::error_code &error, std::s
     return;
   }
 
-  if (auto response = std::dynamic_pointer_cast<krpc::Response>(message); response) {
-    if (auto find_node_response = std::dynamic_pointer_cast<krpc::FindNodeResponse>(response); find_node_response) {
-      handle_find_node_response(*find_node_response, routing_table);
-    } else if (auto ping_response = std::dynamic_pointer_cast<krpc::PingResponse>(response); ping_response) {
-      handle_ping_response(*ping_response);
-    } else if (auto get_peers_response = std::dynamic_pointer_cast<krpc::GetPeersResponse>(response); get_peers_response) {
-      if (auto q = std::dynamic_pointer_cast<krpc::GetPeersQuery>(query_node); q) {
-        handle_get_peers_response(*get_peers_response, *q);
+  std::visit([&](const auto &m) {
+    namespace wire = krpc::wire;
+    using T = std::decay_t<decltype(m)>;
+    if constexpr (std::is_same_v<T, wire::PingQuery>) {
+      handle_ping_query(m);
+    } else if constexpr (std::is_same_v<T, wire::FindNodeQuery>) {
+      handle_find_node_query(m);
+    } else if constexpr (std::is_same_v<T, wire::GetPeersQuery>) {
+      handle_get_peers_query(m);
+    } else if constexpr (std::is_same_v<T, wire::AnnouncePeerQuery>) {
+      handle_announce_peer_query(m);
+    } else if constexpr (std::is_same_v<T, wire::PingResponse>) {
+      handle_ping_response(m);
+    } else if constexpr (std::is_same_v<T, wire::FindNodeResponse>) {
+      handle_find_node_response(m, routing_table);
+    } else if constexpr (std::is_same_v<T, wire::GetPeersResponse>) {
+      if (query_method_name == krpc::MethodNameGetPeers) {
+        handle_get_peers_response(m, query_target);
       } else {
         LOG(error) << "Invalid get_peers response, Query type not get_peers";
         if (bad_sender()) {
           LOG(info) << "banned " << sender_endpoint << " due to invalid get_peers response";
         }
       }
-    } else if (auto sample_infohashes_res = std::dynamic_pointer_cast<krpc::SampleInfohashesResponse>(response); sample_infohashes_res) {
-      handle_sample_infohashes_response(*sample_infohashes_res);
-    } else {
-      LOG(error) << "Warning! response type not supported";
-    }
-  } else if (auto query = std::dynamic_pointer_cast<krpc::Query>(message); query) {
-    if (auto ping = std::dynamic_pointer_cast<krpc::PingQuery>(query); ping) {
-      handle_ping_query(*ping);
-    } else if (auto find_node_query = std::dynamic_pointer_cast<krpc::FindNodeQuery>(query); find_node_query) {
-      handle_find_node_query(*find_node_query);
-    } else if (auto get_peers_query = std::dynamic_pointer_cast<krpc::GetPeersQuery>(query); get_peers_query) {
-      handle_get_peers_query(*get_peers_query);
-    } else if (auto announce_peer_query = std::dynamic_pointer_cast<krpc::AnnouncePeerQuery>(query); announce_peer_query) {
-      handle_announce_peer_query(*announce_peer_query);
+    } else if constexpr (std::is_same_v<T, wire::AnnouncePeerResponse>) {
+      LOG(warning) << "AnnouncePeer response received, ignored";
+    } else if constexpr (std::is_same_v<T, wire::SampleInfohashesResponse>) {
+      handle_sample_infohashes_response(m);
+    } else if constexpr (std::is_same_v<T, wire::Error>) {
+      LOG(error) << "DHT Error message from " << sender_endpoint << ", '" << m.message << "' method: " << query_method_name << ", ignored";
     } else {
-      LOG(error) << "Warning! query type not supported";
+      static_assert(std::is_same_v<T, wire::Error>, "unhandled KRPC message type");
     }
-  } else if (auto dht_error = std::dynamic_pointer_cast<krpc::Error>(message); dht_error) {
-    LOG(error) << "DHT Error message from " << sender_endpoint << ", '" << dht_error->message() << "' method: " << query_method_name << ", ignored";
-//    if (bad_sender()) {
-//      LOG(info) << "banned " << sender_endpoint << " due to error message";
-//    }
-  } else {
-    LOG(error) << "Unknown message type";
-    if (bad_sender()) {
-      LOG(info) << "banned " << sender_endpoint << " due to unknown message type";
-    }
-  }
+  }, message);
 
   continue_receive();
 }
@@ -193,41 +210,70 @@ DHT::DHT(Config config)
           u160::U160::from_hex(config_.self_node_id),
           (config_.public_ip.empty() ? albert::public_ip::my_v4() : boost::asio::ip::address_v4::from_string(config_.public_ip).to_uint()),
           config_.bind_port),
-      transaction_manager(std::chrono::seconds(config.transaction_expiration_seconds)),
-      get_peers_manager_(std::make_unique<dht::get_peers::GetPeersManager>(config_.get_peers_request_expiration_seconds)),
-      blacklist_(config_.blacklist_size, std::chrono::hours(config_.blacklist_hours)) {
-
+      transaction_manager(std::chrono::seconds(config_.transaction_expiration_seconds)),
+      rtt_(std::chrono::milliseconds(config_.transaction_initial_timeout_ms),
+           std::chrono::milliseconds(config_.transaction_min_timeout_ms),
+           std::chrono::seconds(config_.transaction_expiration_seconds)),
+      node_store_(std::make_shared<routing_table::EntryStore>()),
+      get_peers_manager_(std::make_unique<dht::get_peers::GetPeersManager>(
+          config_.get_peers_request_expiration_seconds,
+          config_.max_routing_table_bucket_size,
+          config_.get_peers_alpha,
+          config_.get_peers_shortlist_size,
+          std::chrono::minutes(routing_table::MaxGoodNodeAliveMinutes),
+          std::chrono::seconds(config_.get_peers_unresponsive_seconds),
+          config_.get_peers_max_timeouts_in_row)),
+      blacklist_(config_.blacklist_size, std::chrono::hours(config_.blacklist_hours), config_.blacklist_subnet_threshold) {
+
+  auto make_table = [this]() {
+    return std::make_unique<routing_table::RoutingTable>(
+        u160::U160::from_hex(config_.self_node_id),
+        "main",
+        config_.routing_table_save_path,
+        config_.max_routing_table_bucket_size,
+        config_.max_routing_table_known_nodes,
+        config_.delete_good_nodes,
+        config_.fat_routing_table,
+        config_.flat_routing_table,
+        boost::bind(&DHT::add_to_black_list, this, _1, _2),
+        node_store_);
+  };
   std::ifstream ifs(config_.routing_table_save_path);
   std::unique_ptr<routing_table::RoutingTable> rt;
   if (ifs) {
     LOG(info) << "Loading routing table from '" << config_.routing_table_save_path << "'";
     try {
-      rt = routing_table::RoutingTable::deserialize(
-          ifs, "main",
-          config_.routing_table_save_path,
-          config_.max_routing_table_bucket_size,
-          config_.max_routing_table_known_nodes,
-          config_.delete_good_nodes,
-          config_.fat_routing_table,
-          boost::bind(&DHT::add_to_black_list, this, _1, _2));
-      LOG(info) << "Routing table size " << rt->known_node_count();
+      auto t0 = std::chrono::high_resolution_clock::now();
+      utils::MappedFile mapped(config_.routing_table_save_path);
+      if (routing_table::snapshot::is_snapshot(mapped.data())) {
+        rt = make_table();
+        rt->load_snapshot(mapped.data());
+      } else {
+        rt = routing_table::RoutingTable::deserialize(
+            ifs, "main",
+            config_.routing_table_save_path,
+            config_.max_routing_table_bucket_size,
+            config_.max_routing_table_known_nodes,
+            config_.delete_good_nodes,
+            config_.fat_routing_table,
+            config_.flat_routing_table,
+            boost::bind(&DHT::add_to_black_list, this, _1, _2),
+            node_store_);
+      }
+      auto t1 = std::chrono::high_resolution_clock::now();
+      LOG(info) << "Routing table size " << rt->known_node_count() << ", loaded in "
+                << std::fixed << std::setprecision(2) << std::chrono::duration<double, std::milli>(t1 - t0).count() << "ms";
     } catch (const std::exception &e) {
+      // A table that failed to load a snapshot is still empty
       LOG(info) << "Failed to load routing table, '" << e.what() << "', Creating empty routing table";
     }
   } else {
     LOG(info) << "Creating empty routing table";
   }
   if (!rt) {
-    rt = std::make_unique<routing_table::RoutingTable>(
-        u160::U160::from_hex(config_.self_node_id),
-        "main",
-        config_.routing_table_save_path,
-        config_.max_routing_table_bucket_size,
-        config_.max_routing_table_known_nodes,
-        config_.delete_good_nodes,
-        config_.fat_routing_table,
-        boost::bind(&DHT::add_to_black_list, this, _1, _2));
+    rt = make_table();
   }
+  rt->publish();
   main_routing_table_ = rt.get();
   routing_tables_.push_back(std::move(rt));
 }
@@ -238,6 +284,8 @@ size_t DHT::memory_size() const {
   size_t ret = 0;
   ret += sizeof(*this);
   ret += transaction_manager.memory_size();
+  ret += rtt_.memory_size();
+  ret += node_store_->memory_size();
   for (auto &rt : routing_tables_){
     ret += rt->memory_size();
   }
@@ -259,8 +307,17 @@ DHTInterface::~DHTInterface() {}
 void DHTInterface::start() {
   impl_->bootstrap();
 }
-void DHTInterface::get_peers(const u160::U160 &info_hash, const std::function<void(uint32_t, uint16_t)> &callback) {
-  impl_->get_peers(info_hash, callback);
+void DHTInterface::get_peers(
+    const u160::U160 &info_hash,
+    const std::function<void(uint32_t, uint16_t)> &callback,
+    const std::function<void()> &on_done) {
+  impl_->get_peers(info_hash, callback, on_done);
+}
+void DHTInterface::get_peers_batch(
+    gsl::span<const u160::U160> info_hashes,
+    const std::function<void(const u160::U160 &, uint32_t, uint16_t)> &callback,
+    const std::function<void(const u160::U160 &)> &on_done) {
+  impl_->get_peers_batch(info_hashes, callback, on_done);
 }
 void DHTInterface::sample_infohashes(const std::function<void (const u160::U160 &)> handler) {
   impl_->sample_infohashes(std::move(handler));
@@ -1,6 +1,8 @@
 #pragma once
 #include <array>
+#include <chrono>
 #include <functional>
+#include <future>
 #include <memory>
 #include <set>
 #include <string>
@@ -12,6 +14,7 @@
 #include <boost/asio/steady_timer.hpp>
 #include <boost/asio/signal_set.hpp>
 
+#include <albert/bencode/arena.hpp>
 #include <albert/dht/dht.hpp>
 #include <albert/flow_control/rps_throttler.hpp>
 #include <albert/log/log.hpp>
@@ -28,16 +31,19 @@ class U160;
 }
 
 namespace albert::krpc {
-class PingResponse;
-class FindNodeResponse;
-class GetPeersResponse;
-class SampleInfohashesResponse;
-
-class PingQuery;
-class FindNodeQuery;
 class GetPeersQuery;
-class AnnouncePeerQuery;
 class NodeInfo;
+namespace wire {
+struct PingResponse;
+struct FindNodeResponse;
+struct GetPeersResponse;
+struct SampleInfohashesResponse;
+
+struct PingQuery;
+struct FindNodeQuery;
+struct GetPeersQuery;
+struct AnnouncePeerQuery;
+}
 }
 
 namespace albert::dht {
@@ -78,7 +84,14 @@ class DHTImpl {
 
   explicit DHTImpl(DHT *dht, boost::asio::io_service &io);
   void bootstrap();
-  void get_peers(const u160::U160 &info_hash, const std::function<void(uint32_t, uint16_t)> &callback);
+  void get_peers(
+      const u160::U160 &info_hash,
+      const std::function<void(uint32_t, uint16_t)> &callback,
+      const std::function<void()> &on_done);
+  void get_peers_batch(
+      gsl::span<const u160::U160> info_hashes,
+      const std::function<void(const u160::U160 &, uint32_t, uint16_t)> &callback,
+      const std::function<void(const u160::U160 &)> &on_done);
   void sample_infohashes(std::function<void(const u160::U160 &info_hash)> handler);
 
   /* For SampleInfohashesManager */
@@ -101,28 +114,34 @@ class DHTImpl {
    * DHT Message handlers
    */
 
-  void handle_ping_response(const krpc::PingResponse &response);
-  void handle_find_node_response(const krpc::FindNodeResponse &response, routing_table::RoutingTable *routing_table);
+  void handle_ping_response(const krpc::wire::PingResponse &response);
+  void handle_find_node_response(const krpc::wire::FindNodeResponse &response, routing_table::RoutingTable *routing_table);
   void handle_get_peers_response(
-      const krpc::GetPeersResponse &response,
-      const krpc::GetPeersQuery &query);
-  void handle_sample_infohashes_response(const krpc::SampleInfohashesResponse &response);
+      const krpc::wire::GetPeersResponse &response,
+      const u160::U160 &info_hash);
+  void handle_sample_infohashes_response(const krpc::wire::SampleInfohashesResponse &response);
 
-  void handle_ping_query(const krpc::PingQuery &query);
-  void handle_find_node_query(const krpc::FindNodeQuery &query);
-  void handle_get_peers_query(const krpc::GetPeersQuery &query);
-  void handle_announce_peer_query(const krpc::AnnouncePeerQuery &query);
+  void handle_ping_query(const krpc::wire::PingQuery &query);
+  void handle_find_node_query(const krpc::wire::FindNodeQuery &query);
+  void handle_get_peers_query(const krpc::wire::GetPeersQuery &query);
+  void handle_announce_peer_query(const krpc::wire::AnnouncePeerQuery &query);
 
   void handle_receive_from(const boost::system::error_code &error, std::size_t bytes_transferred);
 
-  bool try_to_handle_unknown_message(std::shared_ptr<bencoding::Node> node);
+  bool try_to_handle_unknown_message(const bencoding::ArenaNode &node);
 
   /**
    * Helper functions
    */
   void continue_receive();
-  std::function<void(const boost::system::error_code &, size_t)>
-  default_handle_send(const std::string &description);
+
+  // Encode the message into a send buffer and send it to ep
+  void send_query(
+      std::shared_ptr<krpc::Query> query,
+      routing_table::RoutingTable *routing_table,
+      const udp::endpoint &ep,
+      const std::string &description);
+  void send_response(const krpc::Response &response, const udp::endpoint &ep, const std::string &description);
 
   void find_self(routing_table::RoutingTable &rt, const udp::endpoint &ep);
   void find_node(routing_table::RoutingTable &rt, const udp::endpoint &ep, u160::U160 target);
@@ -138,13 +157,13 @@ class DHTImpl {
       const std::string &transaction_id,
       const krpc::NodeInfo &receiver,
       const std::vector<krpc::NodeInfo> &nodes);
-  void try_to_send_get_peers_query(
-      const u160::U160 &info_hash,
-      const krpc::NodeInfo &receiver
-      );
+  void send_get_peers_query(const u160::U160 &info_hash, const krpc::NodeInfo &receiver);
+  // Finish the lookup of the info hash if it is done, or send its next queries
+  void continue_get_peers(const u160::U160 &info_hash);
+  void handle_get_peers_timeout(const u160::U160 &info_hash, uint32_t ip, uint16_t port);
 
   void handle_send(const std::string &description, const boost::system::error_code &error, std::size_t bytes_transferred);
-  void good_sender(const u160::U160 &sender_id, const std::string &version);
+  void good_sender(const u160::U160 &sender_id, std::string_view version);
 
   void bad_node(const u160::U160 &id);
   // return value: If the sender is added to black list, it returns true; otherwise, it returns false.
@@ -160,6 +179,13 @@ class DHTImpl {
   void handle_report_stat_timer(const Timer::Cancel &cancel);
   void handle_expand_route_timer(const Timer::Cancel &cancel);
   void handle_refresh_nodes_timer(const Timer::Cancel &cancel);
+  // Every second, handles the node state changes and bucket refreshes that are due and paces pings
+  void handle_node_liveness_timer(const Timer::Cancel &cancel);
+  // Every second, ends the queries past their timeout
+  void handle_transaction_timeout_timer(const Timer::Cancel &cancel);
+  void handle_transaction_timeout(const Transaction &transaction);
+  // Save the main routing table in the background, if the interval passed and the last one finished
+  void checkpoint_routing_table();
   void handle_get_peers_timer(const Timer::Cancel &cancel);
 
  private:
@@ -169,12 +195,29 @@ class DHTImpl {
   boost::asio::io_service &io;
 
   std::array<char, 65536> receive_buffer{};
+  // Nodes of the datagram being handled, reset before receiving the next one
+  bencoding::Arena receive_arena_;
   udp::socket socket;
   udp::endpoint sender_endpoint{};
 
   std::vector<Timer> timers_;
+  // A node turns bad when this many of its queries in a row timed out
+  static constexpr size_t MaxTimeoutsInRow = 3;
+
+  // Outgoing messages are encoded into pooled buffers, a buffer is busy until its async_send_to completes
+  static constexpr size_t SendBufferSize = 2048;
+  static_assert(krpc::MaxQuerySize <= SendBufferSize);
+  typedef std::array<uint8_t, SendBufferSize> SendBuffer;
+  SendBuffer *acquire_send_buffer();
+  void send_buffer(SendBuffer *buffer, size_t size, const udp::endpoint &ep, const std::string &description);
+  std::vector<std::unique_ptr<SendBuffer>> send_buffers_;
+  std::vector<SendBuffer*> free_send_buffers_;
 
   std::function<void (const u160::U160 &info_hash)> announce_peer_handler_;
   flow_control::RPSThrottler throttler_;
+
+  // The file is written by another thread, its destructor waits for it
+  std::future<void> checkpoint_;
+  std::chrono::steady_clock::time_point last_checkpoint_ = std::chrono::steady_clock::now();
 };
 }
@@ -1,128 +1,277 @@
 #include "dht_impl.hpp"
 #include "get_peers.hpp"
 
+#include <algorithm>
+#include <utility>
+
 #include <boost/bind.hpp>
 
 #include <albert/dht/config.hpp>
 #include <albert/dht/dht.hpp>
 #include <albert/dht/routing_table/routing_table.hpp>
+#include <albert/krpc/wire.hpp>
 #include <albert/bt/peer_connection.hpp>
 #include <albert/u160/u160.hpp>
 
 
 namespace albert::dht {
 
-void DHTImpl::get_peers(const u160::U160 &info_hash, const std::function<void(uint32_t, uint16_t)> &callback) {
-
-  if (!dht_->get_peers_manager_->has_request(info_hash)) {
-    dht_->get_peers_manager_->create_request(info_hash);
-
-//  auto targets = dht_->routing_table.k_nearest_good_nodes(info_hash, 200);
-    // use the whole routing table
-
-  } else {
-    LOG(debug) << "get_peers() already searched for " << info_hash.to_string();
+void DHTImpl::get_peers(
+    const u160::U160 &info_hash,
+    const std::function<void(uint32_t, uint16_t)> &callback,
+    const std::function<void()> &on_done) {
+  auto &manager = *dht_->get_peers_manager_;
+  if (auto request = manager.find(info_hash); request) {
+    LOG(debug) << "get_peers() already searching for " << info_hash.to_string();
+    request->add_callback(callback);
+    if (on_done) {
+      request->add_done_callback(on_done);
+    }
     return;
   }
 
-  dht_->get_peers_manager_->add_callback(info_hash, callback);
+  auto &request = manager.create_request(info_hash);
+  request.add_callback(callback);
+  if (on_done) {
+    request.add_done_callback(on_done);
+  }
+  // Nodes recent lookups found near the target are usually closer than the ones of the routing table
+  auto shortlist_size = dht_->config_.get_peers_shortlist_size;
+  auto now = std::chrono::high_resolution_clock::now();
+  for (auto &node : manager.cache().closest(info_hash, shortlist_size, now)) {
+    request.add_node(node);
+  }
+  for (auto &node : dht_->main_routing_table_->k_nearest_good_nodes(info_hash, shortlist_size)) {
+    if (!manager.cache().unresponsive(node.ip(), node.port(), now)) {
+      request.add_node(node);
+    }
+  }
+  LOG(info) << "GetPeersManager: start to get_peers(" << info_hash.to_string() << ") from "
+            << request.shortlist().size() << " nodes";
+  continue_get_peers(info_hash);
+}
 
-  std::list<routing_table::Entry> targets = dht_->main_routing_table_->k_nearest_good_nodes(
-      info_hash,
-      dht_->main_routing_table_->max_bucket_size());
-//  dht_->main_routing_table_->iterate_nodes([&targets](const routing_table::Entry &entry) {
-//    targets.push_back(entry);
-//  });
+void DHTImpl::get_peers_batch(
+    gsl::span<const u160::U160> info_hashes,
+    const std::function<void(const u160::U160 &, uint32_t, uint16_t)> &callback,
+    const std::function<void(const u160::U160 &)> &on_done) {
+  // The lookups run side by side, each one takes the nodes the others learn that are close to its target
+  for (auto &info_hash : info_hashes) {
+    get_peers(
+        info_hash,
+        [callback, info_hash](uint32_t ip, uint16_t port) { callback(info_hash, ip, port); },
+        on_done ? std::function<void()>([on_done, info_hash]() { on_done(info_hash); }) : nullptr);
+  }
+}
 
-  int sent = 0;
-  for (auto &entry : targets) {
-    auto receiver = entry.node_info();
-    if (!dht_->get_peers_manager_->has_node(info_hash, receiver.id())) {
-      try_to_send_get_peers_query(info_hash, receiver);
-      sent++;
-    }
+void DHTImpl::continue_get_peers(const u160::U160 &info_hash) {
+  auto request = dht_->get_peers_manager_->find(info_hash);
+  if (request == nullptr) {
+    return;
+  }
+  if (request->finished()) {
+    LOG(debug) << "GetPeersManager: get_peers(" << info_hash.to_string() << ") finished, "
+               << request->peers().size() << " peers";
+    dht_->get_peers_manager_->finish(info_hash);
+    return;
+  }
+  for (auto &node : request->next_queries()) {
+    // Marked querying only when sent, a dropped send does not hold a slot of alpha that no timeout would free
+    throttler_.throttle([this, info_hash, node]() {
+      auto request = dht_->get_peers_manager_->find(info_hash);
+      if (request != nullptr && request->start_query(node.ip(), node.port())) {
+        send_get_peers_query(info_hash, node);
+      }
+    });
   }
-  LOG(info) << "GetPeersManager: start to get_peers(" << info_hash.to_string() << ")";
 }
 
 void DHTImpl::handle_get_peers_response(
-    const krpc::GetPeersResponse &response,
-    const krpc::GetPeersQuery &query
+    const krpc::wire::GetPeersResponse &response,
+    const u160::U160 &info_hash
 ) {
-  auto transaction_id = response.transaction_id();
-  auto info_hash = query.info_hash();
-  auto sender_id = response.sender_id();
-  if (dht_->get_peers_manager_->has_request(info_hash)) {
-    if (dht_->get_peers_manager_->has_node(info_hash, sender_id)) {
-      if (response.has_peers()) {
-        LOG(debug) << "handle get_peers from " << sender_id.to_string() << " got " << response.peers().size() << " peers";
-        uint32_t ip;
-        uint16_t port;
-        for (auto item : response.peers()) {
-          std::tie(ip, port) = item;
-          dht_->get_peers_manager_->add_peer(info_hash, ip, port);
-        }
+  auto sender_id = response.sender_id;
+  auto sender_ip = sender_endpoint.address().to_v4().to_uint();
+  auto sender_port = sender_endpoint.port();
+  dht_->get_peers_manager_->cache().on_response(sender_ip, sender_port);
+  auto request = dht_->get_peers_manager_->find(info_hash);
+  if (request == nullptr) {
+    LOG(debug) << "GetPeersRequest manager failed, info_hash not found";
+  } else {
+    // The sender may have been dropped from the shortlist while its query was in flight, its peers still count
+    if (!request->on_response(sender_ip, sender_port)) {
+      LOG(debug) << "GetPeersManager info_hash: '" << info_hash.to_string() << "' "
+                 << "response from a node not in the shortlist. node: " << sender_id.to_string();
+    }
+    if (!response.peers.empty()) {
+      LOG(debug) << "handle get_peers from " << sender_id.to_string() << " got " << response.peers.size() << " peers";
+      uint32_t ip;
+      uint16_t port;
+      for (auto item : response.peers) {
+        std::tie(ip, port) = item;
+        request->add_peer(ip, port);
       }
-      if (response.has_nodes()){
-        auto old_prefix = u160::U160::common_prefix_length(info_hash, sender_id);
-        dht_->get_peers_manager_->set_node_traversed(info_hash, sender_id);
-        LOG(debug) << "Node traversed prefix " << old_prefix << " '"
-                  << sender_id.to_string() << "'";
-        for (auto &node : response.nodes()) {
-          if (!dht_->get_peers_manager_->has_node_traversed(info_hash, node.id()) && node.valid()) {
-            auto new_prefix = u160::U160::common_prefix_length(info_hash, node.id());
-            if (new_prefix >= old_prefix) {
-              LOG(debug) << "Node to traverse prefix " << new_prefix << " " << node.id().to_string();
-              throttler_.throttle([=]() {
-                try_to_send_get_peers_query(info_hash, node);
-              });
-            } else {
-              LOG(debug) << "Node ignored new prefix length(" << new_prefix << ") shorter than old(" << old_prefix << ")";
-            }
-          }
+    }
+    // The peer callbacks may have started other requests, request is still valid
+    auto &manager = *dht_->get_peers_manager_;
+    auto now = std::chrono::high_resolution_clock::now();
+    manager.cache().add(krpc::NodeInfo(sender_id, sender_ip, sender_port), now);
+    std::vector<u160::U160> to_continue{info_hash};
+    for (auto node : response.nodes) {
+      if (node.valid() && !dht_->in_black_list(node.ip(), node.port()) &&
+          !manager.cache().unresponsive(node.ip(), node.port(), now)) {
+        request->add_node(node);
+        manager.cache().add(node, now);
+        for (auto &other : manager.share(node, info_hash)) {
+          to_continue.push_back(other);
         }
       }
-    } else {
-      LOG(debug) << "GetPeersManager info_hash: '" << info_hash.to_string() << "' "
-                 << "unknown node sent us a request. node: " << sender_id.to_string();
     }
-  } else {
-    LOG(debug) << "GetPeersRequest manager failed, info_hash not found";
+    std::sort(to_continue.begin(), to_continue.end());
+    to_continue.erase(std::unique(to_continue.begin(), to_continue.end()), to_continue.end());
+    for (auto &target : to_continue) {
+      continue_get_peers(target);
+    }
   }
 
-  good_sender(response.sender_id(), response.version());
+  good_sender(response.sender_id, response.version);
+}
+
+void DHTImpl::handle_get_peers_timeout(const u160::U160 &info_hash, uint32_t ip, uint16_t port) {
+  dht_->get_peers_manager_->cache().on_timeout(ip, port, std::chrono::high_resolution_clock::now());
+  auto request = dht_->get_peers_manager_->find(info_hash);
+  if (request != nullptr && request->on_timeout(ip, port)) {
+    continue_get_peers(info_hash);
+  }
 }
 
 void DHTImpl::handle_get_peers_timer(const std::function<void()> &cancel) {
   dht_->get_peers_manager_->gc();
-  for (auto &[target, nodes] : dht_->get_peers_manager_->expand_routes(8)) {
-    for (auto &node : nodes) {
-      throttler_.throttle([target = target, node = node, this]() {
-        try_to_send_get_peers_query(target, node);
-      });
+  // Lookups whose sends were all dropped by the throttler have nothing in flight to continue them
+  for (auto &info_hash : dht_->get_peers_manager_->targets()) {
+    continue_get_peers(info_hash);
+  }
+}
+
+get_peers::GetPeersRequest::GetPeersRequest(
+    u160::U160 target,
+    std::chrono::high_resolution_clock::time_point expiration_time,
+    size_t k, size_t alpha, size_t shortlist_size)
+    :target_info_hash_(target),
+     expiration_time_(expiration_time),
+     k_(std::max<size_t>(k, 1)),
+     alpha_(std::max<size_t>(alpha, 1)),
+     shortlist_size_(std::max(shortlist_size, k_)) {
+  shortlist_.reserve(shortlist_size_);
+}
+
+bool get_peers::GetPeersRequest::add_node(const krpc::NodeInfo &node) {
+  auto distance = node.id() ^ target_info_hash_;
+  auto it = std::lower_bound(shortlist_.begin(), shortlist_.end(), distance, [this](const Candidate &c, const u160::U160 &d) {
+    return (c.node.id() ^ target_info_hash_) < d;
+  });
+  if (it != shortlist_.end() && it->node.id() == node.id()) {
+    return false;
+  }
+  if (shortlist_.size() >= shortlist_size_ && it == shortlist_.end()) {
+    return false;
+  }
+  // Another id at the same endpoint would make responses ambiguous
+  if (find(node.ip(), node.port()) != nullptr) {
+    return false;
+  }
+  auto index = it - shortlist_.begin();
+  if (shortlist_.size() >= shortlist_size_) {
+    // The farthest is dropped, a response to it only adds its peers and nodes
+    if (shortlist_.back().state == CandidateState::Querying) {
+      querying_--;
     }
+    shortlist_.pop_back();
   }
+  shortlist_.insert(shortlist_.begin() + index, Candidate{node});
+  return true;
 }
 
-void get_peers::GetPeersRequest::delete_node(const u160::U160 &id) {
-  nodes_.erase(id);
+std::vector<krpc::NodeInfo> get_peers::GetPeersRequest::next_queries() const {
+  std::vector<krpc::NodeInfo> ret;
+  for (auto &candidate : shortlist_) {
+    if (querying_ + ret.size() >= alpha_) {
+      break;
+    }
+    if (candidate.state == CandidateState::Fresh) {
+      ret.push_back(candidate.node);
+    }
+  }
+  return ret;
 }
-void get_peers::GetPeersRequest::add_node(const krpc::NodeInfo &node) {
-  nodes_.emplace(node.id(), NodeStatus(node));
+
+bool get_peers::GetPeersRequest::start_query(uint32_t ip, uint16_t port) {
+  auto candidate = find(ip, port);
+  if (candidate == nullptr || candidate->state != CandidateState::Fresh || querying_ >= alpha_) {
+    return false;
+  }
+  candidate->state = CandidateState::Querying;
+  querying_++;
+  return true;
 }
-bool get_peers::GetPeersRequest::has_node(const u160::U160 &id) const {
-  return nodes_.find(id) != nodes_.end();
+
+get_peers::Candidate *get_peers::GetPeersRequest::find(uint32_t ip, uint16_t port) {
+  return const_cast<Candidate*>(std::as_const(*this).find(ip, port));
 }
-std::set<std::tuple<uint32_t, uint16_t>> get_peers::GetPeersRequest::peers() const {
-  return peers_;
+
+const get_peers::Candidate *get_peers::GetPeersRequest::find(uint32_t ip, uint16_t port) const {
+  for (auto &candidate : shortlist_) {
+    if (candidate.node.ip() == ip && candidate.node.port() == port) {
+      return &candidate;
+    }
+  }
+  return nullptr;
 }
-bool get_peers::GetPeersRequest::has_node_traversed(const u160::U160 &id) const {
-  if (nodes_.find(id) == nodes_.end()) {
+
+bool get_peers::GetPeersRequest::on_response(uint32_t ip, uint16_t port) {
+  auto candidate = find(ip, port);
+  if (candidate == nullptr) {
     return false;
-  } else {
-    return nodes_.at(id).traversed;
   }
+  if (candidate->state == CandidateState::Querying) {
+    querying_--;
+  } else if (candidate->state != CandidateState::Failed) {
+    return false;
+  }
+  candidate->state = CandidateState::Responded;
+  return true;
+}
+
+bool get_peers::GetPeersRequest::on_timeout(uint32_t ip, uint16_t port) {
+  auto candidate = find(ip, port);
+  if (candidate == nullptr || candidate->state != CandidateState::Querying) {
+    return false;
+  }
+  candidate->state = CandidateState::Failed;
+  querying_--;
+  return true;
 }
+
+bool get_peers::GetPeersRequest::finished() const {
+  size_t responded = 0;
+  for (auto &candidate : shortlist_) {
+    switch (candidate.state) {
+      case CandidateState::Failed:
+        continue;
+      case CandidateState::Responded:
+        if (++responded >= k_) {
+          return true;
+        }
+        continue;
+      case CandidateState::Fresh:
+      case CandidateState::Querying:
+        return false;
+    }
+  }
+  // Fewer than k nodes left and all of them responded
+  return true;
+}
+
 void get_peers::GetPeersRequest::add_peer(uint32_t ip, uint16_t port) {
   auto result = peers_.insert({ip, port});
   // Call the add-peer-callback only when the peer is first added
@@ -132,113 +281,178 @@ void get_peers::GetPeersRequest::add_peer(uint32_t ip, uint16_t port) {
     }
   }
 }
-void get_peers::GetPeersRequest::set_node_traversed(const u160::U160 &id) {
-  nodes_.at(id).traversed = true;
+void get_peers::GetPeersRequest::add_callback(std::function<void(uint32_t, uint16_t)> callback) {
+  callbacks_.emplace_back(std::move(callback));
+}
+void get_peers::GetPeersRequest::add_done_callback(std::function<void()> callback) {
+  done_callbacks_.emplace_back(std::move(callback));
+}
+void get_peers::GetPeersRequest::done() {
+  for (auto &callback : done_callbacks_) {
+    callback();
+  }
+}
+
+size_t get_peers::GetPeersRequest::memory_size() const {
+  return sizeof(*this) +
+      (callbacks_.size() + done_callbacks_.size()) * sizeof(*callbacks_.begin()) +
+      shortlist_.capacity() * sizeof(Candidate) +
+      peers_.size() * sizeof(std::tuple<uint32_t, uint16_t>);
+}
+
+void get_peers::NodeCache::add(const krpc::NodeInfo &node, TimePoint now) {
+  auto &bucket = buckets_[prefix(node.id())];
+  for (size_t i = 0; i < bucket.size; i++) {
+    if (bucket.items[i].node.id() == node.id()) {
+      bucket.items[i] = {node, now};
+      return;
+    }
+  }
+  bucket.items[bucket.next] = {node, now};
+  bucket.next = (bucket.next + 1) % BucketSize;
+  if (bucket.size < BucketSize) {
+    bucket.size++;
+    size_++;
+  }
+}
+
+void get_peers::NodeCache::on_response(uint32_t ip, uint16_t port) {
+  timeouts_.erase(endpoint_key(ip, port));
+}
+
+void get_peers::NodeCache::on_timeout(uint32_t ip, uint16_t port, TimePoint now) {
+  auto &timeouts = timeouts_[endpoint_key(ip, port)];
+  timeouts.at = now;
+  timeouts.in_row++;
 }
-bool get_peers::GetPeersRequest::expired() const {
-  return std::chrono::high_resolution_clock::now() > expiration_time_;
+
+bool get_peers::NodeCache::unresponsive(uint32_t ip, uint16_t port, TimePoint now) const {
+  auto it = timeouts_.find(endpoint_key(ip, port));
+  return it != timeouts_.end() && it->second.in_row >= max_timeouts_in_row_ && now - it->second.at < unresponsive_ttl_;
 }
-void get_peers::GetPeersRequest::add_callback(std::function<void(uint32_t, uint16_t)> callback) { this->callbacks_.emplace_back(std::move(callback)); }
 
-std::vector<krpc::NodeInfo> get_peers::GetPeersRequest::get_available_nodes(size_t n) const {
+std::vector<krpc::NodeInfo> get_peers::NodeCache::closest(const u160::U160 &target, size_t n, TimePoint now) const {
   std::vector<krpc::NodeInfo> ret;
-  for (auto &item : nodes_) {
-    if (!item.second.traversed) {
-      ret.emplace_back(krpc::NodeInfo(item.first, item.second.node.ip(), item.second.node.port()));
-      if (ret.size() >= n) {
-        return ret;
+  // Every node of bucket p ^ d is closer to target than the ones of bucket p ^ (d + 1)
+  auto p = prefix(target);
+  for (size_t d = 0; d < buckets_.size() && ret.size() < n; d++) {
+    auto &bucket = buckets_[p ^ d];
+    for (size_t i = 0; i < bucket.size; i++) {
+      auto &item = bucket.items[i];
+      if (now - item.learned_at < ttl_ && !unresponsive(item.node.ip(), item.node.port(), now)) {
+        ret.push_back(item.node);
       }
     }
   }
+  auto by_distance = [&target](const krpc::NodeInfo &lhs, const krpc::NodeInfo &rhs) {
+    return (lhs.id() ^ target) < (rhs.id() ^ target);
+  };
+  if (ret.size() > n) {
+    std::partial_sort(ret.begin(), ret.begin() + n, ret.end(), by_distance);
+    ret.resize(n);
+  } else {
+    std::sort(ret.begin(), ret.end(), by_distance);
+  }
   return ret;
 }
 
-size_t get_peers::GetPeersRequest::memory_size() const {
+void get_peers::NodeCache::gc(TimePoint now) {
+  std::vector<uint64_t> to_delete;
+  for (auto &[key, timeouts] : timeouts_) {
+    if (now - timeouts.at >= unresponsive_ttl_) {
+      to_delete.push_back(key);
+    }
+  }
+  for (auto key : to_delete) {
+    timeouts_.erase(key);
+  }
+}
+
+size_t get_peers::NodeCache::memory_size() const {
   return sizeof(*this) +
-      callbacks_.size() * sizeof(*callbacks_.begin()) +
-      nodes_.size() * sizeof(std::pair<albert::u160::U160, NodeStatus>) +
-      peers_.size() * sizeof(std::tuple<uint32_t, uint16_t>);
+      buckets_.capacity() * sizeof(Bucket) +
+      timeouts_.memory_size();
 }
 
-bool get_peers::GetPeersManager::has_node(const u160::U160 &id, const u160::U160 &node) const {
-  return requests_.at(id).has_node(node);
+get_peers::GetPeersRequest *get_peers::GetPeersManager::find(const u160::U160 &info_hash) {
+  auto it = requests_.find(info_hash);
+  return it == requests_.end() ? nullptr : it->second.get();
 }
-void get_peers::GetPeersManager::set_node_traversed(const u160::U160 &id, const u160::U160 &node) {
-  requests_.at(id).set_node_traversed(node);
+bool get_peers::GetPeersManager::has_request(const u160::U160 &id) const {
+  return requests_.contains(id);
 }
-void get_peers::GetPeersManager::create_request(
-    const u160::U160 &info_hash) {
-  requests_.emplace(
+get_peers::GetPeersRequest &get_peers::GetPeersManager::create_request(const u160::U160 &info_hash) {
+  auto [it, inserted] = requests_.emplace(
       info_hash,
-      GetPeersRequest(
+      std::make_unique<GetPeersRequest>(
           info_hash,
-          std::chrono::high_resolution_clock::now() + expiration_));
-}
-void get_peers::GetPeersManager::add_peer(const u160::U160 &id, uint32_t ip, uint16_t port) {
-  requests_.at(id).add_peer(ip, port);
+          std::chrono::high_resolution_clock::now() + expiration_,
+          k_, alpha_, shortlist_size_));
+  return *it->second;
 }
-void get_peers::GetPeersManager::add_node(const u160::U160 &id, const krpc::NodeInfo &node) {
-  requests_.at(id).add_node(node);
+void get_peers::GetPeersManager::finish(const u160::U160 &info_hash) {
+  auto it = requests_.find(info_hash);
+  if (it == requests_.end()) {
+    return;
+  }
+  // Removed first, a done callback may start the same request again
+  auto request = std::move(it->second);
+  requests_.erase(info_hash);
+  request->done();
 }
-bool get_peers::GetPeersManager::has_node_traversed(const u160::U160 &id, const u160::U160 &node) const {
-  return requests_.at(id).has_node_traversed(node);
+std::vector<u160::U160> get_peers::GetPeersManager::targets() const {
+  std::vector<u160::U160> ret;
+  ret.reserve(requests_.size());
+  for (auto &[target, request] : requests_) {
+    ret.push_back(target);
+  }
+  return ret;
 }
-bool get_peers::GetPeersManager::has_request(const u160::U160 &id) const {
-  return requests_.find(id) != requests_.end();
+std::vector<u160::U160> get_peers::GetPeersManager::share(const krpc::NodeInfo &node, const u160::U160 &from) {
+  std::vector<u160::U160> ret;
+  for (auto &[target, request] : requests_) {
+    if (target != from && request->add_node(node)) {
+      ret.push_back(target);
+    }
+  }
+  return ret;
 }
 void get_peers::GetPeersManager::gc() {
   std::list<u160::U160> to_delete;
 
   size_t had_peer = 0;
   size_t total_peers = 0;
-  size_t total_traversed = 0;
+  size_t total_querying = 0;
   size_t total_nodes = 0;
+  auto now = std::chrono::high_resolution_clock::now();
   for (auto &[target, request] : requests_) {
-    if (request.expired() > 0) {
+    if (request->expired(now)) {
       to_delete.push_back(target);
     } else {
-      for (auto &node : request.nodes_) {
-        if (node.second.traversed) {
-          total_traversed++;
-        }
-        total_nodes++;
-      }
-      if (!request.peers().empty()) {
+      total_nodes += request->shortlist().size();
+      total_querying += request->querying();
+      if (!request->peers().empty()) {
         had_peer++;
-        total_peers += request.peers().size();
+        total_peers += request->peers().size();
       }
     }
   }
   for (auto &item : to_delete) {
-    requests_.erase(item);
+    finish(item);
   }
+  cache_.gc(now);
 
-  LOG(debug) << "GetPeersManager: nodes/traversed/peers/valid requests/deleting "
+  LOG(debug) << "GetPeersManager: nodes/querying/peers/valid requests/deleting "
             << total_nodes << "/"
-            << total_traversed << "/"
+            << total_querying << "/"
             << total_peers << "/"
             << had_peer << "/"
             << to_delete.size();
 }
-void get_peers::GetPeersManager::add_callback(
-    const u160::U160 &id,
-    const std::function<void(uint32_t, uint16_t)> &callback) {
-  requests_.at(id).add_callback(callback);
-}
-
-std::map<u160::U160,
-         std::vector<krpc::NodeInfo>> get_peers::GetPeersManager::expand_routes(size_t n_per_request) {
-  std::map<u160::U160, std::vector<krpc::NodeInfo>> ret;
-  for (auto &request : requests_) {
-    auto target = request.first;
-    ret[target] = request.second.get_available_nodes(n_per_request);
-  }
-  return ret;
-}
 size_t get_peers::GetPeersManager::memory_size() const {
-  size_t ret = sizeof(*this);
+  size_t ret = sizeof(*this) + requests_.memory_size() + cache_.memory_size() - sizeof(cache_);
   for (auto &r : requests_) {
-    ret += r.second.memory_size() + sizeof(r.first);
+    ret += r.second->memory_size();
   }
   return ret;
 }
@@ -1,87 +1,214 @@
 #pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <functional>
 #include <list>
+#include <memory>
 #include <set>
 #include <tuple>
 #include <utility>
 #include <vector>
 
+#include <albert/common/open_hash_map.hpp>
 #include <albert/krpc/krpc.hpp>
 #include <albert/u160/u160.hpp>
 
 namespace albert::dht::get_peers {
 
+enum class CandidateState : uint8_t {
+  Fresh,
+  Querying,
+  Responded,
+  Failed,
+};
 
-struct NodeStatus {
-  explicit NodeStatus(krpc::NodeInfo node) :traversed(false), node(std::move(node)) { }
-  bool traversed = false;
+struct Candidate {
   krpc::NodeInfo node;
+  CandidateState state = CandidateState::Fresh;
 };
 
+/**
+ * One iterative Kademlia lookup of the peers of an info hash.
+ *
+ * Nodes to ask are kept in a shortlist of at most shortlist_size nodes sorted by XOR distance to the info hash.
+ *   At most alpha queries are in flight, the closest fresh node is asked as soon as a query ends, by its response
+ *   or its timeout. Peers are taken from every response, also of nodes that left the shortlist.
+ *   Nodes from responses only enter the shortlist if they are closer than its farthest node,
+ *   so a node that was dropped never comes back.
+ * The lookup is finished when the k closest nodes that did not time out have all responded,
+ *   or when there is nobody left to ask.
+ */
 class GetPeersRequest {
  public:
   GetPeersRequest(
-      albert::u160::U160 target,
-      std::chrono::high_resolution_clock::time_point expiration_time)
-      :target_info_hash_(target),
-       expiration_time_(expiration_time) {}
+      u160::U160 target,
+      std::chrono::high_resolution_clock::time_point expiration_time,
+      size_t k, size_t alpha, size_t shortlist_size);
+
+  [[nodiscard]]
+  const u160::U160 &target() const { return target_info_hash_; }
 
   void add_peer(uint32_t ip, uint16_t port);
   [[nodiscard]]
-  std::set<std::tuple<uint32_t, uint16_t>> peers() const;
+  const std::set<std::tuple<uint32_t, uint16_t>> &peers() const { return peers_; }
 
   void add_callback(std::function<void(uint32_t, uint16_t)> callback);
+  void add_done_callback(std::function<void()> callback);
+  // Call the done callbacks
+  void done();
 
-  bool expired() const;
-
-  void add_node(const krpc::NodeInfo &node);
   [[nodiscard]]
-  bool has_node(const u160::U160 &id) const;
-  void delete_node(const u160::U160 &id);
+  bool expired(std::chrono::high_resolution_clock::time_point now) const { return now > expiration_time_; }
 
+  // Returns whether the node entered the shortlist
+  bool add_node(const krpc::NodeInfo &node);
+  // The nodes to query now, so that alpha queries are in flight. They are querying once start_query() is called,
+  //   a send the throttler dropped leaves its node fresh
   [[nodiscard]]
-  bool has_node_traversed(const u160::U160 &id) const;
-  void set_node_traversed(const u160::U160 &id);
+  std::vector<krpc::NodeInfo> next_queries() const;
+  // Returns false if the node is not fresh any more or alpha queries are in flight, the query is not sent then
+  bool start_query(uint32_t ip, uint16_t port);
+  // The query to the node at the endpoint ended, returns false if it is not in the shortlist.
+  // A response after the timeout still counts
+  bool on_response(uint32_t ip, uint16_t port);
+  bool on_timeout(uint32_t ip, uint16_t port);
 
   [[nodiscard]]
-  std::vector<krpc::NodeInfo> get_available_nodes(size_t n) const;
+  bool finished() const;
+  [[nodiscard]]
+  const std::vector<Candidate> &shortlist() const { return shortlist_; }
+  [[nodiscard]]
+  size_t querying() const { return querying_; }
 
   [[nodiscard]]
   size_t memory_size() const;
 
-// private:
-  std::list<std::function<void (uint32_t, uint16_t)>> callbacks_;
+ private:
+  Candidate *find(uint32_t ip, uint16_t port);
+  [[nodiscard]]
+  const Candidate *find(uint32_t ip, uint16_t port) const;
+
+ private:
   u160::U160 target_info_hash_;
-  std::map<albert::u160::U160, NodeStatus> nodes_;
-  std::set<std::tuple<uint32_t, uint16_t>> peers_;
   std::chrono::high_resolution_clock::time_point expiration_time_;
+  size_t k_;
+  size_t alpha_;
+  size_t shortlist_size_;
+
+  std::vector<Candidate> shortlist_;
+  size_t querying_ = 0;
+
+  std::list<std::function<void (uint32_t, uint16_t)>> callbacks_;
+  std::list<std::function<void ()>> done_callbacks_;
+  std::set<std::tuple<uint32_t, uint16_t>> peers_;
+};
+
+/**
+ * Nodes learned by recent lookups, shared by all of them.
+ *
+ * Nodes are kept in 2^PrefixBits buckets by the first bits of their id, each a ring of the BucketSize most
+ *   recently learned ones. closest() visits the buckets in XOR distance order of their prefixes, so a lookup
+ *   starts from the nodes other lookups found near its target, not only from the routing table.
+ * An endpoint whose last max_timeouts_in_row queries timed out is unresponsive, lookups skip it until
+ *   unresponsive_ttl passed since its last timeout or it responds.
+ */
+class NodeCache {
+ public:
+  static constexpr size_t PrefixBits = 8;
+  static constexpr size_t BucketSize = 32;
+  using TimePoint = std::chrono::high_resolution_clock::time_point;
+
+  NodeCache(std::chrono::seconds ttl, std::chrono::seconds unresponsive_ttl, size_t max_timeouts_in_row)
+      :ttl_(ttl), unresponsive_ttl_(unresponsive_ttl), max_timeouts_in_row_(std::max<size_t>(max_timeouts_in_row, 1)),
+       buckets_(size_t(1) << PrefixBits) { }
+
+  void add(const krpc::NodeInfo &node, TimePoint now);
+  void on_response(uint32_t ip, uint16_t port);
+  void on_timeout(uint32_t ip, uint16_t port, TimePoint now);
+  [[nodiscard]]
+  bool unresponsive(uint32_t ip, uint16_t port, TimePoint now) const;
+
+  // At most n nodes learned within the ttl, closest to target first
+  [[nodiscard]]
+  std::vector<krpc::NodeInfo> closest(const u160::U160 &target, size_t n, TimePoint now) const;
+
+  // Forget the timeouts older than unresponsive_ttl
+  void gc(TimePoint now);
+  [[nodiscard]]
+  size_t size() const { return size_; }
+  [[nodiscard]]
+  size_t memory_size() const;
+
+ private:
+  struct Item {
+    krpc::NodeInfo node;
+    TimePoint learned_at;
+  };
+  struct Bucket {
+    std::array<Item, BucketSize> items;
+    // Oldest item once the ring is full
+    uint8_t next = 0;
+    uint8_t size = 0;
+  };
+  struct Timeouts {
+    // Of the last one
+    TimePoint at;
+    size_t in_row = 0;
+  };
+  static size_t prefix(const u160::U160 &id) { return id.word(0) >> (64u - PrefixBits); }
+  static uint64_t endpoint_key(uint32_t ip, uint16_t port) { return (uint64_t(ip) << 16u) | port; }
+
+ private:
+  std::chrono::seconds ttl_;
+  std::chrono::seconds unresponsive_ttl_;
+  size_t max_timeouts_in_row_;
+  std::vector<Bucket> buckets_;
+  size_t size_ = 0;
+  // Endpoints whose last queries timed out
+  common::OpenHashMap<uint64_t, Timeouts> timeouts_;
 };
 
 class GetPeersManager {
  public:
-  explicit GetPeersManager(int64_t expiration_seconds) :expiration_(expiration_seconds) {}
-  void add_peer(const u160::U160 &id, uint32_t ip, uint16_t port);
+  GetPeersManager(int64_t expiration_seconds, size_t k, size_t alpha, size_t shortlist_size, std::chrono::seconds cache_ttl,
+                  std::chrono::seconds unresponsive_ttl, size_t max_timeouts_in_row)
+      :expiration_(expiration_seconds), k_(k), alpha_(alpha), shortlist_size_(shortlist_size),
+       cache_(cache_ttl, unresponsive_ttl, max_timeouts_in_row) {}
+
+  // The request of the info hash, nullptr if there is none.
+  // Requests are held by pointer, it stays valid while callbacks start other requests
+  [[nodiscard]]
+  GetPeersRequest *find(const u160::U160 &info_hash);
   [[nodiscard]]
   bool has_request(const u160::U160 &id) const;
-  void add_callback(const u160::U160 &id, const std::function<void (uint32_t, uint16_t)> &callback);
-  void add_node(const u160::U160 &id, const krpc::NodeInfo &node);
+  GetPeersRequest &create_request(const u160::U160 &info_hash);
+  // Remove the request and call its done callbacks
+  void finish(const u160::U160 &info_hash);
+
+  // The info hashes of all requests
   [[nodiscard]]
-  bool has_node_traversed(const u160::U160 &id, const u160::U160 &node) const;
+  std::vector<u160::U160> targets() const;
+
+  // Offer the node to the shortlists of the requests other than from's, returns the info hashes that took it
+  std::vector<u160::U160> share(const krpc::NodeInfo &node, const u160::U160 &from);
   [[nodiscard]]
-  bool has_node(const u160::U160 &id, const u160::U160 &node) const;
-  void set_node_traversed(const u160::U160 &id, const u160::U160 &node);
-  void create_request(
-      const u160::U160 &info_hash);
+  NodeCache &cache() { return cache_; }
 
+  [[nodiscard]]
+  size_t size() const { return requests_.size(); }
   [[nodiscard]]
   size_t memory_size() const;
 
-  std::map<u160::U160, std::vector<krpc::NodeInfo>> expand_routes(size_t n_per_request);
-
+  // Finish the expired requests
   void gc();
  private:
-  std::map<u160::U160, GetPeersRequest> requests_;
+  common::OpenHashMap<u160::U160, std::unique_ptr<GetPeersRequest>> requests_;
   std::chrono::seconds expiration_;
+  size_t k_;
+  size_t alpha_;
+  size_t shortlist_size_;
+  NodeCache cache_;
 };
 
-}
\ No newline at end of file
+}
@@ -15,6 +15,7 @@
 namespace albert::dht {
 
 void DHTImpl::continue_receive() {
+  receive_arena_.reset();
   socket.async_receive_from(
       boost::asio::buffer(receive_buffer),
       sender_endpoint,
@@ -23,14 +24,52 @@ void DHTImpl::continue_receive() {
                   boost::asio::placeholders::bytes_transferred));
 
 }
-std::function<void(const boost::system::error_code &, size_t)>
-DHTImpl::default_handle_send(const std::string &description) {
-  return boost::bind(
-      &DHTImpl::handle_send,
-      this,
-      description,
-      boost::asio::placeholders::error,
-      boost::asio::placeholders::bytes_transferred);
+
+DHTImpl::SendBuffer *DHTImpl::acquire_send_buffer() {
+  if (free_send_buffers_.empty()) {
+    send_buffers_.push_back(std::make_unique<SendBuffer>());
+    return send_buffers_.back().get();
+  }
+  auto ret = free_send_buffers_.back();
+  free_send_buffers_.pop_back();
+  return ret;
+}
+void DHTImpl::send_buffer(SendBuffer *buffer, size_t size, const udp::endpoint &ep, const std::string &description) {
+  socket.async_send_to(
+      boost::asio::buffer(buffer->data(), size),
+      ep,
+      [this, buffer, description](const boost::system::error_code &error, size_t bytes_transferred) {
+        free_send_buffers_.push_back(buffer);
+        handle_send(description, error, bytes_transferred);
+      });
+}
+void DHTImpl::send_query(
+    std::shared_ptr<krpc::Query> query,
+    routing_table::RoutingTable *routing_table,
+    const udp::endpoint &ep,
+    const std::string &description) {
+  auto buffer = acquire_send_buffer();
+  size_t size = 0;
+  try {
+    size = dht_->create_query(std::move(query), routing_table, ep.address().to_v4().to_uint(), ep.port(), *buffer);
+  } catch (const bencoding::WriterOverflow &e) {
+    LOG(error) << "DHTImpl: failed to encode '" << description << "': " << e.what();
+    free_send_buffers_.push_back(buffer);
+    return;
+  }
+  send_buffer(buffer, size, ep, description);
+}
+void DHTImpl::send_response(const krpc::Response &response, const udp::endpoint &ep, const std::string &description) {
+  auto buffer = acquire_send_buffer();
+  size_t size = 0;
+  try {
+    size = dht_->create_response(response, *buffer);
+  } catch (const bencoding::WriterOverflow &e) {
+    LOG(error) << "DHTImpl: failed to encode '" << description << "': " << e.what();
+    free_send_buffers_.push_back(buffer);
+    return;
+  }
+  send_buffer(buffer, size, ep, description);
 }
 
 [[nodiscard]]
@@ -49,10 +88,7 @@ void DHTImpl::send_find_node_response(
       nodes
   );
   udp::endpoint ep{boost::asio::ip::make_address_v4(receiver.ip()), receiver.port()};
-  socket.async_send_to(
-      boost::asio::buffer(dht_->create_response(*response)),
-      ep,
-      default_handle_send("find_node to " + receiver.to_string()));
+  send_response(*response, ep, "find_node to " + receiver.to_string());
   dht_->message_counters_[krpc::MessageTypeResponse + ":"s + krpc::MethodNameFindNode]++;
 }
 void DHTImpl::ping(const krpc::NodeInfo &target) {
@@ -61,10 +97,7 @@ void DHTImpl::ping(const krpc::NodeInfo &target) {
 
   std::stringstream ep_ss;
   ep_ss << ep;
-  socket.async_send_to(
-      boost::asio::buffer(dht_->create_query(ping_query, nullptr)),
-      ep,
-      default_handle_send("ping " + ep_ss.str()));
+  send_query(ping_query, nullptr, ep, "ping " + ep_ss.str());
   dht_->total_ping_query_sent_++;
 }
 
@@ -72,25 +105,13 @@ void DHTImpl::find_self(routing_table::RoutingTable &rt, const udp::endpoint &ep
   // bootstrap by finding self
   auto id = rt.self();
   auto find_node_query = std::make_shared<krpc::FindNodeQuery>(id, id);
-  socket.async_send_to(
-      boost::asio::buffer(
-          dht_->create_query(find_node_query, &rt)
-      ),
-      ep,
-      default_handle_send(std::string("find_self to " + ep.address().to_string() + ":" + std::to_string(ep.port())))
-  );
+  send_query(find_node_query, &rt, ep, "find_self to " + ep.address().to_string() + ":" + std::to_string(ep.port()));
 }
 void DHTImpl::find_node(routing_table::RoutingTable &rt, const udp::endpoint &ep, u160::U160 target) {
   // bootstrap by finding self
   auto id = rt.self();
   auto find_node_query = std::make_shared<krpc::FindNodeQuery>(id, target);
-  socket.async_send_to(
-      boost::asio::buffer(
-          dht_->create_query(find_node_query, &rt)
-      ),
-      ep,
-      default_handle_send(std::string("find_node to " + ep.address().to_string() + ":" + std::to_string(ep.port())))
-  );
+  send_query(find_node_query, &rt, ep, "find_node to " + ep.address().to_string() + ":" + std::to_string(ep.port()));
 }
 
 void DHTImpl::handle_send(const std::string &description, const boost::system::error_code &error, std::size_t bytes_transferred) {
@@ -99,33 +120,28 @@ void DHTImpl::handle_send(const std::string &description, const boost::system::e
   }
 }
 
-void DHTImpl::good_sender(const u160::U160 &sender_id, const std::string &version) {
+void DHTImpl::good_sender(const u160::U160 &sender_id, std::string_view version) {
+  // The tables share their entries, the first one that adds the sender stores it, the others only refer to it
+  routing_table::Entry entry(
+      sender_id,
+      sender_endpoint.address().to_v4().to_uint(),
+      sender_endpoint.port(),
+      std::string(version));
   for (auto &rt : dht_->routing_tables_) {
-    bool added = rt->add_node(
-        routing_table::Entry(
-            sender_id,
-            sender_endpoint.address().to_v4().to_uint(),
-            sender_endpoint.port(),
-            version));
+    bool added = rt->add_node(entry);
     if (added) {
       LOG(debug) << "DHTImpl: good sender " << sender_id.to_string();
     }
     rt->make_good_now(sender_id);
   }
 }
-void DHTImpl::try_to_send_get_peers_query(const u160::U160 &info_hash, const krpc::NodeInfo &receiver) {
-  if (dht_->get_peers_manager_->has_request(info_hash)) {
-    dht_->get_peers_manager_->add_node(info_hash, receiver);
-    auto query = std::make_shared<krpc::GetPeersQuery>(
-        self(),
-        info_hash
-    );
-    udp::endpoint ep{boost::asio::ip::make_address_v4(receiver.ip()), receiver.port()};
-    socket.async_send_to(
-        boost::asio::buffer(dht_->create_query(query, dht_->main_routing_table_)),
-        ep,
-        default_handle_send("get_peers " + info_hash.to_string() + ", to " + receiver.to_string()));
-  }
+void DHTImpl::send_get_peers_query(const u160::U160 &info_hash, const krpc::NodeInfo &receiver) {
+  auto query = std::make_shared<krpc::GetPeersQuery>(
+      self(),
+      info_hash
+  );
+  udp::endpoint ep{boost::asio::ip::make_address_v4(receiver.ip()), receiver.port()};
+  send_query(query, dht_->main_routing_table_, ep, "get_peers " + info_hash.to_string() + ", to " + receiver.to_string());
 }
 void DHTImpl::bootstrap_routing_table(routing_table::RoutingTable &routing_table) {
   // send bootstrap message to bootstrap nodes
@@ -158,10 +174,7 @@ void DHTImpl::send_sample_infohashes_query(const u160::U160 &target, const krpc:
       target
   );
   udp::endpoint ep{boost::asio::ip::make_address_v4(receiver.ip()), receiver.port()};
-  socket.async_send_to(
-      boost::asio::buffer(dht_->create_query(query, nullptr)),
-      ep,
-      default_handle_send("sample_infohashes"));
+  send_query(query, nullptr, ep, "sample_infohashes");
 }
 void DHTImpl::set_announce_peer_handler(std::function<void(const u160::U160 &info_hash)> handler) {
   this->announce_peer_handler_ = std::move(handler);
@@ -180,38 +193,34 @@ bool DHTImpl::bad_sender() {
   uint16_t port = sender_endpoint.port();
   return dht_->add_to_black_list(ip, port);
 }
-bool DHTImpl::try_to_handle_unknown_message(std::shared_ptr<bencoding::Node> node) {
+bool DHTImpl::try_to_handle_unknown_message(const bencoding::ArenaNode &node) {
   // libtorrent/utorrent extension:
   // According to https://www.libtorrent.org/dht_extensions.html,
   // any message which is not recognized but has either an info_hash or target argument is interpreted as find node
-  if (auto dict_node = std::dynamic_pointer_cast<bencoding::DictNode>(node); !dict_node) {
+  if (!node.is_dict()) {
     return false;
   } else {
-    auto &dict = dict_node->dict();
+    auto &dict = node;
     std::string target;
 
-    if (dict.find("info_hash") != dict.end()) {
-      if (auto s = std::dynamic_pointer_cast<bencoding::StringNode>(dict.at("info_hash")); s) {
-        target = *s;
+    if (auto s = dict.find("info_hash"); s) {
+      if (s->is_string()) {
+        target = s->as_string();
       }
-    } else if (dict.find("target") != dict.end()) {
-      if (auto s = std::dynamic_pointer_cast<bencoding::StringNode>(dict.at("target")); s) {
-        target = *s;
+    } else if (auto s = dict.find("target"); s) {
+      if (s->is_string()) {
+        target = s->as_string();
       }
     }
 
     std::string transaction_id = "unknown tx";
-    if (dict.find("t") != dict.end()) {
-      if (auto s = std::dynamic_pointer_cast<bencoding::StringNode>(dict.at("t")); s) {
-        transaction_id = *s;
-      }
+    if (auto s = dict.find("t"); s && s->is_string()) {
+      transaction_id = s->as_string();
     }
 
     u160::U160 sender_id;
-    if (dict.find("id") != dict.end()) {
-      if (auto s = std::dynamic_pointer_cast<bencoding::StringNode>(dict.at("id")); s) {
-        transaction_id = *s;
-      }
+    if (auto s = dict.find("id"); s && s->is_string()) {
+      transaction_id = s->as_string();
     }
 
     u160::U160 target_id;
@@ -222,10 +231,7 @@ bool DHTImpl::try_to_handle_unknown_message(std::shared_ptr<bencoding::Node> nod
     }
 
     auto nodes = dht_->main_routing_table_->k_nearest_good_nodes(target_id, routing_table::BucketMaxGoodItems);
-    std::vector<krpc::NodeInfo> info{};
-    for (auto &n : nodes) {
-      info.push_back(n.node_info());
-    }
+    std::vector<krpc::NodeInfo> info(nodes.begin(), nodes.end());
 
     send_find_node_response(
         transaction_id,
@@ -243,6 +249,8 @@ size_t DHTImpl::memory_size() const {
   size_t ret = sizeof(*this);
   ret += timers_.size() * sizeof(Timer);
   ret += throttler_.memory_size();
+  ret += receive_arena_.memory_size() - sizeof(receive_arena_);
+  ret += send_buffers_.size() * (sizeof(SendBuffer) + sizeof(void*) * 2);
   return ret;
 }
 
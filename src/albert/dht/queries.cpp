@@ -12,46 +12,41 @@
 #include <albert/dht/dht.hpp>
 #include <albert/dht/routing_table/routing_table.hpp>
 #include <albert/krpc/krpc.hpp>
+#include <albert/krpc/wire.hpp>
 #include <albert/log/log.hpp>
 #include <albert/utils/utils.hpp>
 #include <albert/io_latency/function_latency.hpp>
 
 namespace albert::dht {
 
-void DHTImpl::handle_ping_query(const krpc::PingQuery &query) {
-  krpc::PingResponse res(query.transaction_id(), maybe_fake_self(query.sender_id()));
+void DHTImpl::handle_ping_query(const krpc::wire::PingQuery &query) {
+  krpc::PingResponse res(std::string(query.transaction_id), maybe_fake_self(query.sender_id));
 
-  socket.async_send_to(
-      boost::asio::buffer(
-          dht_->create_response(res)
-      ),
-      sender_endpoint,
-      default_handle_send("ping query to " + query.sender_id().to_string()));
+  send_response(res, sender_endpoint, "ping query to " + query.sender_id.to_string());
   dht_->total_ping_query_received_++;
 
-  good_sender(query.sender_id(), query.version());
+  good_sender(query.sender_id, query.version);
 }
 
-void DHTImpl::handle_find_node_query(const krpc::FindNodeQuery &query) {
-  auto nodes = dht_->main_routing_table_->k_nearest_good_nodes(query.target_id(), routing_table::BucketMaxGoodItems);
-  std::vector<krpc::NodeInfo> info{};
-  for (auto &node : nodes) {
-    info.push_back(node.node_info());
-  }
+void DHTImpl::handle_find_node_query(const krpc::wire::FindNodeQuery &query) {
+  // Served from the published snapshot, which lags the table by a few changes and can be read by any thread
+  auto nodes = dht_->main_routing_table_->published()->k_nearest_good_nodes(
+      query.target_id, routing_table::BucketMaxGoodItems);
+  std::vector<krpc::NodeInfo> info(nodes.begin(), nodes.end());
 
   send_find_node_response(
-      query.transaction_id(),
+      std::string(query.transaction_id),
       krpc::NodeInfo{
-          maybe_fake_self(query.sender_id()),
+          maybe_fake_self(query.sender_id),
           sender_endpoint.address().to_v4().to_uint(),
           sender_endpoint.port()
       },
       info
   );
-  good_sender(query.sender_id(), query.version());
+  good_sender(query.sender_id, query.version);
 }
 
-void DHTImpl::handle_get_peers_query(const krpc::GetPeersQuery &query) {
+void DHTImpl::handle_get_peers_query(const krpc::wire::GetPeersQuery &query) {
   // TODO: implement complete get peers
 
   /**
@@ -59,7 +54,7 @@ void DHTImpl::handle_get_peers_query(const krpc::GetPeersQuery &query) {
    */
   std::vector<krpc::NodeInfo> nodes{};
   if (dht_->config_.fake_id) {
-    auto self_id = maybe_fake_self(query.sender_id());
+    auto self_id = maybe_fake_self(query.sender_id);
     nodes.push_back(krpc::NodeInfo(self_id, dht_->self_info_.ip(), dht_->self_info_.port()));
   }
 
@@ -68,37 +63,31 @@ void DHTImpl::handle_get_peers_query(const krpc::GetPeersQuery &query) {
   std::uniform_int_distribution<char> dist;
   std::generate(token.begin(), token.end(), [&]() { return dist(rng); });
   krpc::GetPeersResponse response(
-      query.transaction_id(),
+      std::string(query.transaction_id),
       krpc::ClientVersion,
-      maybe_fake_self(query.sender_id()),
+      maybe_fake_self(query.sender_id),
       token,
       nodes
   );
-  socket.async_send_to(
-      boost::asio::buffer(dht_->create_response(response)),
-      sender_endpoint,
-      default_handle_send("get_peers query " + query.sender_id().to_string()));
+  send_response(response, sender_endpoint, "get_peers query " + query.sender_id.to_string());
   dht_->message_counters_[krpc::MessageTypeResponse + ":"s + krpc::MethodNameFindNode]++;
 
   LOG(debug) << "get_peers query received from " << sender_endpoint
             << " token: '" << albert::utils::hexdump(token.data(), token.size(), false) << "'";
-  good_sender(query.sender_id(), query.version());
+  good_sender(query.sender_id, query.version);
 }
-void DHTImpl::handle_announce_peer_query(const krpc::AnnouncePeerQuery &query) {
+void DHTImpl::handle_announce_peer_query(const krpc::wire::AnnouncePeerQuery &query) {
   if (announce_peer_handler_) {
-    announce_peer_handler_(query.info_hash());
+    announce_peer_handler_(query.info_hash);
   }
   krpc::AnnouncePeerResponse response(
-      query.transaction_id(),
-      maybe_fake_self(query.sender_id())
+      std::string(query.transaction_id),
+      maybe_fake_self(query.sender_id)
   );
-  socket.async_send_to(
-      boost::asio::buffer(dht_->create_response(response)),
-      sender_endpoint,
-      default_handle_send("announce_peer query " + query.sender_id().to_string()));
+  send_response(response, sender_endpoint, "announce_peer query " + query.sender_id.to_string());
   dht_->message_counters_[krpc::MessageTypeResponse + ":"s + krpc::MethodNameFindNode]++;
 
-  good_sender(query.sender_id(), query.version());
+  good_sender(query.sender_id, query.version);
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,262 @@
+#include <albert/dht/routing_table/entry.hpp>
+
+#include <cstring>
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+#include <albert/log/log.hpp>
+
+namespace albert::dht::routing_table {
+
+namespace {
+
+using Clock = std::chrono::high_resolution_clock;
+
+uint32_t to_seconds(Clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::seconds>(time.time_since_epoch()).count();
+}
+
+Clock::time_point from_seconds(uint32_t seconds) {
+  return Clock::time_point(std::chrono::seconds(seconds));
+}
+
+}
+
+Entry::Entry(const krpc::NodeInfo &info, std::string_view version)
+    :ip_(info.ip()), port_(info.port()), version_length_(std::min(version.size(), MaxVersionLength)) {
+  info.id().encode(id_);
+  memcpy(version_, version.data(), version_length_);
+}
+
+Entry::Entry(const krpc::NodeInfo &info, std::string_view version, Clock::time_point last_seen)
+    :Entry(info, version) {
+  if (last_seen != Clock::time_point{}) {
+    last_seen_ = to_seconds(last_seen);
+  }
+}
+
+Clock::time_point Entry::last_seen() const {
+  return last_seen_ == 0 ? Clock::time_point{} : from_seconds(last_seen_);
+}
+
+bool Entry::is_good() const noexcept {
+  return is_good(common::CoarseClock::now());
+}
+
+bool Entry::is_good(std::chrono::high_resolution_clock::time_point now) const noexcept {
+  // A good node is a node has responded to one of our queries within the last 15 minutes,
+  // A node is also good if it has ever responded to one of our queries and has sent us a query within the last 15 minutes
+
+  return !is_bad(now) && last_seen_ != 0 && (now - from_seconds(last_seen_)) < std::chrono::minutes(MaxGoodNodeAliveMinutes);
+}
+
+bool Entry::is_bad() const {
+  return is_bad(common::CoarseClock::now());
+}
+
+bool Entry::is_bad(std::chrono::high_resolution_clock::time_point now) const {
+  if (!response_required_)
+    return false;
+
+  return (now - from_seconds(last_require_response_)) > krpc::KRPCTimeout || bad_;
+}
+
+EntryState Entry::state(std::chrono::high_resolution_clock::time_point now) const {
+  if (is_bad(now)) {
+    return EntryState::Bad;
+  }
+  return is_good(now) ? EntryState::Good : EntryState::Questionable;
+}
+
+std::chrono::high_resolution_clock::time_point Entry::next_state_change(
+    std::chrono::high_resolution_clock::time_point now) const {
+  auto ret = std::chrono::high_resolution_clock::time_point::max();
+  auto state = this->state(now);
+  if (state == EntryState::Bad) {
+    return ret;
+  }
+  if (response_required_) {
+    // is_bad() compares with >, so it turns bad one tick after the timeout
+    ret = from_seconds(last_require_response_) + krpc::KRPCTimeout + std::chrono::high_resolution_clock::duration(1);
+  }
+  if (state == EntryState::Good) {
+    ret = std::min(ret, from_seconds(last_seen_) + std::chrono::minutes(MaxGoodNodeAliveMinutes));
+  }
+  return ret;
+}
+
+bool Entry::require_response_now() {
+  if (!response_required_) {
+    response_required_ = true;
+    this->last_require_response_ = to_seconds(common::CoarseClock::now());
+    LOG(trace) << "require response " << to_string();
+    return true;
+  } else {
+    return false;
+  }
+}
+
+void Entry::make_good_now() {
+  this->last_seen_ = to_seconds(common::CoarseClock::now());
+  this->response_required_ = false;
+  this->bad_ = false;
+}
+
+void Entry::make_bad() {
+  bad_ = true;
+}
+
+EntryStore::TableId EntryStore::add_table(StateChangeCallback callback) {
+  for (size_t i = 0; i < MaxTables; i++) {
+    if (!tables_[i].used) {
+      tables_[i].used = true;
+      tables_[i].counts = {};
+      tables_[i].on_state_change = std::move(callback);
+      return i;
+    }
+  }
+  throw std::length_error("EntryStore::add_table(), too many tables");
+}
+
+void EntryStore::remove_table(TableId table) {
+  for (Slot slot = 0; slot < records_.size(); slot++) {
+    if (contains(table, slot)) {
+      remove(table, slot);
+    }
+  }
+  tables_[table] = {};
+}
+
+EntryStore::Slot EntryStore::insert(TableId table, Entry entry) {
+  auto key = endpoint_key(entry.ip(), entry.port());
+  auto it = endpoints_.find(key);
+  if (it != endpoints_.end()) {
+    auto slot = it->second;
+    auto &record = records_[slot];
+    if (record.entry.id() != entry.id() || contains(table, slot)) {
+      throw std::invalid_argument("EntryStore::insert(), endpoint " + krpc::format_ep(entry.ip(), entry.port()) + " already exists");
+    }
+    // Another table knows the node, its entry and state are shared
+    record.tables |= 1u << table;
+    tables_[table].counts[record.state]++;
+    return slot;
+  }
+
+  Slot slot;
+  if (free_slots_.empty()) {
+    slot = records_.size();
+    records_.emplace_back();
+  } else {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+  }
+  auto now = common::CoarseClock::now();
+  auto &record = records_[slot];
+  record.entry = std::move(entry);
+  record.tables = 1u << table;
+  record.state = record.entry.state(now);
+  record.scheduled = NotScheduled;
+  counts_[record.state]++;
+  tables_[table].counts[record.state]++;
+  endpoints_.emplace(key, slot);
+  update(slot, now);
+  return slot;
+}
+
+Entry EntryStore::remove(TableId table, Slot slot) {
+  auto &record = records_[slot];
+  record.tables &= ~(1u << table);
+  tables_[table].counts[record.state]--;
+  if (record.tables != 0) {
+    return record.entry;
+  }
+  record.scheduled = NotScheduled;
+  counts_[record.state]--;
+  endpoints_.erase(endpoint_key(record.entry.ip(), record.entry.port()));
+  free_slots_.push_back(slot);
+  return record.entry;
+}
+
+void EntryStore::reserve(size_t n) {
+  records_.reserve(n);
+  endpoints_.reserve(n);
+}
+
+void EntryStore::make_good_now(Slot slot) {
+  records_[slot].entry.make_good_now();
+  update(slot, common::CoarseClock::now());
+}
+
+void EntryStore::make_bad(Slot slot) {
+  records_[slot].entry.make_bad();
+  update(slot, common::CoarseClock::now());
+}
+
+bool EntryStore::require_response_now(Slot slot) {
+  auto ret = records_[slot].entry.require_response_now();
+  update(slot, common::CoarseClock::now());
+  return ret;
+}
+
+void EntryStore::expire(TimePoint now) {
+  schedule_.advance(tick(now), [this, now](Wheel::Tick deadline, Slot slot) {
+    auto &record = records_[slot];
+    // Removed, or rescheduled to an earlier deadline
+    if (record.tables == 0 || record.scheduled != deadline) {
+      return;
+    }
+    record.scheduled = NotScheduled;
+    update(slot, now);
+  });
+}
+
+EntryStore::Wheel::Tick EntryStore::tick(TimePoint time) {
+  return std::chrono::duration_cast<std::chrono::seconds>(time.time_since_epoch()).count();
+}
+
+void EntryStore::update(Slot slot, TimePoint now) {
+  auto &record = records_[slot];
+  auto state = record.entry.state(now);
+  if (state != record.state) {
+    auto old_state = record.state;
+    counts_[old_state]--;
+    counts_[state]++;
+    record.state = state;
+    for (auto tables = record.tables; tables != 0; tables &= tables - 1) {
+      auto &table = tables_[std::countr_zero(tables)];
+      table.counts[old_state]--;
+      table.counts[state]++;
+      if (table.on_state_change) {
+        table.on_state_change(slot, old_state, state);
+      }
+    }
+  }
+
+  // A later deadline is picked up when the current item is due, so each entry has at most one live item.
+  // Rounded up to the next tick, so the state has changed when the item is due
+  auto next = record.entry.next_state_change(now);
+  if (next == TimePoint::max()) {
+    return;
+  }
+  auto next_tick = tick(next) + 1;
+  if (next_tick < record.scheduled) {
+    record.scheduled = schedule_.schedule(next_tick, slot);
+  }
+}
+
+EntryStore::Slot EntryStore::find(uint32_t ip, uint16_t port) const {
+  auto it = endpoints_.find(endpoint_key(ip, port));
+  return it == endpoints_.end() ? npos : it->second;
+}
+
+size_t EntryStore::memory_size() const {
+  return sizeof(*this) +
+      records_.capacity() * sizeof(Record) +
+      free_slots_.capacity() * sizeof(Slot) +
+      schedule_.memory_size() +
+      endpoints_.memory_size();
+}
+
+}
@@ -0,0 +1,295 @@
+#include <albert/dht/routing_table/flat_table.hpp>
+
+#include <algorithm>
+
+#include <albert/log/log.hpp>
+
+namespace albert::dht::routing_table {
+
+size_t FlatTable::bucket_index(const u160::U160 &id) const {
+  return std::min(u160::U160::common_prefix_length(owner_->self(), id), BucketCount - 1);
+}
+
+u160::U160 FlatTable::prefix(size_t i) const {
+  auto self = owner_->self();
+  if (i == BucketCount - 1) {
+    return self & u160::U160::high_mask(i);
+  }
+  // The first i bits of self, then the flipped bit i
+  return (self & u160::U160::high_mask(i + 1)) ^ u160::U160::pow2(u160::U160Bits - 1 - i);
+}
+
+bool FlatTable::bucket_full(size_t i) const {
+  // Like the trie, the bucket self is in never gets full
+  return i < BucketCount - 1 && counts_[i].good >= owner_->max_bucket_size();
+}
+
+void FlatTable::count(size_t i, std::optional<EntryState> old_state, std::optional<EntryState> new_state) {
+  bool was_full = bucket_full(i);
+  bool had_good = counts_[i].good > 0;
+  if (old_state) {
+    counts_[i][*old_state]--;
+  }
+  if (new_state) {
+    counts_[i][*new_state]++;
+  }
+  full_bucket_count_ = full_bucket_count_ - was_full + bucket_full(i);
+  good_bucket_count_ = good_bucket_count_ - had_good + (counts_[i].good > 0);
+}
+
+size_t FlatTable::max_prefix_length() const {
+  return end_ == 0 ? 0 : prefix_length(end_ - 1);
+}
+
+void FlatTable::shrink_end() {
+  while (end_ > 0 && buckets_[end_ - 1].empty()) {
+    end_--;
+  }
+}
+
+size_t FlatTable::memory_size() const {
+  size_t ret = sizeof(*this) + positions_.memory_size();
+  for (auto &bucket : buckets_) {
+    ret += bucket.capacity() * sizeof(Item);
+  }
+  return ret;
+}
+
+void FlatTable::k_closest_good_nodes(KClosest &result) const {
+  // Returns false if the bucket is too far to add anything
+  auto add = [this, &result](size_t i) {
+    if (buckets_[i].empty()) {
+      return true;
+    }
+    if (!result.may_contain_closer(prefix(i), prefix_length(i))) {
+      return false;
+    }
+    for (auto &item : buckets_[i]) {
+      if (!result.accepts(item.id)) {
+        continue;
+      }
+      auto &entry = (*store_)[item.slot];
+      if (entry.is_good(result.now())) {
+        result.add(entry.node_info());
+      }
+    }
+    return true;
+  };
+
+  // Buckets in distance order: the bucket of the target, the ones closer to self, then the farther ones.
+  // Each of the farther ones is farther than the one before, so the first that is too far ends the search
+  auto b = bucket_index(result.target());
+  add(b);
+  for (size_t i = b + 1; i < end_; i++) {
+    add(i);
+  }
+  for (size_t i = b; i > 0 && add(i - 1); i--) {
+  }
+}
+
+bool FlatTable::add_node(Entry entry) {
+  auto id = entry.id();
+  if (positions_.contains(id)) {
+    return true;
+  }
+  auto b = bucket_index(id);
+  auto slot = store_->insert(owner_->table(), std::move(entry));
+  positions_.emplace(id, buckets_[b].size());
+  buckets_[b].push_back({id, slot});
+  end_ = std::max(end_, b + 1);
+  count(b, std::nullopt, store_->state(slot));
+  changed_at_[b] = common::CoarseClock::now();
+  if (refresh_scheduled_[b] == NotScheduled) {
+    schedule_refresh(b);
+  }
+  return true;
+}
+
+std::optional<Entry> FlatTable::remove(const u160::U160 &id) {
+  auto it = positions_.find(id);
+  if (it == positions_.end()) {
+    return {};
+  }
+  auto position = it->second;
+  positions_.erase(id);
+  auto b = bucket_index(id);
+  auto &bucket = buckets_[b];
+  auto removed = bucket[position].slot;
+  if (position + 1 != bucket.size()) {
+    bucket[position] = bucket.back();
+    positions_.at(bucket[position].id) = position;
+  }
+  bucket.pop_back();
+  shrink_end();
+  count(b, store_->state(removed), std::nullopt);
+  changed_at_[b] = common::CoarseClock::now();
+  return store_->remove(owner_->table(), removed);
+}
+
+void FlatTable::remove(uint32_t ip, uint16_t port) {
+  auto slot = store_->find(ip, port);
+  if (slot != EntryStore::npos) {
+    remove((*store_)[slot].id());
+  }
+}
+
+std::tuple<size_t, size_t, size_t, std::list<krpc::NodeInfo>> FlatTable::gc() {
+  size_t n_good_deleted = 0, n_questionable_deleted = 0, n_bad = 0;
+  std::list<krpc::NodeInfo> deleted;
+  std::vector<bool> to_delete;
+  std::vector<size_t> good_nodes, questionable_nodes;
+  for (size_t b = 0; b < BucketCount; b++) {
+    auto &bucket = buckets_[b];
+    // Nothing to delete, known from the counts without visiting the entries
+    if (counts_[b].bad == 0 && counts_[b].good + counts_[b].questionable <= owner_->max_bucket_size()) {
+      continue;
+    }
+    to_delete.assign(bucket.size(), false);
+    good_nodes.clear();
+    questionable_nodes.clear();
+    for (size_t i = 0; i < bucket.size(); i++) {
+      auto &entry = (*store_)[bucket[i].slot];
+      auto state = store_->state(bucket[i].slot);
+      if (state == EntryState::Bad) {
+        LOG(debug) << "FlatTable::gc() bucket " << b << " delete bad node " << entry.to_string();
+        owner_->black_list_node(entry.ip(), entry.port());
+        to_delete[i] = true;
+        n_bad++;
+      } else if (state == EntryState::Good) {
+        good_nodes.push_back(i);
+      } else {
+        questionable_nodes.push_back(i);
+      }
+    }
+
+    // Same policy as Bucket::gc(), questionable nodes go first, then extra good nodes
+    auto max_size = owner_->max_bucket_size();
+    auto n_non_bad = good_nodes.size() + questionable_nodes.size();
+    if (n_non_bad > max_size) {
+      for (size_t i = 0; i < std::min(n_non_bad - max_size, questionable_nodes.size()); i++) {
+        to_delete[questionable_nodes[i]] = true;
+        n_questionable_deleted++;
+      }
+    }
+    if (good_nodes.size() > max_size) {
+      for (size_t i = 0; i < good_nodes.size() - max_size; i++) {
+        to_delete[good_nodes[i]] = true;
+        n_good_deleted++;
+      }
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < bucket.size(); i++) {
+      if (to_delete[i]) {
+        count(b, store_->state(bucket[i].slot), std::nullopt);
+        positions_.erase(bucket[i].id);
+        deleted.push_back(store_->remove(owner_->table(), bucket[i].slot).node_info());
+      } else {
+        if (kept != i) {
+          positions_.at(bucket[i].id) = kept;
+        }
+        bucket[kept++] = bucket[i];
+      }
+    }
+    bucket.erase(bucket.begin() + kept, bucket.end());
+  }
+  shrink_end();
+  return {n_good_deleted, n_questionable_deleted, n_bad, deleted};
+}
+
+void FlatTable::iterate_entries(const std::function<void(const Entry &)> &cb) const {
+  for (auto &bucket : buckets_) {
+    for (auto &item : bucket) {
+      cb((*store_)[item.slot]);
+    }
+  }
+}
+
+bool FlatTable::require_response_now(const u160::U160 &id) {
+  auto slot = search(id);
+  return slot != EntryStore::npos && store_->require_response_now(slot);
+}
+
+bool FlatTable::make_good_now(const u160::U160 &id) {
+  auto slot = search(id);
+  if (slot != EntryStore::npos) {
+    store_->make_good_now(slot);
+    changed_at_[bucket_index(id)] = common::CoarseClock::now();
+    return true;
+  }
+  return false;
+}
+
+bool FlatTable::make_good_now(uint32_t ip, uint16_t port) {
+  auto slot = store_->find(ip, port);
+  if (slot != EntryStore::npos && store_->contains(owner_->table(), slot)) {
+    store_->make_good_now(slot);
+    changed_at_[bucket_index((*store_)[slot].id())] = common::CoarseClock::now();
+    return true;
+  }
+  return false;
+}
+
+void FlatTable::make_bad(uint32_t ip, uint16_t port) {
+  auto slot = store_->find(ip, port);
+  if (slot != EntryStore::npos) {
+    store_->make_bad(slot);
+  }
+}
+
+void FlatTable::state_changed(EntryStore::Slot slot, EntryState old_state, EntryState new_state) {
+  count(bucket_index((*store_)[slot].id()), old_state, new_state);
+}
+
+void FlatTable::schedule_refresh(size_t i) {
+  refresh_scheduled_[i] = refresh_wheel_->schedule(
+      EntryStore::tick(changed_at_[i] + std::chrono::minutes(BucketRefreshMinutes)) + 1, {prefix(i), prefix_length(i)});
+}
+
+std::optional<u160::U160> FlatTable::refresh(
+    const RefreshWheel::Tick &tick, const std::pair<u160::U160, size_t> &item) {
+  auto b = bucket_index(item.first);
+  if (refresh_scheduled_[b] != tick) {
+    return {};
+  }
+  // Empty buckets are scheduled again when they get a node
+  if (buckets_[b].empty()) {
+    refresh_scheduled_[b] = NotScheduled;
+    return {};
+  }
+  std::optional<u160::U160> ret;
+  auto now = common::CoarseClock::now();
+  if (now - changed_at_[b] >= std::chrono::minutes(BucketRefreshMinutes)) {
+    ret = u160::U160::random_from_prefix(prefix(b), prefix_length(b));
+    changed_at_[b] = now;
+  }
+  schedule_refresh(b);
+  return ret;
+}
+
+void FlatTable::encode(std::ostream &os) const {
+  os << "[" << std::endl;
+  bool first = true;
+  for (size_t i = 0; i < BucketCount; i++) {
+    if (buckets_[i].empty()) {
+      continue;
+    }
+    if (!first) {
+      os << "  ," << std::endl;
+    }
+    first = false;
+    os << "  {" << std::endl;
+    os << R"(    "prefix_length": )" << prefix_length(i) << "," << std::endl;
+    os << R"(    "prefix": ")" << prefix(i).to_string() << "\"," << std::endl;
+    os << R"(    "entry_count": )" << buckets_[i].size() << std::endl;
+    os << "  }" << std::endl;
+  }
+  os << "]" << std::endl;
+}
+
+EntryStore::Slot FlatTable::search(const u160::U160 &id) const {
+  auto it = positions_.find(id);
+  return it == positions_.end() ? EntryStore::npos : buckets_[bucket_index(id)][it->second].slot;
+}
+
+}
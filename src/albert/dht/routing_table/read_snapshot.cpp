@@ -0,0 +1,58 @@
+#include <albert/dht/routing_table/read_snapshot.hpp>
+
+#include <algorithm>
+#include <utility>
+
+namespace albert::dht::routing_table {
+
+ReadSnapshot::ReadSnapshot(uint64_t version, std::vector<krpc::NodeInfo> nodes)
+    :version_(version), nodes_(std::move(nodes)) {
+  std::sort(nodes_.begin(), nodes_.end(), [](const krpc::NodeInfo &lhs, const krpc::NodeInfo &rhs) {
+    return lhs.id() < rhs.id();
+  });
+  nodes_.shrink_to_fit();
+}
+
+ClosestNodes ReadSnapshot::k_nearest_good_nodes(const u160::U160 &id, size_t k) const {
+  ClosestNodes result;
+  closest(nodes_.begin(), nodes_.end(), 0, id, std::min(k, MaxClosestNodes), result);
+  return result;
+}
+
+void ReadSnapshot::closest(
+    Iterator first, Iterator last, size_t depth, const u160::U160 &target, size_t k, ClosestNodes &result) {
+  if (k == 0 || first == last) {
+    return;
+  }
+  // Ids are unique, so there is one node left at the last bit
+  if (size_t(last - first) <= k || depth == u160::U160Bits) {
+    // Few enough to sort by distance directly
+    ClosestNodes nodes;
+    for (auto it = first; it != last; ++it) {
+      nodes.push_back(*it);
+    }
+    std::sort(nodes.begin(), nodes.end(), [&target](const krpc::NodeInfo &lhs, const krpc::NodeInfo &rhs) {
+      return (lhs.id() ^ target) < (rhs.id() ^ target);
+    });
+    for (auto &node : nodes) {
+      result.push_back(node);
+    }
+    return;
+  }
+
+  // Ids with a 0 at depth come first, the half on the side of the target is closer than all of the other half
+  auto bit = u160::U160Bits - 1 - depth;
+  auto mid = std::partition_point(first, last, [bit](const krpc::NodeInfo &node) { return !node.id().bit(bit); });
+  auto near_first = first, near_last = mid, far_first = mid, far_last = last;
+  if (target.bit(bit)) {
+    std::swap(near_first, far_first);
+    std::swap(near_last, far_last);
+  }
+  size_t near_count = near_last - near_first;
+  closest(near_first, near_last, depth + 1, target, k, result);
+  if (near_count < k) {
+    closest(far_first, far_last, depth + 1, target, k - near_count, result);
+  }
+}
+
+}
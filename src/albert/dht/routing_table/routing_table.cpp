@@ -1,8 +1,13 @@
 #include <albert/dht/routing_table/routing_table.hpp>
+#include <albert/dht/routing_table/flat_table.hpp>
+#include <albert/dht/routing_table/snapshot.hpp>
+
+#include <cstring>
 
 #include <random>
 #include <memory>
 #include <fstream>
+#include <utility>
 
 #include <boost/asio/ip/address_v4.hpp>
 
@@ -33,14 +38,17 @@ void Bucket::split_if_required() {
   right_->prefix_length_ = prefix_length_ + 1;
 
   for (auto &item : known_nodes_) {
-    if (left_->in_bucket(item.first)) {
-      left_->known_nodes_.emplace(item.first, std::move(item.second));
-    } else {
-      assert(right_->in_bucket(item.first));
-      right_->known_nodes_.emplace(item.first, std::move(item.second));
-    }
+    auto child = left_->in_bucket(item.first) ? left_.get() : right_.get();
+    assert(child->in_bucket(item.first));
+    child->known_nodes_.emplace(item.first, std::move(item.second));
+    child->counts_[store_->state(item.second)]++;
   }
   known_nodes_.clear();
+  left_->update_aggregates();
+  right_->update_aggregates();
+  left_->changed_at_ = right_->changed_at_ = changed_at_;
+  left_->schedule_refresh();
+  right_->schedule_refresh();
 
   left_->split_if_required();
   right_->split_if_required();
@@ -56,30 +64,53 @@ void Bucket::merge() {
     known_nodes_.emplace(item.first, std::move(item.second));
   }
 
+  changed_at_ = std::max(left_->changed_at_, right_->changed_at_);
   left_ = nullptr;
   right_ = nullptr;
+  update_aggregates();
+  schedule_refresh();
+}
+
+void Bucket::update_aggregates() {
+  for (auto bucket = this; bucket; bucket = bucket->parent_) {
+    if (bucket->is_leaf()) {
+      // counts_ of a leaf is updated in place, so it is also right after merge() because the sum did not change
+      bucket->leaf_count_ = 1;
+      bool full = bucket->self_in_bucket() ?
+          bucket->prefix_length_ >= int(u160::U160Bits - 1) :
+          bucket->counts_.good >= bucket->owner_->max_bucket_size();
+      bucket->non_full_leaf_count_ = full ? 0 : 1;
+      bucket->good_leaf_count_ = bucket->counts_.good > 0 ? 1 : 0;
+      bucket->max_prefix_length_ = bucket->prefix_length_;
+      bucket->memory_size_ = sizeof(Bucket) + bucket->known_nodes_.memory_size();
+    } else {
+      auto &l = *bucket->left_, &r = *bucket->right_;
+      bucket->counts_ = l.counts_;
+      bucket->counts_ += r.counts_;
+      bucket->leaf_count_ = l.leaf_count_ + r.leaf_count_;
+      bucket->non_full_leaf_count_ = l.non_full_leaf_count_ + r.non_full_leaf_count_;
+      bucket->good_leaf_count_ = l.good_leaf_count_ + r.good_leaf_count_;
+      bucket->max_prefix_length_ = std::max(l.max_prefix_length_, r.max_prefix_length_);
+      bucket->memory_size_ = sizeof(Bucket) + bucket->known_nodes_.memory_size() + l.memory_size_ + r.memory_size_;
+    }
+  }
 }
 
 
 
 bool Bucket::add_node(Entry entry) {
   assert(in_bucket(entry.id()));
-  if (is_leaf()) {
-    bool added = false;
-//    if (self_in_bucket() || good_node_count() < BucketMaxGoodItems) {
-      known_nodes_.insert(std::make_pair(entry.id(), std::move(entry)));
-      added = true;
-//    }
-    split_if_required();
-    return added;
-  } else {
-    if (left_->in_bucket(entry.id())) {
-      return left_->add_node(std::move(entry));
-    } else {
-      assert(right_->in_bucket(entry.id()));
-      return right_->add_node(std::move(entry));
-    }
+  auto bucket = leaf(entry.id());
+  if (!bucket->known_nodes_.contains(entry.id())) {
+    auto id = entry.id();
+    auto slot = store_->insert(owner_->table(), std::move(entry));
+    bucket->known_nodes_.emplace(id, slot);
+    bucket->counts_[store_->state(slot)]++;
+    bucket->touch();
+    bucket->update_aggregates();
+    bucket->split_if_required();
   }
+  return true;
 }
 void Bucket::encode_(std::ostream &os, int i) {
   if (is_leaf()) {
@@ -93,67 +124,44 @@ void Bucket::encode_(std::ostream &os, int i) {
     right_->encode_(os, i);
   }
 }
-size_t Bucket::leaf_count() const {
-  if (is_leaf()) {
-    return 1;
-  } else {
-    return left_->leaf_count() + right_->leaf_count();
-  }
-}
 void Bucket::encode(std::ostream &os) {
   os << "[" << std::endl;
   encode_(os, 1);
   os << "]" << std::endl;
 
 }
-std::list<Entry> Bucket::k_nearest_good_nodes(const u160::U160 &id, size_t k) const {
-  assert(k > 0);
+void Bucket::k_closest_good_nodes(KClosest &result) const {
+  if (!result.may_contain_closer(prefix_, prefix_length_)) {
+    return;
+  }
   if (is_leaf()) {
-    std::list<Entry> results;
     for (auto &item : known_nodes_) {
-      results.push_back(item.second);
-      if (results.size() >= k) {
-        break;
+      auto &entry = (*store_)[item.second];
+      if (result.accepts(item.first) && entry.is_good(result.now())) {
+        result.add(entry.node_info());
       }
     }
-    return results;
   } else {
-    Bucket *primary_node{}, *secondary_node{};
-    if (!id.bit(u160::U160Bits - prefix_length_ - 1)) {
-      primary_node = left_.get();
-      secondary_node = right_.get();
-    } else {
-      primary_node = right_.get();
-      secondary_node = left_.get();
-    }
-    auto result = primary_node->k_nearest_good_nodes(id, k);
-    if (result.size() < k) {
-      result.merge(secondary_node->k_nearest_good_nodes(id, k - result.size()));
-    }
-    return result;
-  }
-}
-bool Bucket::is_full() const {
-  if (is_leaf()) {
-    if (self_in_bucket()) {
-      return prefix_length_ >= (u160::U160Bits - 1);
+    // The child on the side of the target first, it is closer, so the other one is more likely to be skipped
+    if (!result.target().bit(u160::U160Bits - prefix_length_ - 1)) {
+      left_->k_closest_good_nodes(result);
+      right_->k_closest_good_nodes(result);
     } else {
-      return good_node_count() >= owner_->max_bucket_size();
+      right_->k_closest_good_nodes(result);
+      left_->k_closest_good_nodes(result);
     }
-  } else {
-    return left_->is_full() && right_->is_full();
   }
 }
-
-std::list<std::tuple<Entry, u160::U160>> Bucket::find_some_node_for_filling_bucket(size_t k) const {
-  std::list<Entry> selected_nodes;
-  std::list<Entry> good_nodes;
-  std::list<Entry> questionable_nodes;
+std::list<std::tuple<krpc::NodeInfo, u160::U160>> Bucket::find_some_node_for_filling_bucket(size_t k) const {
+  std::list<krpc::NodeInfo> selected_nodes;
+  std::list<krpc::NodeInfo> good_nodes;
+  std::list<krpc::NodeInfo> questionable_nodes;
   for (auto &item : known_nodes_) {
-    if (item.second.is_good()) {
-      good_nodes.push_back(item.second);
-    } else if (!item.second.is_bad()) {
-      questionable_nodes.push_back(item.second);
+    auto state = store_->state(item.second);
+    if (state == EntryState::Good) {
+      good_nodes.push_back((*store_)[item.second].node_info());
+    } else if (state == EntryState::Questionable) {
+      questionable_nodes.push_back((*store_)[item.second].node_info());
     }
   }
 
@@ -178,19 +186,12 @@ std::list<std::tuple<Entry, u160::U160>> Bucket::find_some_node_for_filling_buck
 
   auto virtual_target_id =
       u160::U160::random_from_prefix(prefix_, prefix_length_);
-  std::list<std::tuple<Entry, u160::U160>> results;
+  std::list<std::tuple<krpc::NodeInfo, u160::U160>> results;
   for (auto &item : selected_nodes) {
     results.emplace_back(item, virtual_target_id);
   }
   return results;
 }
-size_t Bucket::total_good_node_count() const {
-  if (is_leaf()) {
-    return good_node_count();
-  } else {
-    return left_->total_good_node_count() + right_->total_good_node_count();
-  }
-}
 void Bucket::dfs(const std::function<void(const Bucket &)> &cb) const {
   cb(*this);
   if (!is_leaf()) {
@@ -198,17 +199,15 @@ void Bucket::dfs(const std::function<void(const Bucket &)> &cb) const {
     right_->dfs(cb);
   }
 }
-bool Bucket::dfs_w(const std::function<bool (Bucket &)> &cb) {
-  if (cb(*this)) {
-    if (!is_leaf()) {
-      if (left_->dfs_w(cb)) {
-        return right_->dfs_w(cb);
-      }
-    } else {
-      return true;
-    }
+Bucket *Bucket::leaf(const u160::U160 &id) {
+  return const_cast<Bucket*>(std::as_const(*this).leaf(id));
+}
+const Bucket *Bucket::leaf(const u160::U160 &id) const {
+  auto bucket = this;
+  while (!bucket->is_leaf()) {
+    bucket = bucket->left_->in_bucket(id) ? bucket->left_.get() : bucket->right_.get();
   }
-  return false;
+  return bucket;
 }
 void Bucket::bfs(const std::function<void(const Bucket &)> &cb) const {
   std::list<const Bucket*> queue;
@@ -240,131 +239,110 @@ u160::U160 Bucket::min() const {
   return prefix_;
 }
 bool Bucket::make_good_now(const u160::U160 &id) {
-  bool found = false;
-  Bucket *bucket = nullptr;
-  // TODO: optimize dfs to searching by id prefix
-  dfs_w([&found, id, &bucket](Bucket &b) -> bool {
-    if (!found && b.is_leaf()) {
-      for (auto &item : b.known_nodes_) {
-        if (item.first == id) {
-          item.second.make_good_now();
-          found = true;
-          bucket = &b;
-          return false;
-        }
-      }
-    }
-    return true;
-  });
-  if (bucket) {
-    bucket->split_if_required();
+  auto bucket = leaf(id);
+  auto it = bucket->known_nodes_.find(id);
+  if (it == bucket->known_nodes_.end()) {
+    return false;
   }
-  return found;
+  store_->make_good_now(it->second);
+  bucket->touch();
+  bucket->split_if_required();
+  return true;
 }
 bool Bucket::make_good_now(uint32_t ip, uint16_t port) {
-  bool found = false;
-  Bucket *bucket = nullptr;
-  dfs_w([&found, &bucket, ip, port](Bucket &b) -> bool {
-    if (!found && b.is_leaf()) {
-      for (auto &item : b.known_nodes_) {
-        if (item.second.ip() == ip && item.second.port() == port) {
-          item.second.make_good_now();
-          found = true;
-          bucket = &b;
-          return false;
-        }
-      }
-    }
-    return true;
-  });
-  if (bucket) {
-    bucket->split_if_required();
+  auto slot = store_->find(ip, port);
+  if (slot == EntryStore::npos) {
+    return false;
   }
-  return found;
+  return make_good_now((*store_)[slot].id());
 }
 std::string Bucket::indent(int n) {
   return std::string(n*2, ' ');
 }
-size_t Bucket::good_node_count() const {
-  size_t ret = 0;
-  for (auto &item : known_nodes_) {
-    if (item.second.is_good()) {
-      ret++;
-    }
-  }
-  return ret;
-}
-size_t Bucket::total_known_node_count() const {
-  if (is_leaf()) {
-    return known_node_count();
-  } else {
-    return left_->total_known_node_count() + right_->total_known_node_count();
-  }
-}
 size_t Bucket::known_node_count() const {
   return this->known_nodes_.size();
 }
 void Bucket::iterate_entries(const std::function<void(const Entry &)> &cb) const {
   for (auto &item : known_nodes_) {
-    cb(item.second);
+    cb((*store_)[item.second]);
   }
 }
 std::optional<Entry> Bucket::remove(const u160::U160 &id) {
-  std::optional<Entry> ret;
-  dfs_w([id, &ret](Bucket &bucket) -> bool {
-    if (bucket.known_nodes_.find(id) != bucket.known_nodes_.end()) {
-      ret.emplace(std::move(bucket.known_nodes_.at(id)));
-      bucket.known_nodes_.erase(id);
-      return false;
-    }
-    return true;
-  });
-  return ret;
+  auto bucket = leaf(id);
+  auto it = bucket->known_nodes_.find(id);
+  if (it == bucket->known_nodes_.end()) {
+    return {};
+  }
+  auto slot = it->second;
+  bucket->known_nodes_.erase(id);
+  bucket->counts_[store_->state(slot)]--;
+  bucket->touch();
+  bucket->update_aggregates();
+  return store_->remove(owner_->table(), slot);
 }
 bool Bucket::require_response_now(const u160::U160 &target) {
-  auto entry = search(target);
-  if (entry) {
-    entry->require_response_now();
-    return true;
-  } else {
-    return false;
-  }
-}
-Entry *Bucket::search(const u160::U160 &id) {
-  Entry *ret = nullptr;
-  bool found = false;
-  dfs_w([&ret, &found, &id](Bucket &bucket) -> bool {
-    if (!found && bucket.is_leaf()) {
-      for (auto &item : bucket.known_nodes_) {
-        if (item.first == id) {
-          ret = &item.second;
-          return false;
-        }
-      }
+  auto slot = search(target);
+  return slot != EntryStore::npos && store_->require_response_now(slot);
+}
+EntryStore::Slot Bucket::search(const u160::U160 &id) const {
+  auto bucket = leaf(id);
+  auto it = bucket->known_nodes_.find(id);
+  return it == bucket->known_nodes_.end() ? EntryStore::npos : it->second;
+}
+void Bucket::schedule_refresh() {
+  // A merged bucket may be due already, the wheel moves its deadline to the next tick
+  refresh_scheduled_ = refresh_wheel_->schedule(
+      EntryStore::tick(changed_at_ + std::chrono::minutes(BucketRefreshMinutes)) + 1, {prefix_, prefix_length_});
+}
+std::optional<u160::U160> Bucket::refresh(
+    const RefreshWheel::Tick &tick, const std::pair<u160::U160, size_t> &item) {
+  auto bucket = leaf(item.first);
+  // Split, merged or rescheduled since
+  if (bucket->prefix_length() != item.second || bucket->refresh_scheduled_ != tick) {
+    return {};
+  }
+  std::optional<u160::U160> ret;
+  auto now = common::CoarseClock::now();
+  if (now - bucket->changed_at_ >= std::chrono::minutes(BucketRefreshMinutes)) {
+    if (bucket->known_node_count() > 0) {
+      ret = u160::U160::random_from_prefix(bucket->prefix_, bucket->prefix_length_);
     }
-    return true;
-  });
+    bucket->changed_at_ = now;
+  }
+  bucket->schedule_refresh();
   return ret;
-
+}
+void Bucket::state_changed(EntryStore::Slot slot, EntryState old_state, EntryState new_state) {
+  auto bucket = leaf((*store_)[slot].id());
+  bucket->counts_[old_state]--;
+  bucket->counts_[new_state]++;
+  bucket->update_aggregates();
 }
 std::tuple<size_t, size_t, size_t, std::list<krpc::NodeInfo>> Bucket::gc() {
   if (is_leaf()) {
+    // Nothing to delete, known from the counts without visiting the entries
+    auto max_size = owner_->max_bucket_size();
+    if (counts_.bad == 0 && counts_.good + counts_.questionable <= max_size) {
+      return {0, 0, 0, {}};
+    }
     std::list<krpc::NodeInfo> nodes_to_delete;
     std::vector<krpc::NodeInfo> questionable_nodes, good_nodes;
     size_t n_good = 0, n_non_bad = 0, n_bad = 0;
     for (auto &node : known_nodes_) {
-      if (node.second.is_bad()) {
-        LOG(debug) << "Bucket::gc() prefix " << prefix_length_ << " delete bad node " << node.second.to_string();
-        nodes_to_delete.push_back(node.second.node_info());
-        owner_->black_list_node(node.second.ip(), node.second.port());
+      auto &entry = (*store_)[node.second];
+      auto state = store_->state(node.second);
+      if (state == EntryState::Bad) {
+        LOG(debug) << "Bucket::gc() prefix " << prefix_length_ << " delete bad node " << entry.to_string();
+        nodes_to_delete.push_back(entry.node_info());
+        owner_->black_list_node(entry.ip(), entry.port());
         n_bad++;
-      } else if (node.second.is_good()) {
+      } else if (state == EntryState::Good) {
         n_good++;
         n_non_bad++;
-        good_nodes.push_back(node.second.node_info());
+        good_nodes.push_back(entry.node_info());
       } else {
         n_non_bad++;
-        questionable_nodes.push_back(node.second.node_info());
+        questionable_nodes.push_back(entry.node_info());
       }
     }
     size_t n_good_deleted = 0, n_questionable_deleted = 0;
@@ -388,15 +366,20 @@ std::tuple<size_t, size_t, size_t, std::list<krpc::NodeInfo>> Bucket::gc() {
     }
 
     for (auto &node : nodes_to_delete) {
+      auto slot = known_nodes_.at(node.id());
+      counts_[store_->state(slot)]--;
+      store_->remove(owner_->table(), slot);
       known_nodes_.erase(node.id());
     }
+    known_nodes_.shrink_to_fit();
+    update_aggregates();
     return {n_good_deleted, n_questionable_deleted, n_bad, nodes_to_delete};
   } else {
     size_t a1, a2, b1, b2, c1, c2;
     std::list<krpc::NodeInfo> l, r;
     std::tie(a1, b1, c1, l) = right_->gc();
     std::tie(a2, b2, c2, r) = left_->gc();
-    l.merge(r);
+    l.splice(l.end(), r);
 
     // merge buckets when all the sub-buckets are no bigger than max/2
     if (left_->is_leaf() && right_->is_leaf()) {
@@ -410,43 +393,62 @@ std::tuple<size_t, size_t, size_t, std::list<krpc::NodeInfo>> Bucket::gc() {
 }
 
 void Bucket::make_bad(uint32_t ip, uint16_t port) {
-  dfs_w([ip, port](Bucket &b) -> bool {
-    if (b.is_leaf()) {
-      for (auto &item : b.known_nodes_) {
-        if (item.second.ip() == ip && item.second.port() == port) {
-          item.second.make_bad();
-          return false;
-        }
-      }
-    }
-    return true;
-  });
-}
-size_t Bucket::memory_size() const {
-  size_t ret = sizeof(*this);
-  ret += known_node_count() * (sizeof(u160::U160) + sizeof(Entry));
-  if (left_) {
-    ret += left_->memory_size();
-  }
-  if (right_) {
-    ret += right_->memory_size();
+  auto slot = store_->find(ip, port);
+  if (slot != EntryStore::npos) {
+    store_->make_bad(slot);
   }
-  return ret;
 }
 void Bucket::remove(uint32_t ip, uint16_t port) {
-  dfs_w([ip, port](Bucket &bucket) -> bool {
-    for (auto &item : bucket.known_nodes_) {
-      if (item.second.ip() == ip && item.second.port() == port) {
-        bucket.known_nodes_.erase(item.first);
-        return false;
-      }
+  auto slot = store_->find(ip, port);
+  if (slot != EntryStore::npos) {
+    remove((*store_)[slot].id());
+  }
+}
+
+RoutingTable::RoutingTable(
+    u160::U160 self_id, std::string name, std::string save_path, size_t max_bucket_size, size_t max_known_nodes,
+    bool delete_good, bool fat_mode, bool flat_mode, std::function<void(uint32_t, uint16_t)> black_list_node,
+    std::shared_ptr<EntryStore> store)
+    :shared_store_(store != nullptr),
+     entries_(store ? std::move(store) : std::make_shared<EntryStore>()),
+     refresh_wheel_(EntryStore::tick(common::CoarseClock::now())),
+     root_(this, entries_.get(), &refresh_wheel_, fat_mode),
+     self_id_(self_id),
+     save_path_(std::move(save_path)),
+     name_(std::move(name)),
+     max_bucket_size_(max_bucket_size),
+     delete_good_nodes_(delete_good),
+     fat_mode_(fat_mode),
+     max_known_nodes_(max_known_nodes),
+     black_list_node_(std::move(black_list_node)) {
+  if (flat_mode) {
+    if (fat_mode) {
+      throw std::invalid_argument("RoutingTable constructor, flat mode does not support fat mode");
+    }
+    flat_ = std::make_unique<FlatTable>(this, entries_.get(), &refresh_wheel_);
+  }
+  table_ = entries_->add_table([this](EntryStore::Slot slot, EntryState old_state, EntryState new_state) {
+    if (flat_) {
+      flat_->state_changed(slot, old_state, new_state);
+    } else {
+      root_.state_changed(slot, old_state, new_state);
+    }
+    if (new_state == EntryState::Questionable) {
+      questionable_nodes_.push_back((*entries_)[slot].id());
+    }
+    if (old_state == EntryState::Good || new_state == EntryState::Good) {
+      version_++;
     }
-    return true;
   });
+  root_.update_aggregates();
+  if (!flat_) {
+    root_.schedule_refresh();
+  }
 }
 
-std::list<std::tuple<Entry, u160::U160>> RoutingTable::select_expand_route_targets() {
-  std::list<std::tuple<Entry, u160::U160>> entries;
+std::list<std::tuple<krpc::NodeInfo, u160::U160>> RoutingTable::select_expand_route_targets() {
+  std::list<std::tuple<krpc::NodeInfo, u160::U160>> entries;
+  update_states();
   if (fat_mode_) {
     // for fat routing tables, we make it shallow and fat
     root_.bfs([&entries](const Bucket &bucket) {
@@ -456,18 +458,61 @@ std::list<std::tuple<Entry, u160::U160>> RoutingTable::select_expand_route_targe
     });
   } else {
     // for non fat routing tables, we make it deep
-    for (auto &entry : root_.k_nearest_good_nodes(self(), max_bucket_size())) {
-      entries.emplace_back(entry, self());
+    for (auto &node : k_nearest_good_nodes(self(), max_bucket_size())) {
+      entries.emplace_back(node, self());
     }
   }
   return entries;
 }
+std::list<std::tuple<krpc::NodeInfo, u160::U160>> RoutingTable::select_refresh_targets() {
+  std::vector<u160::U160> targets;
+  refresh_wheel_.advance(
+      EntryStore::tick(common::CoarseClock::now()),
+      [this, &targets](RefreshWheel::Tick tick, const std::pair<u160::U160, size_t> &item) {
+        auto target = flat_ ? flat_->refresh(tick, item) : root_.refresh(tick, item);
+        if (target) {
+          targets.push_back(*target);
+        }
+      });
+
+  std::list<std::tuple<krpc::NodeInfo, u160::U160>> ret;
+  for (auto &target : targets) {
+    auto nodes = k_nearest_good_nodes(target, 1);
+    if (!nodes.empty()) {
+      ret.emplace_back(nodes.front(), target);
+    }
+  }
+  return ret;
+}
+
+std::vector<krpc::NodeInfo> RoutingTable::select_nodes_to_ping(size_t max) {
+  update_states();
+  std::vector<krpc::NodeInfo> ret;
+  while (ret.size() < max && !questionable_nodes_.empty()) {
+    auto id = questionable_nodes_.front();
+    questionable_nodes_.pop_front();
+    auto slot = search(id);
+    // Removed, or responded since
+    if (slot == EntryStore::npos || entries_->state(slot) != EntryState::Questionable) {
+      continue;
+    }
+    if (entries_->require_response_now(slot)) {
+      ret.push_back((*entries_)[slot].node_info());
+    }
+  }
+  return ret;
+}
+
 void RoutingTable::encode(std::ostream &os) {
   os << "{"  << std::endl;
   os << R"("type": "routing_table",)" << std::endl;
   os << R"("self_id": ")" << self_id_.to_string() << "\"," << std::endl;
   os << R"("data": )" << std::endl;
-  root_.encode(os);
+  if (flat_) {
+    flat_->encode(os);
+  } else {
+    root_.encode(os);
+  }
   os << "}" << std::endl;
 }
 
@@ -477,7 +522,8 @@ struct TrieLevelStat {
   size_t buckets = 0;
 };
 
-void RoutingTable::stat() const {
+void RoutingTable::stat() {
+  update_states();
   LOG(info) << "Routing Table: ";
   if (fat_mode_) {
     std::map<size_t, TrieLevelStat> level_stat;
@@ -492,6 +538,13 @@ void RoutingTable::stat() const {
     for (auto &item : level_stat) {
       LOG(debug) << "  depth=" << item.first << ", buckets=" << item.second.buckets << " " << item.second.good << "/" << item.second.known;
     }
+  } else if (flat_) {
+    for (size_t i = 0; i < FlatTable::BucketCount; i++) {
+      if (flat_->bucket_known_node_count(i) > 0) {
+        LOG(debug) << "  len(p)=" << FlatTable::prefix_length(i)
+                   << ", " << flat_->bucket_good_node_count(i) << "/" << flat_->bucket_known_node_count(i);
+      }
+    }
   } else {
     root_.bfs([](const Bucket &bucket) {
       if (bucket.is_leaf()) {
@@ -500,8 +553,8 @@ void RoutingTable::stat() const {
       }
     });
   }
-  LOG(info) << "  total entries: " << root_.total_known_node_count();
-  LOG(info) << "  total good entries: " << root_.total_good_node_count();
+  LOG(info) << "  total entries: " << known_node_count();
+  LOG(info) << "  total good entries: " << good_node_count();
   LOG(info) << "  total node added: " << total_node_added_;
   LOG(info) << "  total good deleted: " << total_good_node_deleted_;
   LOG(info) << "  total questionable deleted: " << total_questionable_node_deleted_;
@@ -509,42 +562,55 @@ void RoutingTable::stat() const {
   LOG(info) << "  total bucket count: " << bucket_count();
 }
 bool RoutingTable::make_good_now(const u160::U160 &id) {
+  if (flat_) {
+    return flat_->make_good_now(id);
+  }
   return root_.make_good_now(id);
 }
 bool RoutingTable::add_node(Entry entry) {
-  if (reverse_map_.find({entry.ip(), entry.port()}) == reverse_map_.end()) {
-    reverse_map_[std::make_tuple(entry.ip(), entry.port())] = entry.id();
-    if (is_full()) {
-      LOG(debug) << "failed to add node because routing table is full";
-      return false;
-    } else {
-      if (root_.add_node(std::move(entry))) {
-        total_node_added_++;
-        return true;
-      } else {
-        LOG(debug) << "failed to add node because routing table bucket is full";
-        return false;
-      }
-    }
-  } else {
-    if (entry.id() == reverse_map_[{entry.ip(), entry.port()}]) {
-      if (!root_.in_bucket(entry.node_info().id())) {
-        LOG(error) << "!!!!!!!!!!!!!!!!!!! error, routing table inconsistent";
-      }
-    } else {
+  auto slot = entries_->find(entry.ip(), entry.port());
+  if (slot != EntryStore::npos) {
+    if ((*entries_)[slot].id() != entry.id()) {
       black_list_node(entry.ip(), entry.port());
-      reverse_map_.erase({entry.ip(), entry.port()});
       make_bad(entry.ip(), entry.port());
       LOG(debug) << "banned node " << entry.to_string() << " because it has multiple node IDs";
+      return false;
+    }
+    if (entries_->contains(table_, slot)) {
+      return false;
     }
+    // Known by another table sharing the store, only this table is added to the entry
+  }
+  if (is_full()) {
+    LOG(debug) << "failed to add node because routing table is full";
+    return false;
+  }
+  auto ip = entry.ip();
+  auto port = entry.port();
+  if (flat_ ? flat_->add_node(std::move(entry)) : root_.add_node(std::move(entry))) {
+    total_node_added_++;
+    version_++;
+    slot = entries_->find(ip, port);
+    if (slot != EntryStore::npos && entries_->state(slot) == EntryState::Questionable) {
+      questionable_nodes_.push_back((*entries_)[slot].id());
+    }
+    return true;
+  } else {
+    LOG(debug) << "failed to add node because routing table bucket is full";
     return false;
   }
-
 }
 bool RoutingTable::make_good_now(uint32_t ip, uint16_t port) {
+  if (flat_) {
+    return flat_->make_good_now(ip, port);
+  }
   return root_.make_good_now(ip, port);
 }
 void RoutingTable::iterate_nodes(const std::function<void(const Entry &)> &callback) const {
+  if (flat_) {
+    flat_->iterate_entries(callback);
+    return;
+  }
   root_.dfs([&callback](const Bucket &bucket) {
     if (bucket.is_leaf()) {
       bucket.iterate_entries(callback);
@@ -552,55 +618,160 @@ void RoutingTable::iterate_nodes(const std::function<void(const Entry &)> &callb
   });
 }
 std::optional<Entry> RoutingTable::remove_node(const u160::U160 &target) {
-  auto node = root_.remove(target);
-  if (node.has_value()) {
-    reverse_map_.erase({node->ip(), node->port()});
-  }
-  return node;
+  version_++;
+  return flat_ ? flat_->remove(target) : root_.remove(target);
 }
 
 void RoutingTable::gc() {
   auto t0 = std::chrono::high_resolution_clock::now();
+  entries_->expire(t0);
 
   size_t bad{}, good{}, quest;
   std::list<krpc::NodeInfo> info;
-  std::tie(good, quest, bad, info) = root_.gc();
+  std::tie(good, quest, bad, info) = flat_ ? flat_->gc() : root_.gc();
   total_good_node_deleted_ += good;
   total_questionable_node_deleted_ += quest;
   total_bad_node_deleted_ += bad;
-  for (auto &node : info) {
-    reverse_map_.erase({node.ip(), node.port()});
+  if (!info.empty()) {
+    version_++;
   }
   auto t1 = std::chrono::high_resolution_clock::now();
   LOG(debug) << "RoutingTable::gc() good/bad/questionable = " << good << "/" << bad << "/" << quest << " in "
             << std::fixed << std::setprecision(2) << std::chrono::duration<double, std::milli>(t1 - t0).count() << "ms";
 }
 size_t RoutingTable::max_prefix_length() const {
-  size_t length = 0;
-  root_.dfs([&length](const Bucket &bucket) {
-    if (bucket.prefix_length() > length) {
-      length = bucket.prefix_length();
-    }
-  });
-  return length;
+  return flat_ ? flat_->max_prefix_length() : root_.max_prefix_length();
 }
 size_t RoutingTable::known_node_count() const {
-  return root_.total_known_node_count();
+  return entries_->counts(table_).known();
 }
-size_t RoutingTable::good_node_count() const {
-  return root_.total_good_node_count();
+size_t RoutingTable::good_node_count() {
+  update_states();
+  return entries_->counts(table_).good;
 }
 
-bool RoutingTable::is_full() const {
-  return root_.total_known_node_count() >= max_known_nodes_ || root_.is_full();
+bool RoutingTable::is_full() {
+  if (known_node_count() >= max_known_nodes_) {
+    return true;
+  }
+  update_states();
+  return flat_ ? flat_->is_full() : root_.is_full();
 }
 
 bool RoutingTable::require_response_now(const u160::U160 &target) {
-  return root_.require_response_now(target);
+  return flat_ ? flat_->require_response_now(target) : root_.require_response_now(target);
+}
+
+void RoutingTable::update_states() {
+  entries_->expire(common::CoarseClock::now());
+}
+
+EntryStore::Slot RoutingTable::search(const u160::U160 &id) const {
+  return flat_ ? flat_->search(id) : root_.search(id);
+}
+
+ClosestNodes RoutingTable::k_nearest_good_nodes(const u160::U160 &id, size_t k) const {
+  KClosest result(id, k);
+  if (flat_) {
+    flat_->k_closest_good_nodes(result);
+  } else {
+    root_.k_closest_good_nodes(result);
+  }
+  return result.result();
 }
 
-std::list<Entry> RoutingTable::k_nearest_good_nodes(const u160::U160 &id, size_t k) const {
-  return root_.k_nearest_good_nodes(id, k);
+void RoutingTable::publish() {
+  update_states();
+  auto snapshot = published();
+  auto changes = version_ - snapshot->version();
+  if (changes == 0) {
+    return;
+  }
+  auto now = common::CoarseClock::now();
+  if (changes < std::max<size_t>(snapshot->size() / PublishChangeDivisor, 1) &&
+      now - published_at_ < std::chrono::seconds(PublishMaxAgeSeconds)) {
+    return;
+  }
+  published_at_ = now;
+  std::vector<krpc::NodeInfo> nodes;
+  nodes.reserve(good_node_count());
+  iterate_nodes([&nodes, now](const Entry &entry) {
+    if (entry.is_good(now)) {
+      nodes.push_back(entry.node_info());
+    }
+  });
+  published_.store(std::make_shared<const ReadSnapshot>(version_, std::move(nodes)), std::memory_order_release);
+}
+
+std::vector<uint8_t> RoutingTable::snapshot() const {
+  // Entries keep CoarseClock time, which may not be the system clock, so times are stored as unix time
+  auto now = common::CoarseClock::now();
+  auto unix_now = std::chrono::duration_cast<std::chrono::seconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+
+  std::vector<snapshot::Record> records;
+  records.reserve(known_node_count());
+  iterate_nodes([&records, now, unix_now](const Entry &entry) {
+    auto state = entry.state(now);
+    if (state == EntryState::Bad) {
+      return;
+    }
+    snapshot::Record record{};
+    entry.id().encode(record.id);
+    record.ip = entry.ip();
+    record.port = entry.port();
+    record.state = static_cast<snapshot::RecordState>(state);
+    auto version = entry.version();
+    record.version_length = std::min(version.size(), sizeof(record.version));
+    memcpy(record.version, version.data(), record.version_length);
+    if (entry.last_seen() != common::CoarseClock::time_point{}) {
+      record.last_seen = unix_now - std::chrono::duration_cast<std::chrono::seconds>(now - entry.last_seen()).count();
+    }
+    records.push_back(record);
+  });
+  return snapshot::encode(self_id_, records);
+}
+
+size_t RoutingTable::load_snapshot(gsl::span<const uint8_t> data) {
+  auto records = snapshot::records(data);
+  auto now = common::CoarseClock::now();
+  auto unix_now = std::chrono::duration_cast<std::chrono::seconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+
+  entries_->reserve(entries_->size() + records.size());
+  size_t loaded = 0;
+  for (auto &record : records) {
+    if (known_node_count() >= max_known_nodes_) {
+      break;
+    }
+    if (record.state == snapshot::RecordState::Bad) {
+      continue;
+    }
+    auto id = u160::U160::decode(record.id);
+    auto slot = entries_->find(record.ip, record.port);
+    if (slot != EntryStore::npos && ((*entries_)[slot].id() != id || entries_->contains(table_, slot))) {
+      continue;
+    }
+    if (id == self_id_ || search(id) != EntryStore::npos) {
+      continue;
+    }
+    auto last_seen = common::CoarseClock::time_point{};
+    if (record.last_seen != 0) {
+      last_seen = now - std::chrono::seconds(std::max<int64_t>(unix_now - record.last_seen, 0));
+    }
+    std::string_view version(reinterpret_cast<const char*>(record.version), std::min<size_t>(record.version_length, 4));
+    Entry entry(krpc::NodeInfo(id, record.ip, record.port), version, last_seen);
+    if (flat_ ? !flat_->add_node(std::move(entry)) : !root_.add_node(std::move(entry))) {
+      continue;
+    }
+    slot = entries_->find(record.ip, record.port);
+    if (entries_->state(slot) == EntryState::Questionable) {
+      questionable_nodes_.push_back(id);
+    }
+    loaded++;
+  }
+  version_++;
+  return loaded;
 }
 
 void RoutingTable::serialize(std::ostream &os) const {
@@ -612,7 +783,7 @@ void RoutingTable::serialize(std::ostream &os) const {
           entry.id().to_string(),
           boost::asio::ip::address_v4(entry.ip()).to_string(),
           entry.port(),
-          entry.version()
+          std::string(entry.version())
       );
       list_node->append(item);
     }
@@ -623,10 +794,11 @@ void RoutingTable::serialize(std::ostream &os) const {
 
 std::unique_ptr<RoutingTable> RoutingTable::deserialize(
     std::istream &is, std::string name, std::string save_path, size_t max_bucket_size, size_t max_known_nodes,
-    bool delete_good_nodes, bool fat_mode,
-    std::function<void(uint32_t, uint16_t)> black_list_node) {
+    bool delete_good_nodes, bool fat_mode, bool flat_mode,
+    std::function<void(uint32_t, uint16_t)> black_list_node, std::shared_ptr<EntryStore> store) {
   auto ret = std::make_unique<RoutingTable>(u160::U160(), std::move(name), std::move(save_path), max_bucket_size, max_known_nodes,
-                                            delete_good_nodes, fat_mode, std::move(black_list_node));
+                                            delete_good_nodes, fat_mode, flat_mode, std::move(black_list_node),
+                                            std::move(store));
   auto root_dict = std::dynamic_pointer_cast<bencoding::DictNode>(bencoding::Node::decode(is));
   auto node_list = bencoding::get<bencoding::ListNode>(*root_dict, "nodes");
   for (size_t i = 0; i < node_list.size(); i++) {
@@ -635,7 +807,7 @@ std::unique_ptr<RoutingTable> RoutingTable::deserialize(
         u160::U160::from_hex(bencoding::get<std::string>(node, 0)),
         boost::asio::ip::address_v4::from_string(bencoding::get<std::string>(node, 1)).to_uint(),
         bencoding::get<uint16_t>(node, 2),
-        bencoding::get<std::string>(node, 3)
+        std::string(bencoding::get<std::string>(node, 3))
     ));
   }
   return ret;
@@ -644,21 +816,24 @@ std::unique_ptr<RoutingTable> RoutingTable::deserialize(
 RoutingTable::~RoutingTable() {
   if (!save_path_.empty()) {
     LOG(info) << "Saving routing table to file '" << save_path_  << "'";
-    std::ofstream save_file(save_path_);
-    serialize(save_file);
+    try {
+      snapshot::write(save_path_, snapshot());
+    } catch (const std::exception &e) {
+      LOG(error) << "Failed to save routing table, " << e.what();
+    }
   }
+  entries_->remove_table(table_);
 }
 void RoutingTable::make_bad(uint32_t ip, uint16_t port) {
-  root_.make_bad(ip, port);
+  if (flat_) {
+    flat_->make_bad(ip, port);
+  } else {
+    root_.make_bad(ip, port);
+  }
 }
-size_t RoutingTable::bucket_count() const {
-  size_t n = 0;
-  root_.dfs([&n](const Bucket &b) {
-    if (b.is_leaf() && b.good_node_count() > 0) {
-      n++;
-    }
-  });
-  return n;
+size_t RoutingTable::bucket_count() {
+  update_states();
+  return flat_ ? flat_->bucket_count() : root_.good_leaf_count();
 }
 void RoutingTable::black_list_node(uint32_t ip, uint16_t port) const {
   if (black_list_node_) {
@@ -668,46 +843,18 @@ void RoutingTable::black_list_node(uint32_t ip, uint16_t port) const {
 size_t RoutingTable::memory_size() const {
   size_t size = sizeof(*this);
   size += root_.memory_size() - sizeof(root_);
+  if (flat_) {
+    size += flat_->memory_size();
+  }
   size += name_.size();
   size += save_path_.size();
-  size += (sizeof(reverse_map_.begin()->first) + sizeof(reverse_map_.begin()->second)) * reverse_map_.size();
-  return size;
-}
-
-bool Entry::is_good() const noexcept {
-  // A good node is a node has responded to one of our queries within the last 15 minutes,
-  // A node is also good if it has ever responded to one of our queries and has sent us a query within the last 15 minutes
-
-  return !is_bad() &&
-      (std::chrono::high_resolution_clock::now() - last_seen_) < std::chrono::minutes(MaxGoodNodeAliveMinutes);
-}
-
-bool Entry::is_bad() const {
-  if (!response_required)
-    return false;
-
-  return (std::chrono::high_resolution_clock::now() - last_require_response_) > krpc::KRPCTimeout || bad_;
-}
-
-bool Entry::require_response_now() {
-  if (!response_required) {
-    response_required = true;
-    this->last_require_response_ = std::chrono::high_resolution_clock::now();
-    LOG(trace) << "require response " << to_string();
-    return true;
-  } else {
-    return false;
+  if (!shared_store_) {
+    size += entries_->memory_size();
   }
+  size += refresh_wheel_.memory_size() - sizeof(refresh_wheel_);
+  size += questionable_nodes_.size() * sizeof(u160::U160);
+  size += published()->memory_size();
+  return size;
 }
 
-void Entry::make_good_now() {
-  this->last_seen_ = std::chrono::high_resolution_clock::now();
-  this->response_required = false;
-  this->bad_ = false;
-}
-
-void Entry::make_bad() {
-  bad_ = true;
 }
-}
-
@@ -0,0 +1,93 @@
+#include <albert/dht/routing_table/snapshot.hpp>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+
+#include <boost/crc.hpp>
+
+#include <unistd.h>
+
+namespace albert::dht::routing_table::snapshot {
+
+namespace {
+
+uint32_t checksum(const Header &header, gsl::span<const Record> records) {
+  auto copy = header;
+  copy.checksum = 0;
+  boost::crc_32_type crc;
+  crc.process_bytes(&copy, sizeof(copy));
+  crc.process_bytes(records.data(), records.size_bytes());
+  return crc.checksum();
+}
+
+}
+
+bool is_snapshot(gsl::span<const uint8_t> data) {
+  return data.size() >= sizeof(Magic) && memcmp(data.data(), Magic, sizeof(Magic)) == 0;
+}
+
+gsl::span<const Record> records(gsl::span<const uint8_t> data) {
+  if (!is_snapshot(data) || data.size() < sizeof(Header)) {
+    throw InvalidSnapshot("snapshot::records(), not a routing table snapshot");
+  }
+  auto header = reinterpret_cast<const Header*>(data.data());
+  if (header->version != Version) {
+    throw InvalidSnapshot("snapshot::records(), unsupported version " + std::to_string(header->version));
+  }
+  if (header->record_size != sizeof(Record)) {
+    throw InvalidSnapshot("snapshot::records(), invalid record size " + std::to_string(header->record_size));
+  }
+  if ((data.size() - sizeof(Header)) / sizeof(Record) < header->record_count) {
+    throw InvalidSnapshot("snapshot::records(), truncated, " + std::to_string(header->record_count) + " records expected");
+  }
+  gsl::span<const Record> ret(reinterpret_cast<const Record*>(data.data() + sizeof(Header)), header->record_count);
+  if (checksum(*header, ret) != header->checksum) {
+    throw InvalidSnapshot("snapshot::records(), checksum mismatch");
+  }
+  return ret;
+}
+
+std::vector<uint8_t> encode(const u160::U160 &self, const std::vector<Record> &records) {
+  Header header{};
+  memcpy(header.magic, Magic, sizeof(Magic));
+  header.version = Version;
+  header.record_size = sizeof(Record);
+  header.record_count = records.size();
+  header.saved_at = std::chrono::duration_cast<std::chrono::seconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  self.encode(header.self_id);
+  header.checksum = checksum(header, records);
+
+  std::vector<uint8_t> ret(sizeof(Header) + records.size() * sizeof(Record));
+  memcpy(ret.data(), &header, sizeof(Header));
+  if (!records.empty()) {
+    memcpy(ret.data() + sizeof(Header), records.data(), records.size() * sizeof(Record));
+  }
+  return ret;
+}
+
+void write(const std::string &path, const std::vector<uint8_t> &data) {
+  // Unique per writer, a checkpoint may still be writing when the table is saved on exit
+  static std::atomic<size_t> counter;
+  auto tmp_path = path + ".tmp." + std::to_string(::getpid()) + "." + std::to_string(counter++);
+  {
+    std::ofstream ofs(tmp_path, std::ios::binary | std::ios::trunc);
+    ofs.write(reinterpret_cast<const char*>(data.data()), data.size());
+    if (!ofs.flush()) {
+      std::remove(tmp_path.c_str());
+      throw std::runtime_error("snapshot::write(), failed to write '" + tmp_path + "'");
+    }
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    auto error = errno;
+    std::remove(tmp_path.c_str());
+    throw std::runtime_error("snapshot::write(), failed to rename '" + tmp_path + "' to '" + path + "', " + strerror(error));
+  }
+}
+
+}
@@ -0,0 +1,123 @@
+#include <albert/dht/rtt_estimator.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <sstream>
+#include <vector>
+
+namespace albert::dht {
+
+namespace {
+
+uint32_t to_seconds(RttEstimator::TimePoint time) {
+  return std::chrono::duration_cast<std::chrono::seconds>(time.time_since_epoch()).count();
+}
+
+// Long enough for a doubled max_timeout of any sane config
+constexpr size_t MaxBackoff = 6;
+
+}
+
+RttEstimator::RttEstimator(duration initial_timeout, duration min_timeout, duration max_timeout)
+    :initial_timeout_(initial_timeout), min_timeout_(min_timeout), max_timeout_(std::max(min_timeout, max_timeout)) { }
+
+void RttEstimator::Estimate::update(uint32_t rtt) {
+  if (srtt == 0) {
+    srtt = std::max<uint32_t>(rtt, 1);
+    rttvar = rtt / 2;
+    return;
+  }
+  // RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, then SRTT = 7/8 SRTT + 1/8 R
+  uint32_t delta = srtt > rtt ? srtt - rtt : rtt - srtt;
+  rttvar = uint32_t((3 * uint64_t(rttvar) + delta) / 4);
+  srtt = std::max<uint32_t>(uint32_t((7 * uint64_t(srtt) + rtt) / 8), 1);
+}
+
+void RttEstimator::on_response(uint32_t ip, uint16_t port, duration rtt) {
+  auto us = uint32_t(std::clamp<duration::rep>(rtt.count(), 0, UINT32_MAX));
+  global_.update(us);
+  auto &node = nodes_[endpoint_key(ip, port)];
+  node.estimate.update(us);
+  node.updated_at = to_seconds(common::CoarseClock::now());
+  node.timeouts_in_row = 0;
+
+  size_t bucket = std::min<size_t>(std::bit_width(us / 1000), HistogramBuckets - 1);
+  histogram_[bucket]++;
+  samples_++;
+}
+
+size_t RttEstimator::on_timeout(uint32_t ip, uint16_t port) {
+  auto &node = nodes_[endpoint_key(ip, port)];
+  node.updated_at = to_seconds(common::CoarseClock::now());
+  if (node.timeouts_in_row < UINT8_MAX) {
+    node.timeouts_in_row++;
+  }
+  timeouts_++;
+  return node.timeouts_in_row;
+}
+
+RttEstimator::duration RttEstimator::clamp(uint64_t us, size_t backoff) const {
+  us <<= std::min(backoff, MaxBackoff);
+  return std::clamp(duration(us), min_timeout_, max_timeout_);
+}
+
+RttEstimator::duration RttEstimator::timeout() const {
+  if (global_.srtt == 0) {
+    return std::clamp(initial_timeout_, min_timeout_, max_timeout_);
+  }
+  return clamp(global_.timeout(), 0);
+}
+
+RttEstimator::duration RttEstimator::timeout(uint32_t ip, uint16_t port) const {
+  auto it = nodes_.find(endpoint_key(ip, port));
+  if (it == nodes_.end()) {
+    return timeout();
+  }
+  auto &node = it->second;
+  if (node.estimate.srtt == 0) {
+    return clamp(timeout().count(), node.timeouts_in_row);
+  }
+  return clamp(node.estimate.timeout(), node.timeouts_in_row);
+}
+
+std::string RttEstimator::histogram_string() const {
+  size_t end = HistogramBuckets;
+  while (end > 0 && histogram_[end - 1] == 0) {
+    end--;
+  }
+  std::stringstream ss;
+  for (size_t i = 0; i < end; i++) {
+    if (i > 0) {
+      ss << " ";
+    }
+    if (i == 0) {
+      ss << "<1ms:";
+    } else if (i == HistogramBuckets - 1) {
+      ss << ">=" << (1u << (i - 1)) << "ms:";
+    } else {
+      ss << (1u << (i - 1)) << "ms:";
+    }
+    ss << histogram_[i];
+  }
+  return ss.str();
+}
+
+void RttEstimator::gc(TimePoint before) {
+  auto seconds = to_seconds(before);
+  std::vector<uint64_t> to_delete;
+  for (auto &[key, node] : nodes_) {
+    if (node.updated_at < seconds) {
+      to_delete.push_back(key);
+    }
+  }
+  for (auto key : to_delete) {
+    nodes_.erase(key);
+  }
+  nodes_.shrink_to_fit();
+}
+
+size_t RttEstimator::memory_size() const {
+  return sizeof(*this) + nodes_.memory_size();
+}
+
+}
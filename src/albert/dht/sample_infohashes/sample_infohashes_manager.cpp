@@ -30,8 +30,9 @@ SampleInfohashesManager::SampleInfohashesManager(
       current_target_, "sample_infohashes(" + current_target_.to_string() + ")", "",
       dht::routing_table::BucketMaxItems,
       16384,
-      true, false,
-      nullptr);
+      true, false, false,
+      nullptr,
+      dht_.node_store());
   routing_table_ = rt.get();
   dht_.add_routing_table(std::move(rt));
   impl_.bootstrap_routing_table(*routing_table_);
@@ -54,9 +55,9 @@ void SampleInfohashesManager::handle_timer(const boost::system::error_code &erro
 }
 
 
-void SampleInfohashesManager::handle(const albert::krpc::SampleInfohashesResponse &response) {
+void SampleInfohashesManager::handle(const albert::krpc::wire::SampleInfohashesResponse &response) {
   // TODO
-  for (auto sample : response.samples()) {
+  for (auto sample : response.samples) {
     LOG(info) << "sample infohashes handle " << sample.to_string();
   }
 }
@@ -5,9 +5,11 @@
 #include <boost/asio/io_service.hpp>
 #include <boost/bind.hpp>
 
+#include <albert/common/coarse_clock.hpp>
 #include <albert/dht/config.hpp>
 #include <albert/dht/dht.hpp>
 #include <albert/dht/routing_table/routing_table.hpp>
+#include <albert/dht/routing_table/snapshot.hpp>
 #include <albert/log/log.hpp>
 #include <albert/utils/utils.hpp>
 
@@ -36,17 +38,24 @@ void DHTImpl::handle_report_stat_timer(const Timer::Cancel &cancel) {
 //      std::tie(ip, port) = item;
 //      black_list_s << boost::asio::ip::address_v4(ip) << ":" << port << " ";
 //    }
-    LOG(info) << "black list " << dht_->blacklist_.size() << " in total";
+    LOG(info) << "black list " << dht_->blacklist_.size() << " in total, " << dht_->blacklist_.subnet_count() << " subnets";
   } else {
     LOG(info) << "main routing table "
               << dht_->main_routing_table_->max_prefix_length() << " "
               << dht_->main_routing_table_->good_node_count() << " "
               << dht_->main_routing_table_->known_node_count() << " "
               << dht_->main_routing_table_->bucket_count() << " "
-              << "banned " << dht_->blacklist_.size() << " "
+              << "nodes " << dht_->node_store_->size() << " "
+              << "banned " << dht_->blacklist_.size() << "," << dht_->blacklist_.subnet_count() << " "
               << "mem " << utils::pretty_size(dht_->main_routing_table_->memory_size()) << " "
-              << "tx: (n,mem) " << dht_->transaction_manager.size() << "," << utils::pretty_size(dht_->transaction_manager.memory_size())
+              << "tx: (n,mem) " << dht_->transaction_manager.size() << "," << utils::pretty_size(dht_->transaction_manager.memory_size()) << " "
+              << "rtt: (srtt,rttvar,timeout) "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(dht_->rtt_.srtt()).count() << ","
+              << std::chrono::duration_cast<std::chrono::milliseconds>(dht_->rtt_.rttvar()).count() << ","
+              << std::chrono::duration_cast<std::chrono::milliseconds>(dht_->rtt_.timeout()).count() << "ms "
+              << "timeouts " << dht_->rtt_.timeouts() << "/" << dht_->rtt_.timeouts() + dht_->rtt_.samples()
           ;
+    LOG(info) << "rtt histogram " << dht_->rtt_.histogram_string();
     for (auto &rt : dht_->routing_tables_) {
       if (rt->name() != dht_->main_routing_table_->name()) {
         LOG(info) << "Routing table '" << rt->name() << "' "
@@ -58,6 +67,33 @@ void DHTImpl::handle_report_stat_timer(const Timer::Cancel &cancel) {
     }
   }
   LOG(debug) << "DHT RPSThrottler: " << throttler_.stat();
+
+  checkpoint_routing_table();
+}
+
+void DHTImpl::checkpoint_routing_table() {
+  auto interval = dht_->config_.routing_table_checkpoint_interval_seconds;
+  auto &rt = *dht_->main_routing_table_;
+  if (interval <= 0 || rt.save_path().empty() ||
+      std::chrono::steady_clock::now() - last_checkpoint_ < std::chrono::seconds(interval)) {
+    return;
+  }
+  if (checkpoint_.valid()) {
+    if (checkpoint_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+      return;
+    }
+    try {
+      checkpoint_.get();
+    } catch (const std::exception &e) {
+      LOG(error) << "Failed to checkpoint routing table, " << e.what();
+    }
+  }
+  last_checkpoint_ = std::chrono::steady_clock::now();
+
+  // Taking the snapshot is a copy of the entries, only writing the file is left to the other thread
+  checkpoint_ = std::async(std::launch::async, [path = rt.save_path(), data = rt.snapshot()]() {
+    routing_table::snapshot::write(path, data);
+  });
 }
 void DHTImpl::handle_expand_route_timer(const Timer::Cancel &cancel) {
   for (auto &rt : dht_->routing_tables_) {
@@ -81,25 +117,63 @@ void DHTImpl::handle_refresh_nodes_timer(const Timer::Cancel &cancel) {
 
   for (auto &rt : dht_->routing_tables_) {
     rt->gc();
-
-    // try refreshing questionable nodes
-    size_t n = 0;
-    rt->iterate_nodes([this, &n](const routing_table::Entry &node) {
-      if (!node.is_good() && !node.is_bad()) {
-        // FIXME: const_cast
-        if (const_cast<routing_table::Entry&>(node).require_response_now()) {
-          ping(krpc::NodeInfo{node.id(), node.ip(), node.port()});
-          n++;
-        }
-      }
-    });
   }
 
   if (dht_->main_routing_table_->known_node_count() == 0) {
     bootstrap_routing_table(*dht_->main_routing_table_);
   }
 
-  dht_->transaction_manager.gc();
+  // Nodes not heard from in a while start over from the estimate of all nodes
+  dht_->rtt_.gc(common::CoarseClock::now() - std::chrono::minutes(routing_table::MaxGoodNodeAliveMinutes));
+}
+
+void DHTImpl::handle_transaction_timeout_timer(const Timer::Cancel &cancel) {
+  common::CoarseClock::update();
+  auto n = dht_->transaction_manager.expire(common::CoarseClock::now(), [this](const Transaction &transaction) {
+    handle_transaction_timeout(transaction);
+  });
+  if (n > 0) {
+    LOG(debug) << "DHTImpl: " << n << " queries timed out";
+  }
+}
+
+void DHTImpl::handle_transaction_timeout(const Transaction &transaction) {
+  auto in_row = dht_->rtt_.on_timeout(transaction.ip_, transaction.port_);
+  if (std::string_view(transaction.method_name_) == krpc::MethodNameGetPeers) {
+    handle_get_peers_timeout(transaction.target_, transaction.ip_, transaction.port_);
+  }
+  auto &store = *dht_->node_store_;
+  auto slot = store.find(transaction.ip_, transaction.port_);
+  if (slot == routing_table::EntryStore::npos) {
+    return;
+  }
+  // A questionable node that did not answer its ping is bad now instead of after krpc::KRPCTimeout,
+  // other nodes get a few chances, a response may have been lost
+  auto &entry = store[slot];
+  if (!entry.is_bad() && (entry.response_required() || in_row >= MaxTimeoutsInRow)) {
+    LOG(debug) << "DHTImpl: " << entry.to_string() << " is bad, " << transaction.method_name_ << " timed out";
+    store.make_bad(slot);
+  }
+}
+
+void DHTImpl::handle_node_liveness_timer(const Timer::Cancel &cancel) {
+  common::CoarseClock::update();
+  for (auto &rt : dht_->routing_tables_) {
+    rt->update_states();
+
+    for (auto &item : rt->select_refresh_targets()) {
+      auto &node = std::get<0>(item);
+      udp::endpoint ep{boost::asio::ip::make_address_v4(node.ip()), node.port()};
+      find_node(*rt, ep, std::get<1>(item));
+    }
+
+    // try refreshing questionable nodes
+    for (auto &node : rt->select_nodes_to_ping(dht_->config_.max_node_pings_per_second)) {
+      ping(node);
+    }
+  }
+  // Only the snapshot of the main table is read
+  dht_->main_routing_table_->publish();
 }
 
 }
\ No newline at end of file
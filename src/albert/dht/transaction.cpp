@@ -1,77 +1,77 @@
 #include <albert/dht/transaction.hpp>
 
-#include <list>
-#include <iomanip>
-
-#include <albert/log/log.hpp>
+#include <algorithm>
 
 namespace albert::dht {
-void TransactionManager::start(const std::function<void(Transaction &transaction)> &callback) {
-  std::unique_lock<std::mutex> _(lock_);
-  auto transaction_id_int = transaction_counter_++;
-  std::stringstream ss;
-  std::array<char, sizeof(transaction_id_int)> transaction_id_buf{};
-  std::copy(
-      (const char *) &transaction_id_int,
-      (const char *) &transaction_id_int + sizeof(transaction_id_int),
-      transaction_id_buf.begin()
-  );
-  std::string transaction_id(transaction_id_buf.data(), transaction_id_buf.size());
-  if (transactions_.find(transaction_id) != transactions_.end()) {
-    throw TransactionError("Transaction ID overflow");
-  }
-  Transaction transaction{};
-  transaction.id_ = transaction_id;
-  transaction.start_time_ = std::chrono::high_resolution_clock::now();
 
-  callback(transaction);
-  if (transaction.method_name_.empty()) {
-    throw TransactionError("Transaction invalid start callback, method_name not set");
+std::string TransactionManager::start(const Transaction &transaction, std::chrono::microseconds timeout) {
+  if (transaction.method_name_ == nullptr) {
+    throw TransactionError("Transaction invalid start, method_name not set");
   }
-
-  if (!transaction.query_node_) {
-    throw TransactionError("Transaction invalid start callback, query_node not set");
+  Slot slot;
+  if (free_slots_.empty()) {
+    if (records_.size() >= MaxSlots) {
+      throw TransactionError("Transaction ID overflow");
+    }
+    slot = records_.size();
+    records_.emplace_back();
+  } else {
+    slot = free_slots_.front();
+    free_slots_.pop_front();
   }
+  auto &record = records_[slot];
+  record.transaction = transaction;
+  // The coarse clock may be seconds old when a timer sends, that would be part of the round trip time
+  record.transaction.start_time_ = common::CoarseClock::clock::now();
+  record.transaction.deadline_ = record.transaction.start_time_ +
+      std::min<std::chrono::microseconds>(timeout, expiration_time_);
+  record.active = true;
+  deadlines_.push({record.transaction.deadline_, slot, record.generation});
+  size_++;
 
-  transactions_[transaction_id] = transaction;
-}
-void TransactionManager::end(
-    const std::string &id,
-    const std::function<void(const Transaction &)> &callback) {
-  std::unique_lock<std::mutex> _(lock_);
-  if (this->transactions_.find(id) == this->transactions_.end()) {
-    throw TransactionError("Transaction not found");
+  // Big endian slot then generation, in as few bytes as the slot needs, at least 2
+  uint32_t value = (slot << GenerationBits) | record.generation;
+  size_t length = slot < (1u << 8) ? 2 : slot < (1u << 16) ? 3 : 4;
+  std::string id(length, 0);
+  for (size_t i = 0; i < length; i++) {
+    id[length - 1 - i] = char((value >> (8 * i)) & 0xffu);
   }
-  callback(this->transactions_.at(id));
-  this->transactions_.erase(id);
+  return id;
 }
 
-void TransactionManager::gc() {
-  auto t0 = std::chrono::high_resolution_clock::now();
-  std::vector<std::string> to_delete;
-  to_delete.reserve(transactions_.size());
-  auto a = t0 - expiration_time_;
-  for (auto &item : transactions_) {
-    if (a > item.second.start_time_) {
-      to_delete.push_back(item.first);
-    }
+TransactionManager::Slot TransactionManager::find(std::string_view id) const {
+  if (id.size() < 2 || id.size() > 4) {
+    return npos;
   }
-  for (auto &item : to_delete) {
-    transactions_.erase(item);
+  uint32_t value = 0;
+  for (auto c : id) {
+    value = (value << 8u) | uint8_t(c);
   }
-
-  auto t1 = std::chrono::high_resolution_clock::now();
-  LOG(debug) << "TransactionManager: delete " << to_delete.size() << " expiried transactions in "
-            << std::fixed << std::setprecision(2) << std::chrono::duration<double,std::milli>(t1-t0).count() << "ms";
+  Slot slot = value >> GenerationBits;
+  if (slot >= records_.size()) {
+    return npos;
+  }
+  auto &record = records_[slot];
+  if (!record.active || record.generation != uint8_t(value)) {
+    return npos;
+  }
+  return slot;
 }
-bool TransactionManager::has_transaction(const std::string &id) const {
-  return transactions_.find(id) != transactions_.end();
+
+void TransactionManager::free(Slot slot) {
+  auto &record = records_[slot];
+  record.active = false;
+  record.generation++;
+  record.transaction = {};
+  free_slots_.push_back(slot);
+  size_--;
 }
+
 size_t TransactionManager::memory_size() const {
-  size_t size = sizeof(*this);
-  for (auto &item : transactions_) {
-    size += sizeof(item.first) + sizeof(item.second) + item.first.size();
-  }
-  return size;
+  return sizeof(*this) +
+      records_.capacity() * sizeof(Record) +
+      free_slots_.size() * sizeof(Slot) +
+      deadlines_.size() * sizeof(Deadline);
 }
+
 }
@@ -0,0 +1,200 @@
+#include <albert/krpc/wire.hpp>
+
+#include <cstring>
+
+#include <albert/utils/utils.hpp>
+
+namespace albert::krpc::wire {
+
+using bencoding::Parser;
+using bencoding::Token;
+using bencoding::schema::field_bit;
+
+static_assert(field_bit<Fields>("id") == Fields::Id);
+static_assert(field_bit<Fields>("implied_port") == Fields::ImpliedPort);
+static_assert(field_bit<Fields>("info_hash") == Fields::InfoHash);
+static_assert(field_bit<Fields>("interval") == Fields::Interval);
+static_assert(field_bit<Fields>("nodes") == Fields::Nodes);
+static_assert(field_bit<Fields>("num") == Fields::Num);
+static_assert(field_bit<Fields>("port") == Fields::Port);
+static_assert(field_bit<Fields>("samples") == Fields::Samples);
+static_assert(field_bit<Fields>("target") == Fields::Target);
+static_assert(field_bit<Fields>("token") == Fields::Token);
+static_assert(field_bit<Fields>("values") == Fields::Values);
+
+PeerList::iterator::iterator(gsl::span<const uint8_t> data) :parser_(data) {
+  if (data.empty()) {
+    end_ = true;
+    return;
+  }
+  parser_.read_list_begin();
+  ++*this;
+}
+
+PeerList::iterator &PeerList::iterator::operator++() {
+  while (true) {
+    auto token = parser_.next();
+    if (token == Token::End) {
+      end_ = true;
+      return *this;
+    }
+    if (token == Token::String && parser_.string().size() == CompactPeerSize) {
+      auto s = parser_.string();
+      uint32_t ip;
+      uint16_t port;
+      memcpy(&ip, s.data(), sizeof(ip));
+      memcpy(&port, s.data() + sizeof(ip), sizeof(port));
+      peer_ = {utils::network_to_host(ip), utils::network_to_host(port)};
+      return *this;
+    }
+    parser_.skip(token);
+  }
+}
+
+bool Envelope::has_body() const {
+  return (present & (field_bit<Envelope>("a") | field_bit<Envelope>("r"))) != 0;
+}
+bool Envelope::has_error() const {
+  return (present & field_bit<Envelope>("e")) != 0;
+}
+
+Envelope scan(gsl::span<const uint8_t> datagram) {
+  Envelope envelope;
+  try {
+    envelope.present = bencoding::schema::decode(datagram, envelope);
+  } catch (const bencoding::schema::SchemaError &e) {
+    throw InvalidMessage(std::string("Invalid KRPC message, ") + e.what());
+  }
+  return envelope;
+}
+
+// Value of a field that the message requires
+template <typename T>
+static const T &require(const Fields &fields, uint64_t field, const T &value, const char *key, const char *context) {
+  if (!fields.has(field)) {
+    throw InvalidMessage(std::string(context) + ", '" + key + "' not found");
+  }
+  return value;
+}
+
+static Message decode_query(const Envelope &envelope) {
+  auto &f = envelope.fields;
+  auto t = envelope.transaction_id;
+  auto v = envelope.version;
+  auto q = envelope.method_name;
+  if (!envelope.has_body()) {
+    throw InvalidMessage("Query, 'a' not found");
+  }
+  if (q == MethodNamePing) {
+    return PingQuery{t, v, require(f, Fields::Id, f.id, "id", "Query")};
+  } else if (q == MethodNameFindNode) {
+    return FindNodeQuery{
+        t, v,
+        require(f, Fields::Id, f.id, "id", "FindNodeQuery"),
+        require(f, Fields::Target, f.target, "target", "FindNodeQuery")};
+  } else if (q == MethodNameGetPeers) {
+    return GetPeersQuery{
+        t, v,
+        require(f, Fields::Id, f.id, "id", "GetPeersQuery"),
+        require(f, Fields::InfoHash, f.info_hash, "info_hash", "GetPeersQuery")};
+  } else if (q == MethodNameAnnouncePeer) {
+    return AnnouncePeerQuery{
+        t, v,
+        require(f, Fields::Id, f.id, "id", "AnnouncePeerQuery"),
+        f.implied_port != 0,
+        require(f, Fields::InfoHash, f.info_hash, "info_hash", "AnnouncePeerQuery"),
+        static_cast<uint16_t>(require(f, Fields::Port, f.port, "port", "AnnouncePeerQuery")),
+        require(f, Fields::Token, f.token, "token", "AnnouncePeerQuery")};
+  } else {
+    throw InvalidMessage("Query, Unknown method name '" + std::string(q) + "'");
+  }
+}
+
+static Message decode_response(const Envelope &envelope, std::string_view method_name) {
+  auto &f = envelope.fields;
+  auto t = envelope.transaction_id;
+  auto v = envelope.version;
+  if (!envelope.has_body()) {
+    throw InvalidMessage("Response, 'r' not found");
+  }
+  if (method_name == MethodNamePing) {
+    return PingResponse{t, v, require(f, Fields::Id, f.id, "id", "PingResponse")};
+  } else if (method_name == MethodNameFindNode) {
+    return FindNodeResponse{
+        t, v,
+        require(f, Fields::Id, f.id, "id", "FindNode"),
+        require(f, Fields::Nodes, f.nodes, "nodes", "FindNode")};
+  } else if (method_name == MethodNameGetPeers) {
+    // We support libtorrent/utorrent extension here
+    //  ref: https://www.libtorrent.org/dht_extensions.html
+    return GetPeersResponse{
+        t, v,
+        require(f, Fields::Id, f.id, "id", "GetPeersResponse"),
+        require(f, Fields::Token, f.token, "token", "GetPeersResponse"),
+        f.nodes,
+        f.values};
+  } else if (method_name == MethodNameAnnouncePeer) {
+    return AnnouncePeerResponse{t, v, require(f, Fields::Id, f.id, "id", "AnnouncePeerResponse")};
+  } else if (method_name == MethodNameSampleInfohashes) {
+    return SampleInfohashesResponse{
+        t, v,
+        require(f, Fields::Id, f.id, "id", "SampleInfohashes"),
+        f.interval,
+        static_cast<size_t>(f.num),
+        require(f, Fields::Samples, f.samples, "samples", "SampleInfohashes")};
+  } else {
+    throw InvalidMessage("Unknown response type: '" + std::string(method_name) + "'");
+  }
+}
+
+Message decode(const Envelope &envelope, std::string_view method_name) {
+  if (envelope.type == MessageTypeQuery) {
+    return decode_query(envelope);
+  } else if (envelope.type == MessageTypeResponse) {
+    return decode_response(envelope, method_name);
+  } else if (envelope.type == MessageTypeError) {
+    if (!envelope.has_error()) {
+      throw InvalidMessage("Invalid 'Error' message, 'e' not found");
+    }
+    return Error{envelope.transaction_id, envelope.version, envelope.error.code, envelope.error.message};
+  } else {
+    throw InvalidMessage("Root node, 'y' is not one of  {'q', 'r', 'e'}");
+  }
+}
+
+}
+
+namespace albert::bencoding::schema {
+
+// Only the compact peers are counted, other items are skipped by the iterator
+void Codec<krpc::wire::PeerList>::decode(Parser &parser, Token token, krpc::wire::PeerList &out) {
+  if (token != Token::ListBegin) {
+    throw SchemaError("expected a list");
+  }
+  auto start = parser.token_offset();
+  size_t count = 0;
+  for (auto item = parser.next(); item != Token::End; item = parser.next()) {
+    if (item == Token::String && parser.string().size() == krpc::wire::CompactPeerSize) {
+      count++;
+    } else {
+      parser.skip(item);
+    }
+  }
+  out = krpc::wire::PeerList(parser.data().subspan(start, parser.offset() - start), count);
+}
+
+void Codec<krpc::wire::ErrorBody>::decode(Parser &parser, Token token, krpc::wire::ErrorBody &out) {
+  if (token != Token::ListBegin || parser.next() != Token::Int) {
+    throw SchemaError("expected a list of an int and a string");
+  }
+  out.code = parser.integer();
+  if (parser.next() != Token::String) {
+    throw SchemaError("expected a list of an int and a string");
+  }
+  out.message = parser.string();
+  if (parser.next() != Token::End) {
+    throw SchemaError("expected a list of an int and a string");
+  }
+}
+
+}
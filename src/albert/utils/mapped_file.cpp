@@ -0,0 +1,48 @@
+#include <albert/utils/mapped_file.hpp>
+
+#include <cerrno>
+#include <cstring>
+
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace albert::utils {
+
+MappedFile::MappedFile(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("MappedFile: cannot open '" + path + "', " + strerror(errno));
+  }
+  struct stat st{};
+  if (::fstat(fd, &st) < 0) {
+    auto error = errno;
+    ::close(fd);
+    throw std::runtime_error("MappedFile: cannot stat '" + path + "', " + strerror(error));
+  }
+  size_ = st.st_size;
+  // mmap() does not accept a zero length, an empty file is an empty span
+  if (size_ > 0) {
+    auto p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+      auto error = errno;
+      ::close(fd);
+      throw std::runtime_error("MappedFile: cannot mmap '" + path + "', " + strerror(error));
+    }
+    // The whole file is usually read once from start to end
+    ::madvise(p, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<const uint8_t*>(p);
+  }
+  ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    ::munmap(const_cast<uint8_t*>(data_), size_);
+  }
+}
+
+}